@@ -1,3 +1,4 @@
+#pragma once
 
 #define height_mapping(x) (0.999 + 0.125 * x)
 
@@ -6,6 +7,11 @@
 #define START_LEVEL 1
 #define MAX_LEVEL 22
 
+// craters on the levels evaluated in the shader, set per program variant (PbrAsteroid::Variant)
+#ifndef CRATERS
+#define CRATERS 1
+#endif
+
 #define ICO_POINT0_X 0.8944271909999159
 #define ICO_POINT0_Y 0.
 #define ICO_POINT0_Z 0.447213595499958
@@ -271,8 +277,10 @@ void initCrater(in vec3 pos, in int vcount, out float vsector_size, out float va
 	}
 }
 
-// calculates smooth noise at any position on sphere (height and normal for current point)
-vec4 height_map(in vec3 Pos, in int Start, in float Count, in float Multiplier)
+// continues height_map() from the state after FirstLevel levels (baked by AsteroidSurfaceMap on CPU);
+// Normal1/Normal2 are sums of the first levels' ground and crater normals minus FirstLevel * normalize(Pos)
+vec4 height_map_continue(in vec3 Pos, in int Start, in float Count, in float Multiplier, in int FirstLevel,
+						 in float Height, in float OutsideCrater, in vec3 Normal1, in vec3 Normal2)
 {
 	// bumps part
 	// detect triangle of icosaedr and rotate it to convenient coordinate system
@@ -286,11 +294,11 @@ vec4 height_map(in vec3 Pos, in int Start, in float Count, in float Multiplier)
 
 	// prepare cycling by levels of details
 	vec3 avgnormal1 = vec3(0.0);
-	vec3 avgnormal2 = vec3(0.0);
-	float height = 0.5;
-	float outside_crater = 1.0;
-	int intPow = getIntPow(Start);
-	for (int level = 0; level < 1 + int(Count); level ++)
+	vec3 avgnormal2 = Normal2 + FirstLevel * pos;
+	float height = Height;
+	float outside_crater = OutsideCrater;
+	int intPow = getIntPow(Start + FirstLevel);
+	for (int level = FirstLevel; level < 1 + int(Count); level ++)
 	{
 		// get position inside triangles grid
 		vec2 cr1 = vec2(0.0), cr2 = vec2(0.0), cr3 = vec2(0.0);
@@ -317,7 +325,7 @@ vec4 height_map(in vec3 Pos, in int Start, in float Count, in float Multiplier)
 
 		// craters
 		vec3 nml = pos;                                                     	// normal by default
-		if (level > 1 && intPow >= 4 && Count > 0)
+		if (0 != CRATERS && level > 1 && intPow >= 4 && Count > 0)
 		{
 			int vcount = intPow;                                                // vectical sectors count
 			float vsector_size, vang, mult_length, hsector_size;                // calculate parameters needed for crater
@@ -370,9 +378,16 @@ vec4 height_map(in vec3 Pos, in int Start, in float Count, in float Multiplier)
 
 	avgnormal1.xz = rotate2D(avgnormal1.xz, -rotYang);                          // transform normals back to "global" coordinates
 	avgnormal1.xy = rotate2D(avgnormal1.xy, -rotZang);
+	avgnormal1 += Normal1 + FirstLevel * pos;
 	avgnormal1 = 2.0 * (normalize(avgnormal1) - pos) + pos;                    // weight of normals
 	avgnormal2 = 32.0 * (normalize(avgnormal2) - pos) + pos;
 	vec3 avgnormal = normalize(normalize(avgnormal1) + normalize(avgnormal2));  // mix normals of ground and crater
 
 	return vec4(avgnormal, height); // return height and normal
 }
+
+// calculates smooth noise at any position on sphere (height and normal for current point)
+vec4 height_map(in vec3 Pos, in int Start, in float Count, in float Multiplier)
+{
+	return height_map_continue(Pos, Start, Count, Multiplier, 0, 0.5, 1.0, vec3(0.0), vec3(0.0));
+}
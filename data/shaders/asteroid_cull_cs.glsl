@@ -0,0 +1,147 @@
+#version 450 core
+// Physically Based Rendering
+// * Forked from Michał Siejak PBR project
+
+// Culls asteroid patches of all instances and computes their tessellation levels.
+// Visible patches are appended to a compact list drawn by one non indexed indirect draw.
+
+#include "asteroid_instance.glsl"
+
+#define MAX_EDGE_LENGTH maxEdgeLength
+#define MAX_TESS min(tessLevelCap, maxTessLevel)
+
+// base displacement of vertices for each noise variant
+layout(std430, binding=0) readonly buffer VertexHeightBuffer
+{
+	float vertexHeight[];
+};
+
+// per noise variant and patch, object space: bounding sphere (center, radius)
+// and normal cone (axis, cutoff) of the displaced surface
+layout(std430, binding=1) readonly buffer PatchBoundsBuffer
+{
+	vec4 patchBounds[];
+};
+
+// Mesh::Vertex, 14 floats
+layout(std430, binding=4) readonly buffer VertexDataBuffer
+{
+	float vertexData[];
+};
+
+layout(std430, binding=5) readonly buffer FaceIndexBuffer
+{
+	uint faceIndices[];
+};
+
+layout(std430, binding=6) writeonly buffer VisiblePatchBuffer
+{
+	VisiblePatch visiblePatches[];
+};
+
+// DrawArraysIndirectCommand, count is reset to 0 before the dispatch
+layout(std430, binding=7) buffer DrawCommandBuffer
+{
+	uint drawVertexCount;
+	uint drawInstanceCount;
+	uint drawFirst;
+	uint drawBaseInstance;
+};
+
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+
+#define height_mapping(x) (0.999 + 0.125 * x)
+
+vec2 getScreenPos(in vec4 ViewPoint)
+{
+    vec2 vp = 0.5 * (ViewPoint.xy / max(ViewPoint.w, 0.000001) + 1.0);
+    return vp * viewport.zw + viewport.xy;
+}
+
+uint getTessLevel(vec4 p1, vec4 p2)
+{   // function expects points projected to view space
+    vec4 pc = 0.5 * (p1 + p2);                      // center point
+    float len = 0.5 * length(vec3(p1) - vec3(p2));  // get distance between points
+    vec4 pp1 = pc - vec4(len, 0.0, 0.0, 0.0);       // replace them with points aligned relative to camera
+    vec4 pp2 = pc + vec4(len, 0.0, 0.0, 0.0);
+    // get screen distance between points
+    float scrLen = length(getScreenPos(projectionMat * pp1)
+                            - getScreenPos(projectionMat * pp2));
+    return uint(0.5 + min(MAX_TESS, max(1, scrLen / MAX_EDGE_LENGTH)));
+}
+
+vec4 getRow(mat4 m, int i)
+{
+    return vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+}
+
+bool isOutsideFrustum(vec3 center, float radius)
+{   // side and near planes of the view projection
+    vec4 r0 = getRow(viewProjectionMat, 0);
+    vec4 r1 = getRow(viewProjectionMat, 1);
+    vec4 r2 = getRow(viewProjectionMat, 2);
+    vec4 r3 = getRow(viewProjectionMat, 3);
+    vec4 planes[5] = vec4[5](r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2);
+    for (int i = 0; i < 5; i++)
+    {
+        if (dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+vec3 getVertexPosition(uint index)
+{
+    return vec3(vertexData[14 * index], vertexData[14 * index + 1], vertexData[14 * index + 2]);
+}
+
+void main()
+{
+    uint patchIndex = gl_GlobalInvocationID.x;
+    uint instanceIndex = gl_WorkGroupID.y;
+    if (patchIndex >= uint(patchCount))
+    {
+        return;
+    }
+
+    AsteroidInstance instance = instances[instanceIndex];
+    float scale = length(instance.modelMat[0].xyz);
+    if (isOutsideFrustum(instance.modelMat[3].xyz, instance.boundingRadius))
+    {
+        return;
+    }
+
+    int bounds = 2 * (int(instance.noiseVariant) * patchCount + int(patchIndex));
+    vec4 sphere = patchBounds[bounds];
+    vec4 cone = patchBounds[bounds + 1];
+    vec3 center = vec3(instance.modelMat * vec4(sphere.xyz, 1.0));
+    float radius = scale * sphere.w;
+    if (isOutsideFrustum(center, radius))
+    {
+        return;
+    }
+    vec3 toCenter = center - eyePosition;
+    if (dot(toCenter, normalize(mat3(instance.modelMat) * cone.xyz)) >= cone.w * length(toCenter) + radius)
+    {   // back facing for every direction from the eye to the sphere
+        return;
+    }
+
+    mat4 modelViewMatrix = viewMat * instance.modelMat;
+    vec4 pp[3];
+    for (int i = 0; i < 3; i++)
+    {
+        uint vertex = faceIndices[3 * patchIndex + i];
+        float height = vertexHeight[int(instance.noiseVariant) * vertexCount + int(vertex)];
+        pp[i] = modelViewMatrix * vec4(height_mapping(height) * getVertexPosition(vertex), 1.0);
+    }
+    uint outer0 = getTessLevel(pp[1], pp[2]);
+    uint outer1 = getTessLevel(pp[2], pp[0]);
+    uint outer2 = getTessLevel(pp[0], pp[1]);
+    float maxLevel = float(max(outer0, max(outer1, outer2)));
+    uint inner = uint(0.5 + min(float(MAX_TESS), max(1.0, maxLevel - 1.0)));
+
+    uint slot = atomicAdd(drawVertexCount, 3u) / 3u;
+    visiblePatches[slot] = VisiblePatch(patchIndex, instanceIndex, outer0 | (outer1 << 8) | (outer2 << 16) | (inner << 24));
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Per frame uniforms and per instance data shared by all stages of the asteroid program,
+// must match PbrAsteroid::FrameUB and AsteroidInstanceData in opengl.hpp
+
+const int NumLights = 3;
+
+struct AnalyticalLight
+{
+	vec3 direction;
+	vec3 radiance;
+};
+
+struct AsteroidInstance
+{
+	mat4 modelMat;				// rotation, uniform scale and translation
+	vec4 albedoRoughness;		// albedo multiplier, roughness
+	float metalness;
+	uint noiseVariant;			// index into noiseRotation
+	float boundingRadius;		// world space radius of the displaced mesh
+	float reserved;
+	mat4 prevModelMat;			// model matrix of the previous frame, for motion vectors
+};
+
+// patch that passed culling, written by asteroid_cull_cs.glsl and drawn as one patch of three pulled vertices
+struct VisiblePatch
+{
+	uint patchIndex;
+	uint instanceIndex;
+	uint tessLevels;			// outer 0, 1, 2 and inner level, 8 bits each from the lowest
+};
+
+layout(std140, binding=0) uniform FrameUniforms
+{
+	mat4 viewMat;
+	mat4 projectionMat;
+	mat4 viewProjectionMat;
+	vec4 viewport;
+	AnalyticalLight lights[NumLights];
+	vec3 eyePosition;
+	int maxTessLevel;
+	int opaquePass;
+	int bakedLevels;			// noise levels stored in the surface maps, 0 when they are not bound
+	int vertexCount;			// per noise variant sizes of the base displacement buffers
+	int patchCount;
+	float maxEdgeLength;		// level of detail set by LodGovernor: screen space length of tessellated edges,
+	int tessLevelCap;			// cap of the tessellation levels
+	float noiseLevelBias;		// and bias of the noise levels evaluated per fragment
+	float normalSampleOffset;	// temporal anti-aliasing (PbrAsteroid::SetTemporal): rotation of the extra normal sample,
+	mat4 prevViewProjectionMat;	// view projection of the previous frame
+	vec4 jitter;				// and projection jitter in NDC of this (xy) and the previous frame (zw)
+};
+
+layout(std430, binding=2) readonly buffer InstanceBuffer
+{
+	AsteroidInstance instances[];
+};
+
+// the noise of a variant is evaluated at noiseRotation * direction, so one set of baked data serves
+// all variants; base displacement of vertices and patches is stored per variant
+layout(std430, binding=3) readonly buffer NoiseVariantBuffer
+{
+	mat4 noiseRotation[];
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+// Luminance histogram and exposure of the tone mapping, must match AutoExposure in opengl.hpp.
+// Bin 0 counts black texels, bins 1..255 split MinLogLuminance..MinLogLuminance + LogLuminanceRange
+// evenly in log2 luminance.
+
+const int HistogramBins = 256;
+const float MinLogLuminance = -10.0;
+const float LogLuminanceRange = 16.0;
+
+layout(std430, binding=8) buffer ExposureBuffer
+{
+	uint bins[HistogramBins];
+	float exposure;
+};
+
+uint luminanceBin(vec3 color)
+{
+	float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+	if (luminance < 0.0001)
+	{
+		return 0;
+	}
+	float t = clamp((log2(luminance) - MinLogLuminance) / LogLuminanceRange, 0.0, 1.0);
+	return uint(t * float(HistogramBins - 2) + 1.0);
+}
+
+float binLogLuminance(float bin)
+{
+	return (bin - 1.0) / float(HistogramBins - 2) * LogLuminanceRange + MinLogLuminance;
+}
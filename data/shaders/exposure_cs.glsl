@@ -0,0 +1,46 @@
+#version 450 core
+// Physically Based Rendering
+// * Forked from Michał Siejak PBR project
+
+// Reduction of the luminance histogram to the exposure of the tone mapping, one workgroup with
+// an invocation per bin. The exposure maps the average log luminance of the non-black texels to
+// the key value and follows it exponentially in log space; the histogram is cleared for the next frame.
+
+#include "exposure.glsl"
+
+layout(local_size_x=256) in;
+
+// 1 - exp(-elapsed time * adaptation speed), 1 jumps to the measured exposure
+layout(location=0) uniform float adaptation;
+// mid grey the average luminance is mapped to
+layout(location=1) uniform float keyValue;
+
+shared float weightedBins[HistogramBins];
+shared float counts[HistogramBins];
+
+void main()
+{
+	uint bin = gl_LocalInvocationIndex;
+	float count = (0 == bin) ? 0.0 : float(bins[bin]);
+	bins[bin] = 0;
+	weightedBins[bin] = count * float(bin);
+	counts[bin] = count;
+	barrier();
+
+	for (uint stride = HistogramBins / 2; stride > 0; stride >>= 1)
+	{
+		if (bin < stride)
+		{
+			weightedBins[bin] += weightedBins[bin + stride];
+			counts[bin] += counts[bin + stride];
+		}
+		barrier();
+	}
+
+	if (0 == bin && counts[0] > 0.0)
+	{
+		float averageLogLuminance = binLogLuminance(weightedBins[0] / counts[0]);
+		float targetLogExposure = log2(keyValue) - averageLogLuminance;
+		exposure = exp2(mix(log2(exposure), targetLogExposure, adaptation));
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// L2 spherical harmonics of the diffuse environment lighting, must match Environment in opengl.hpp
+// and the projection of ibl-bake. The 9 coefficients are stored premultiplied by the convolution with
+// the clamped cosine lobe divided by PI (1, 2/3, 1/4 per band), so like the irradiance map they replaced
+// they evaluate to exitant radiance of a white Lambertian surface.
+
+const int SHCoefficients = 9;
+
+// real spherical harmonics basis of bands 0 to 2 at unit direction n
+void shBasis(vec3 n, out float basis[SHCoefficients])
+{
+	basis[0] = 0.282095;
+	basis[1] = 0.488603 * n.y;
+	basis[2] = 0.488603 * n.z;
+	basis[3] = 0.488603 * n.x;
+	basis[4] = 1.092548 * n.x * n.y;
+	basis[5] = 1.092548 * n.y * n.z;
+	basis[6] = 0.315392 * (3.0 * n.z * n.z - 1.0);
+	basis[7] = 1.092548 * n.x * n.z;
+	basis[8] = 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+vec3 shIrradiance(const vec4 coefficients[SHCoefficients], vec3 n)
+{
+	float basis[SHCoefficients];
+	shBasis(n, basis);
+	vec3 result = vec3(0.0);
+	for (int i = 0; i < SHCoefficients; i++)
+	{
+		result += coefficients[i].rgb * basis[i];
+	}
+	return max(result, vec3(0.0));
+}
@@ -0,0 +1,99 @@
+#version 450 core
+// Physically Based Rendering
+// * Forked from Michał Siejak PBR project
+
+// Projects the environment onto L2 spherical harmonics for diffuse lighting, replacing the irradiance
+// cube map convolution. One workgroup reads every texel of a small mip level of the environment,
+// weights it by its solid angle and reduces the 9 coefficients in shared memory.
+
+#include "irradiance_sh.glsl"
+
+layout(binding=0) uniform samplerCube inputTexture;
+
+layout(std430, binding=0) writeonly buffer IrradianceSHBuffer
+{
+	vec4 coefficients[SHCoefficients];
+};
+
+// mip level of inputTexture that is projected
+layout(location=0) uniform int sourceLevel;
+
+const uint GroupSize = 128;
+layout(local_size_x=GroupSize) in;
+
+shared vec3 partial[SHCoefficients][GroupSize];
+
+// direction through the center of texel (x, y) of a face, same convention as getSamplingVector() of
+// the other precompute programs; uv is returned for the solid angle
+vec3 texelDirection(int face, ivec2 texel, int size, out vec2 uv)
+{
+	vec2 st = (vec2(texel) + 0.5) / float(size);
+	uv = 2.0 * vec2(st.x, 1.0 - st.y) - vec2(1.0);
+
+	vec3 ret;
+	if(face == 0)      ret = vec3(1.0,  uv.y, -uv.x);
+	else if(face == 1) ret = vec3(-1.0, uv.y,  uv.x);
+	else if(face == 2) ret = vec3(uv.x, 1.0, -uv.y);
+	else if(face == 3) ret = vec3(uv.x, -1.0, uv.y);
+	else if(face == 4) ret = vec3(uv.x, uv.y, 1.0);
+	else               ret = vec3(-uv.x, uv.y, -1.0);
+	return normalize(ret);
+}
+
+void main()
+{
+	uint index = gl_LocalInvocationIndex;
+	int size = textureSize(inputTexture, sourceLevel).x;
+	int texelsPerFace = size * size;
+
+	vec3 sum[SHCoefficients];
+	for (int i = 0; i < SHCoefficients; i++)
+	{
+		sum[i] = vec3(0.0);
+	}
+
+	for (int texel = int(index); texel < 6 * texelsPerFace; texel += int(GroupSize))
+	{
+		int face = texel / texelsPerFace;
+		int inFace = texel - face * texelsPerFace;
+		vec2 uv;
+		vec3 direction = texelDirection(face, ivec2(inFace % size, inFace / size), size, uv);
+
+		// solid angle of the texel: (2 / size)^2 projected onto the unit sphere
+		float texelArea = 2.0 / float(size);
+		float solidAngle = texelArea * texelArea / pow(1.0 + dot(uv, uv), 1.5);
+
+		vec3 radiance = textureLod(inputTexture, direction, float(sourceLevel)).rgb * solidAngle;
+		float basis[SHCoefficients];
+		shBasis(direction, basis);
+		for (int i = 0; i < SHCoefficients; i++)
+		{
+			sum[i] += radiance * basis[i];
+		}
+	}
+
+	for (int i = 0; i < SHCoefficients; i++)
+	{
+		partial[i][index] = sum[i];
+	}
+	barrier();
+
+	for (uint stride = GroupSize / 2; stride > 0; stride >>= 1)
+	{
+		if (index < stride)
+		{
+			for (int i = 0; i < SHCoefficients; i++)
+			{
+				partial[i][index] += partial[i][index + stride];
+			}
+		}
+		barrier();
+	}
+
+	if (index < SHCoefficients)
+	{
+		// convolution with the clamped cosine divided by PI, per band
+		float band = (0 == index) ? 1.0 : ((index < 4) ? 2.0 / 3.0 : 0.25);
+		coefficients[index] = vec4(partial[index][0] * band, 0.0);
+	}
+}
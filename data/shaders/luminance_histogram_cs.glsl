@@ -0,0 +1,41 @@
+#version 450 core
+// Physically Based Rendering
+// * Forked from Michał Siejak PBR project
+
+// Luminance histogram of the HDR scene colour for auto-exposure. The scene is downsampled by
+// point sampling one texel (sample 0 with MSAA) of every 2x2 block; each workgroup counts into
+// shared memory and adds its non-empty bins to the histogram of the frame once.
+
+#include "exposure.glsl"
+
+layout(local_size_x=16, local_size_y=16) in;
+
+#ifdef MULTISAMPLE
+layout(binding=0) uniform sampler2DMS sceneColor;
+#else
+layout(binding=0) uniform sampler2D sceneColor;
+#endif
+
+// rendered part of the scene targets
+layout(location=0) uniform ivec2 renderSize;
+
+shared uint localBins[HistogramBins];
+
+void main()
+{
+	localBins[gl_LocalInvocationIndex] = 0;
+	barrier();
+
+	ivec2 texel = 2 * ivec2(gl_GlobalInvocationID.xy);
+	if (all(lessThan(texel, renderSize)))
+	{
+		atomicAdd(localBins[luminanceBin(texelFetch(sceneColor, texel, 0).rgb)], 1);
+	}
+	barrier();
+
+	uint count = localBins[gl_LocalInvocationIndex];
+	if (count > 0)
+	{
+		atomicAdd(bins[gl_LocalInvocationIndex], count);
+	}
+}
@@ -0,0 +1,35 @@
+#version 450 core
+// Physically Based Rendering
+// * Forked from Michał Siejak PBR project
+
+// Depth pre-pass of the asteroid: positions of pbr_asteroid_es.glsl without shading outputs.
+// The position code has to stay identical to that shader, the shading pass tests depth with GL_EQUAL.
+
+layout(triangles, equal_spacing, ccw) in;
+
+layout(location=0) in vec3 position_es_in[];
+layout(location=5) flat in int instance_es_in[];
+
+#include "asteroid_instance.glsl"
+
+invariant gl_Position;
+
+#include "asteroid_base.glsl"
+
+vec3 interpolateHeight(vec3 v0, vec3 v1, vec3 v2)
+{
+	float newHeight = gl_TessCoord.x * length(v0) + gl_TessCoord.y * length(v1) + gl_TessCoord.z * length(v2);
+	return newHeight * normalize(gl_TessCoord.x * v0 + gl_TessCoord.y * v1 + gl_TessCoord.z * v2);
+}
+
+void main()
+{
+    AsteroidInstance instance = instances[instance_es_in[0]];
+    mat4 modelViewProjectionMat = viewProjectionMat * instance.modelMat;
+
+    vec3 mesh_pos = interpolateHeight(position_es_in[0], position_es_in[1], position_es_in[2]);
+    vec4 noise = height_map(mat3(noiseRotation[instance.noiseVariant]) * normalize(mesh_pos), START_LEVEL, MAX_LEVEL - 5, 1.0);
+    mesh_pos *= height_mapping(noise.a);
+
+    gl_Position = modelViewProjectionMat * vec4(mesh_pos, 1.0);
+}
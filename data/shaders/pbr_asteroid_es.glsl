@@ -7,20 +7,20 @@ layout(location=1) in vec3 normal_es_in[];
 layout(location=2) in vec2 texcoord_es_in[];
 layout(location=3) in vec3 tangent_es_in[];
 layout(location=4) in vec3 bitangent_es_in[];
+layout(location=5) flat in int instance_es_in[];
 
-layout(std140, binding=3) uniform ViewProjectionMatrixUniform
-{
-    mat4 modelMat;
-    mat4 viewMatrix;
-    mat4 modelViewProjectionMat;
-    vec4 viewport;
-};
+#include "asteroid_instance.glsl"
 
 layout(location=0) out vec2 koef_scr_diff_fs_in;
 layout(location=1) out vec2 texcoord_fs_in;
 layout(location=2) out vec3 position_fs_in;
 layout(location=3) out vec3 mesh_pos_fs_in;
 layout(location=4) out mat3 tangent_basis_fs_in;
+layout(location=7) flat out int instance_fs_in;
+layout(location=8) out vec4 prev_position_fs_in;	// clip space position of the previous frame, for motion vectors
+
+// matches the depth pre-pass (pbr_asteroid_depth_es.glsl)
+invariant gl_Position;
 
 #include "asteroid_base.glsl"
 
@@ -48,6 +48,11 @@ vec2 getScreenPos(in vec4 ViewPoint)
 
 void main()
 {
+    instance_fs_in = instance_es_in[0];
+    AsteroidInstance instance = instances[instance_fs_in];
+    mat4 modelMat = instance.modelMat;
+    mat4 modelViewProjectionMat = viewProjectionMat * modelMat;
+
     vec3 normal = normalize(interpolate3D(normal_es_in[0], normal_es_in[1], normal_es_in[2]));
 	vec3 tangent = normalize(interpolate3D(tangent_es_in[0], tangent_es_in[1], tangent_es_in[2]));
 	vec3 bitangent = normalize(interpolate3D(bitangent_es_in[0], bitangent_es_in[1], bitangent_es_in[2]));
@@ -56,17 +61,18 @@ void main()
 
     mesh_pos_fs_in = interpolateHeight(position_es_in[0], position_es_in[1], position_es_in[2]);
 
-    vec4 noise = height_map(normalize(mesh_pos_fs_in), START_LEVEL, MAX_LEVEL - 5, 1.0);//vec4(normalize(mesh_pos_fs_in), 0.5);//
+    vec4 noise = height_map(mat3(noiseRotation[instance.noiseVariant]) * normalize(mesh_pos_fs_in), START_LEVEL, MAX_LEVEL - 5, 1.0);//vec4(normalize(mesh_pos_fs_in), 0.5);//
 
 	mesh_pos_fs_in *= height_mapping(noise.a);
 
     tangent_basis_fs_in = mat3(tangent, bitangent, normal);
 	vec3 N = mat3(modelMat) * normalize(tangent_basis_fs_in * vec3(0, 0, 1));
-	vec3 eyeDir = normalize(vec3(viewMatrix * modelMat * vec4(mesh_pos_fs_in, 1.0)));
-    koef_scr_diff_fs_in.x = max(0.01, dot(normalize(mat3(viewMatrix) * N), normalize(-eyeDir)));
+	vec3 eyeDir = normalize(vec3(viewMat * modelMat * vec4(mesh_pos_fs_in, 1.0)));
+    koef_scr_diff_fs_in.x = max(0.01, dot(normalize(mat3(viewMat) * N), normalize(-eyeDir)));
 
 	vec4 position = vec4(mesh_pos_fs_in, 1.0);
     position_fs_in = vec3(modelMat * position);
+    prev_position_fs_in = prevViewProjectionMat * instance.prevModelMat * position;
     gl_Position = position = modelViewProjectionMat * position;
     const vec2 screenPos = getScreenPos(position);
 
@@ -3,16 +3,26 @@
 // * Forked from Michał Siejak PBR project
 
 // Physically Based shading model: Vertex program.
+// Vertices are pulled from the mesh buffers: every three vertices form one patch of the list
+// written by asteroid_cull_cs.glsl. The evaluation shaders displace the tessellated positions,
+// the precomputed base heights are only read by the cull pass.
 
-layout(location=0) in vec3 position;
-layout(location=1) in vec3 normal;
-layout(location=2) in vec3 tangent;
-layout(location=3) in vec3 bitangent;
-layout(location=4) in vec2 texcoord;
+#include "asteroid_instance.glsl"
 
-layout(std140, binding=0) uniform ModelMatrixUniform
+// Mesh::Vertex: position, normal, tangent, bitangent, texcoord
+layout(std430, binding=4) readonly buffer VertexDataBuffer
 {
-	mat4 modelViewProjectionMatrix;
+	float vertexData[];
+};
+
+layout(std430, binding=5) readonly buffer FaceIndexBuffer
+{
+	uint faceIndices[];
+};
+
+layout(std430, binding=6) readonly buffer VisiblePatchBuffer
+{
+	VisiblePatch visiblePatches[];
 };
 
 layout(location=0) out vec3 position_cs_in;
@@ -20,18 +30,25 @@ layout(location=1) out vec3 normal_cs_in;
 layout(location=2) out vec2 texcoord_cs_in;
 layout(location=3) out vec3 tangent_cs_in;
 layout(location=4) out vec3 bitangent_cs_in;
+layout(location=6) flat out int instance_cs_in;
 
-#include "asteroid_base.glsl"
+vec3 getVertexData3(uint offset)
+{
+	return vec3(vertexData[offset], vertexData[offset + 1], vertexData[offset + 2]);
+}
 
 void main()
 {
+	VisiblePatch visible = visiblePatches[gl_VertexID / 3];
+	uint vertex = faceIndices[3 * visible.patchIndex + uint(gl_VertexID % 3)];
+	uint base = 14 * vertex;
+
+	vec2 texcoord = vec2(vertexData[base + 12], vertexData[base + 13]);
 	texcoord_cs_in = vec2(texcoord.x, 1.0 - texcoord.y);
-	normal_cs_in = normalize(normal);
-	tangent_cs_in = tangent;
-	bitangent_cs_in = bitangent;
-
-	position_cs_in = position;
-	vec4 noise = height_map(normalize(position_cs_in), START_LEVEL, MAX_LEVEL - 5, 1.0);
-	vec4 proj = modelViewProjectionMatrix * vec4(height_mapping(noise.a) * position_cs_in, 1.0);
-	gl_Position = proj;
+	normal_cs_in = normalize(getVertexData3(base + 3));
+	tangent_cs_in = getVertexData3(base + 6);
+	bitangent_cs_in = getVertexData3(base + 9);
+
+	instance_cs_in = int(visible.instanceIndex);
+	position_cs_in = getVertexData3(base);
 }
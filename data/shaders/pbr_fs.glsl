@@ -48,9 +48,16 @@ layout(binding=1) uniform sampler2D normalTexture;
 layout(binding=2) uniform sampler2D metalnessTexture;
 layout(binding=3) uniform sampler2D roughnessTexture;
 layout(binding=4) uniform samplerCube specularTexture;
-layout(binding=5) uniform samplerCube irradianceTexture;
 layout(binding=6) uniform sampler2D specularBRDF_LUT;
 
+#include "irradiance_sh.glsl"
+
+// diffuse environment lighting projected by irradiance_sh_cs.glsl
+layout(std140, binding=3) uniform IrradianceUniforms
+{
+	vec4 irradianceSH[SHCoefficients];
+};
+
 // GGX/Towbridge-Reitz normal distribution function.
 // Uses Disney's reparametrization of alpha = roughness^2.
 float ndfGGX(float cosLh, float roughness)
@@ -152,8 +159,8 @@ void main()
 	// Ambient lighting (IBL).
 	vec3 ambientLighting;
 	{
-		// Sample diffuse irradiance at normal direction.
-		vec3 irradiance = texture(irradianceTexture, N).rgb;
+		// Evaluate diffuse irradiance at normal direction.
+		vec3 irradiance = shIrradiance(irradianceSH, N);
 
 		// Calculate Fresnel term for ambient lighting.
 		// Since we use pre-filtered cubemap(s) and irradiance is coming from many directions
@@ -164,7 +171,7 @@ void main()
 		// Get diffuse contribution factor (as with direct lighting).
 		vec3 kd = mix(vec3(1.0) - F, vec3(0.0), metalness);
 
-		// Irradiance map contains exitant radiance assuming Lambertian BRDF, no need to scale by 1/PI here either.
+		// Irradiance SH evaluates to exitant radiance assuming Lambertian BRDF, no need to scale by 1/PI here either.
 		vec3 diffuseIBL = kd * albedo * irradiance;
 
 		// Sample pre-filtered specular reflection environment at correct mipmap level.
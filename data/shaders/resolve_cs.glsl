@@ -0,0 +1,52 @@
+#version 450 core
+// Physically Based Rendering
+// * Forked from Michał Siejak PBR project
+
+// Resolve of the multisampled scene targets, OIT composition and tone mapping in one pass:
+// samples are read directly from the multisample textures, every attachment is averaged like
+// a blit resolve before the composition, the result is written to the LDR output image which
+// is blitted (and scaled with dynamic resolution) to the window.
+
+#include "tonemap.glsl"
+
+layout(local_size_x=8, local_size_y=8) in;
+
+layout(binding=0) uniform sampler2DMS opaqueTex;
+#ifndef NO_TRANSPARENCY
+layout(binding=1) uniform sampler2DMS accTex;
+layout(binding=2) uniform sampler2DMS counter;
+#endif
+layout(binding=0, rgba8) writeonly uniform image2D outputImage;
+
+// rendered part of the targets
+layout(location=0) uniform ivec2 renderSize;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, renderSize)))
+	{
+		return;
+	}
+
+	int samples = textureSamples(opaqueTex);
+	vec3 Cbg = vec3(0.0);
+#ifndef NO_TRANSPARENCY
+	vec4 acc = vec4(0.0);
+	float cnt = 0.0;
+#endif
+	for (int i = 0; i < samples; i++)
+	{
+		Cbg += texelFetch(opaqueTex, texel, i).rgb;
+#ifndef NO_TRANSPARENCY
+		acc += texelFetch(accTex, texel, i);
+		cnt += texelFetch(counter, texel, i).r;
+#endif
+	}
+	Cbg /= float(samples);
+#ifndef NO_TRANSPARENCY
+	Cbg = composeTransparency(Cbg, acc / float(samples), cnt / float(samples));
+#endif
+
+	imageStore(outputImage, texel, vec4(tonemap(Cbg), 1.0));
+}
@@ -4,8 +4,19 @@
 
 // Environment skybox: Fragment program.
 
+layout(std140, binding=0) uniform SkyboxUniforms
+{
+	mat4 skyViewProjectionMatrix;
+	mat4 prevSkyViewProjectionMatrix;
+	vec4 jitter;
+};
+
 layout(location=0) in vec3 localPosition;
+layout(location=1) in vec4 clipPosition;
+layout(location=2) in vec4 prevClipPosition;
 layout(location=0) out vec4 color;
+// NDC motion since the previous frame without the jitter, used only by temporal anti-aliasing
+layout(location=3) out vec2 velocity;
 
 layout(binding=0) uniform samplerCube envTexture;
 
@@ -13,4 +24,5 @@ void main()
 {
 	vec3 envVector = normalize(localPosition);
 	color = textureLod(envTexture, envVector, 0);
+	velocity = (clipPosition.xy / clipPosition.w - jitter.xy) - (prevClipPosition.xy / prevClipPosition.w - jitter.zw);
 }
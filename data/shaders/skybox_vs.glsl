@@ -6,13 +6,19 @@
 layout(std140, binding=0) uniform SkyboxUniforms
 {
 	mat4 skyViewProjectionMatrix;
+	mat4 prevSkyViewProjectionMatrix;	// of the previous frame, for motion vectors
+	vec4 jitter;						// projection jitter in NDC of this (xy) and the previous frame (zw)
 };
 
 layout(location=0) in vec3 position;
 layout(location=0) out vec3 localPosition;
+layout(location=1) out vec4 clipPosition;
+layout(location=2) out vec4 prevClipPosition;
 
 void main()
 {
 	localPosition = position.xyz;
 	gl_Position   = skyViewProjectionMatrix * vec4(position, 1.0);
+	clipPosition = gl_Position;
+	prevClipPosition = prevSkyViewProjectionMatrix * vec4(position, 1.0);
 }
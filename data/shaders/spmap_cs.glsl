@@ -9,9 +9,6 @@ const float PI = 3.141592;
 const float TwoPI = 2 * PI;
 const float Epsilon = 0.00001;
 
-const uint NumSamples = 1024;
-const float InvNumSamples = 1.0 / float(NumSamples);
-
 // In OpenGL only a single mip level is bound.
 const int NumMipLevels = 1;
 layout(binding=0) uniform samplerCube inputTexture;
@@ -19,6 +16,9 @@ layout(binding=0, rgba16f) restrict writeonly uniform imageCube outputTexture[Nu
 
 // Roughness value to pre-filter for.
 layout(location=0) uniform float roughness;
+// GGX samples per texel of the quality tier; filtered importance sampling below keeps 32-128 of them
+// close to the 1024 sample reference.
+layout(location=1) uniform int sampleCount;
 
 #define PARAM_LEVEL     0
 #define PARAM_ROUGHNESS roughness
@@ -35,10 +35,10 @@ float radicalInverse_VdC(uint bits)
 	return float(bits) * 2.3283064365386963e-10; // / 0x100000000
 }
 
-// Sample i-th point from Hammersley point set of NumSamples points total.
-vec2 sampleHammersley(uint i)
+// Sample i-th point from Hammersley point set of numSamples points total.
+vec2 sampleHammersley(uint i, uint numSamples)
 {
-	return vec2(i * InvNumSamples, radicalInverse_VdC(i));
+	return vec2(float(i) / float(numSamples), radicalInverse_VdC(i));
 }
 
 // Importance sample GGX normal distribution function for a fixed roughness value.
@@ -127,11 +127,12 @@ void main(void)
 
 	vec3 color = vec3(0);
 	float weight = 0;
+	uint numSamples = uint(max(sampleCount, 1));
 
 	// Convolve environment map using GGX NDF importance sampling.
 	// Weight by cosine term since Epic claims it generally improves quality.
-	for(uint i=0; i<NumSamples; ++i) {
-		vec2 u = sampleHammersley(i);
+	for(uint i=0; i<numSamples; ++i) {
+		vec2 u = sampleHammersley(i, numSamples);
 		vec3 Lh = tangentToWorld(sampleGGX(u.x, u.y, PARAM_ROUGHNESS), N, S, T);
 
 		// Compute incident direction (Li) by reflecting viewing direction (Lo) around half-vector (Lh).
@@ -149,7 +150,7 @@ void main(void)
 			float pdf = ndfGGX(cosLh, PARAM_ROUGHNESS) * 0.25;
 
 			// Solid angle associated with this sample.
-			float ws = 1.0 / (NumSamples * pdf);
+			float ws = 1.0 / (float(numSamples) * pdf);
 
 			// Mip level to sample from.
 			float mipLevel = max(0.5 * log2(ws / wt) + 1.0, 0.0);
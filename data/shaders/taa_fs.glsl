@@ -0,0 +1,79 @@
+#version 450 core
+// Physically Based Rendering
+// * Forked from Michał Siejak PBR project
+
+// Temporal anti-aliasing resolve: composes the OIT layers of the current single sampled frame,
+// reprojects the history by the motion vectors and clamps it to the colour range of the 3x3
+// neighbourhood before blending. Drawn over the rendered part of the targets, the result is the
+// history of the next frame and the input of the tone mapping.
+// See: "High Quality Temporal Supersampling", Karis, SIGGRAPH 2014
+
+#include "tonemap.glsl"
+
+layout(location=0) in  vec2 screenPosition;
+layout(binding=0) uniform sampler2D opaqueTex;
+#ifndef NO_TRANSPARENCY
+layout(binding=1) uniform sampler2D accTex;
+layout(binding=2) uniform sampler2D counter;
+#endif
+layout(binding=3) uniform sampler2D velocityTex;
+layout(binding=4) uniform sampler2D historyTex;
+
+// xy scales screen to texture coordinates of the rendered part, zw is its last texel centre (see tonemap_fs.glsl)
+layout(location=0) uniform vec4 sourceRect;
+// weight of the history, 0 when there is none
+layout(location=1) uniform float historyWeight;
+
+layout(location=0) out vec4 outColor;
+
+vec3 sceneColor(ivec2 texel)
+{
+	vec3 Cbg = texelFetch(opaqueTex, texel, 0).rgb;
+#ifndef NO_TRANSPARENCY
+	Cbg = composeTransparency(Cbg, texelFetch(accTex, texel, 0), texelFetch(counter, texel, 0).r);
+#endif
+	return Cbg;
+}
+
+float luminance(vec3 color)
+{
+	return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	ivec2 lastTexel = ivec2(sourceRect.zw * vec2(textureSize(opaqueTex, 0)));
+
+	vec3 current = sceneColor(texel);
+	vec3 neighbourMin = current;
+	vec3 neighbourMax = current;
+	for (int y = -1; y <= 1; y++)
+	{
+		for (int x = -1; x <= 1; x++)
+		{
+			if (0 != x || 0 != y)
+			{
+				vec3 neighbour = sceneColor(clamp(texel + ivec2(x, y), ivec2(0), lastTexel));
+				neighbourMin = min(neighbourMin, neighbour);
+				neighbourMax = max(neighbourMax, neighbour);
+			}
+		}
+	}
+
+	vec2 texcoord = screenPosition * sourceRect.xy;
+	vec2 velocity = texelFetch(velocityTex, texel, 0).xy;
+	vec2 historyTexcoord = texcoord - 0.5 * velocity * sourceRect.xy;
+	float weight = historyWeight;
+	if (any(lessThan(historyTexcoord, vec2(0.0))) || any(greaterThan(historyTexcoord, sourceRect.xy)))
+	{
+		weight = 0.0;		// disoccluded at the border, nothing to reproject
+	}
+	vec3 history = texture(historyTex, min(historyTexcoord, sourceRect.zw)).rgb;
+	history = clamp(history, neighbourMin, neighbourMax);
+
+	// blend weighted by inverse luminance so that bright HDR samples do not dominate the average
+	float currentWeight = (1.0 - weight) / (1.0 + luminance(current));
+	float historyWeighted = weight / (1.0 + luminance(history));
+	outColor = vec4((current * currentWeight + history * historyWeighted) / max(currentWeight + historyWeighted, 0.00001), 1.0);
+}
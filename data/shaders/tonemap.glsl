@@ -0,0 +1,41 @@
+#pragma once
+
+// Order Independent Transparency composition and tone mapping shared by the resolve (resolve_cs.glsl),
+// the TAA resolve (taa_fs.glsl) and the tone mapping of the TAA history (tonemap_fs.glsl).
+// The exposure is read from the buffer of AutoExposure, fixed or measured on the GPU every frame.
+
+#include "exposure.glsl"
+
+const float gamma     = 1.8;
+const float pureWhite = 1.0;
+
+// Order Independent Transparency (OIT), see https://developer.download.nvidia.com/SDK/10/opengl/src/dual_depth_peeling/doc/DualDepthPeeling.pdf
+// accumulated colour and alpha of cnt transparent layers over the opaque background
+vec3 composeTransparency(vec3 Cbg, vec4 acc, float cnt)
+{
+	if (cnt > 0)
+	{
+		vec3 C = acc.rgb / cnt;
+		float A = acc.a / cnt;
+		float oneMinusA_N = pow(1. - A, cnt);
+		Cbg = C * (1. - oneMinusA_N) + Cbg * oneMinusA_N;
+	}
+	return Cbg;
+}
+
+// Tone-mapping & gamma correction.
+vec3 tonemap(vec3 hdrColor)
+{
+	vec3 color = hdrColor * exposure;
+
+	// Reinhard tonemapping operator.
+	// see: "Photographic Tone Reproduction for Digital Images", eq. 4
+	float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+	float mappedLuminance = (luminance * (1.0 + luminance / (pureWhite * pureWhite))) / (1.0 + luminance);
+
+	// Scale color by ratio of average luminances.
+	vec3 mappedColor = (mappedLuminance / luminance) * color;
+
+	// Gamma correction.
+	return pow(mappedColor, vec3(1.0/gamma));
+}
@@ -8,9 +8,14 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <numeric>
+#include <vector>
 #include <GLFW/glfw3.h>
 
 #include "application.hpp"
+#include "image.hpp"
 
 #include <iostream>
 
@@ -31,13 +36,9 @@ Application::Application()
 	, m_prevCursorY(0.0)
 	, m_mode(InputMode::None)
 {
-	if (!glfwInit())
-	{
-		throw std::runtime_error("Failed to initialize GLFW library");
-	}
-
 	m_viewSettings.distance = ViewDistance;
 	m_viewSettings.fov      = ViewFOV;
+	m_viewSettings.m_diffCursorX = m_viewSettings.m_diffCursorY = 0;
 
 	m_sceneSettings.lights[0] = { glm::normalize(glm::vec3{-1.0f,  0.0f, 0.0f}), glm::vec3{1.0f}, false };
 	m_sceneSettings.lights[1] = { glm::normalize(glm::vec3{ 1.0f,  0.0f, 0.0f}), glm::vec3{1.0f}, false };
@@ -55,6 +56,12 @@ Application::~Application()
 
 void Application::run(const std::unique_ptr<RendererInterface>& renderer)
 {
+	// GLFW is initialized here, the headless mode must not need a display server
+	if (!glfwInit())
+	{
+		throw std::runtime_error("Failed to initialize GLFW library");
+	}
+
 	m_window = renderer->initialize(DisplaySizeX, DisplaySizeY, DisplaySamples);
 
 	glfwSetWindowUserPointer(m_window, this);
@@ -64,7 +71,11 @@ void Application::run(const std::unique_ptr<RendererInterface>& renderer)
 	glfwSetKeyCallback(m_window, Application::keyCallback);
 	glfwSetFramebufferSizeCallback(m_window, framebufferSizeCallback);
 
-	m_onResize = renderer->setup();
+	m_onResize = renderer->setup(m_sceneSettings);
+	if (!m_frameReport.empty())
+	{
+		renderer->openFrameReport(m_frameReport);
+	}
 
 	while(!glfwWindowShouldClose(m_window)) {
 		renderer->render(m_window, m_viewSettings, m_sceneSettings);
@@ -93,6 +104,66 @@ void Application::run(const std::unique_ptr<RendererInterface>& renderer)
 	renderer->shutdown();
 }
 
+void Application::runHeadless(const std::unique_ptr<RendererInterface>& renderer, const HeadlessOptions& options)
+{
+	if (!renderer->initializeHeadless(options.width, options.height, DisplaySamples))
+	{
+		throw std::runtime_error("Headless rendering is not available");
+	}
+	renderer->setup(m_sceneSettings);
+	renderer->finish();
+	if (!m_frameReport.empty())
+	{
+		renderer->openFrameReport(m_frameReport);
+	}
+
+	std::vector<double> frameTimes;
+	frameTimes.reserve(options.frames);
+	for (int frame = 0; frame < options.frames; frame++)
+	{
+		// frame time includes the wait for GPU, frames are not pipelined
+		const auto start = std::chrono::steady_clock::now();
+		renderer->render(nullptr, m_viewSettings, m_sceneSettings);
+		renderer->finish();
+		const std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - start;
+		frameTimes.push_back(frameTime.count());
+		std::cout << "frame " << frame << ": " << std::fixed << std::setprecision(3) << frameTime.count() << " ms" << std::endl;
+	}
+
+	if (!frameTimes.empty())
+	{
+		std::vector<double> sorted = frameTimes;
+		std::sort(sorted.begin(), sorted.end());
+		const double average = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+		std::cout << std::fixed << std::setprecision(3)
+				  << "frames: " << sorted.size() << ", " << options.width << "x" << options.height
+				  << ", min " << sorted.front() << " ms, average " << average
+				  << " ms, median " << sorted[sorted.size() / 2] << " ms, max " << sorted.back() << " ms" << std::endl;
+	}
+
+	if (!options.outputDirectory.empty() && options.frames > 0)
+	{
+		std::vector<unsigned char> pixels;
+		int width, height;
+		renderer->readFrame(pixels, width, height);
+		std::string filename = options.outputDirectory;
+		if (filename.back() != '/' && filename.back() != '\\')
+		{
+			filename += '/';
+		}
+		filename += "frame.png";
+		std::error_code error;
+		std::filesystem::create_directories(options.outputDirectory, error);
+		if (!Image::writePng(filename, width, height, 4, pixels.data()))
+		{
+			throw std::runtime_error("Failed to write image file: " + filename);
+		}
+		std::cout << "Frame written to " << filename << std::endl;
+	}
+
+	renderer->shutdown();
+}
+
 void Application::mousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 {
 	Application* self = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
@@ -189,6 +260,23 @@ void Application::keyCallback(GLFWwindow* window, int key, int /*scancode*/, int
 		case GLFW_KEY_F3:
 			light = &self->m_sceneSettings.lights[2];
 			break;
+		case GLFW_KEY_F4:
+			self->m_sceneSettings.depthPrePass = !self->m_sceneSettings.depthPrePass;
+			std::cout << "Depth pre-pass " << (self->m_sceneSettings.depthPrePass ? "on" : "off") << std::endl;
+			break;
+		case GLFW_KEY_F5:
+			self->m_sceneSettings.temporalAA = !self->m_sceneSettings.temporalAA;
+			std::cout << "Anti-aliasing " << (self->m_sceneSettings.temporalAA ? "TAA" : "MSAA") << std::endl;
+			break;
+		case GLFW_KEY_F6:
+			self->m_sceneSettings.autoExposure = !self->m_sceneSettings.autoExposure;
+			std::cout << "Auto-exposure " << (self->m_sceneSettings.autoExposure ? "on" : "off") << std::endl;
+			break;
+		case GLFW_KEY_F7:
+			// the renderer prints the tier once its maps are in place
+			self->m_sceneSettings.environmentQuality = EnvironmentMaps::Quality(
+				(int(self->m_sceneSettings.environmentQuality) + 1) % int(EnvironmentMaps::Quality::NumQualities));
+			break;
 		case GLFW_KEY_ESCAPE:
 			glfwSetWindowShouldClose(window, 1);
 			break;
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include "renderer.hpp"
 
 class Application
@@ -15,7 +16,30 @@ public:
 	Application();
 	~Application();
 
+	struct HeadlessOptions
+	{
+		int frames = 100;
+		int width = 1280;
+		int height = 720;
+		std::string outputDirectory;	// the last frame is written there as PNG when not empty
+	};
+
+	// CSV or JSON lines file for per frame stage timings of either mode
+	void setFrameReport(const std::string& filename) { m_frameReport = filename; }
+	void setAsteroidCount(int count) { m_sceneSettings.asteroidCount = count; }
+	void setDepthPrePass(bool enabled) { m_sceneSettings.depthPrePass = enabled; }
+	void setNoiseLevels(int levels) { m_sceneSettings.noiseLevels = levels; }
+	void setCraters(bool enabled) { m_sceneSettings.craters = enabled; }
+	void setGpuBudget(double milliseconds) { m_sceneSettings.gpuBudgetMs = milliseconds; }
+	void setResolutionBudget(double milliseconds) { m_sceneSettings.resolutionBudgetMs = milliseconds; }
+	void setTemporalAA(bool enabled) { m_sceneSettings.temporalAA = enabled; }
+	void setAutoExposure(bool enabled) { m_sceneSettings.autoExposure = enabled; }
+	void setEnvironmentQuality(EnvironmentMaps::Quality quality) { m_sceneSettings.environmentQuality = quality; }
+	void setSurfaceMapResolution(int resolution) { m_sceneSettings.surfaceMapResolution = resolution; }
+
 	void run(const std::unique_ptr<RendererInterface>& renderer);
+	// renders without a window and prints per frame timings
+	void runHeadless(const std::unique_ptr<RendererInterface>& renderer, const HeadlessOptions& options);
 
 private:
 	static void mousePositionCallback(GLFWwindow* window, double xpos, double ypos);
@@ -39,4 +63,5 @@ private:
 	InputMode m_mode;
 
 	std::function<void (int w, int h)> m_onResize;
+	std::string m_frameReport;
 };
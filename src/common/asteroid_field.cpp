@@ -0,0 +1,80 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <cmath>
+#include <random>
+
+#include "asteroid_field.hpp"
+
+namespace {
+	const float Pi = 3.14159265358979f;
+
+	// uniform [0, 1) from the raw generator output, distributions of the standard library
+	// differ between implementations and the field has to be the same everywhere
+	float uniform(std::mt19937& rng)
+	{
+		return static_cast<float>(rng() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float uniform(std::mt19937& rng, float from, float to)
+	{
+		return from + (to - from) * uniform(rng);
+	}
+
+	glm::vec3 randomDirection(std::mt19937& rng)
+	{
+		const float z = uniform(rng, -1.0f, 1.0f);
+		const float phi = uniform(rng, 0.0f, 2.0f * Pi);
+		const float r = std::sqrt(1.0f - z * z);
+		return glm::vec3{ r * std::cos(phi), r * std::sin(phi), z };
+	}
+}
+
+std::vector<AsteroidField::Instance> AsteroidField::generate(int count, uint32_t seed, float innerRadius, float outerRadius)
+{
+	std::mt19937 rng{ seed };
+	std::vector<Instance> instances;
+	instances.reserve(count > 0 ? count : 0);
+	for (int i = 0; i < count; i++)
+	{
+		Instance instance;
+		// flat belt: uniform by area in the XZ plane, small vertical spread
+		const float distance = std::sqrt(uniform(rng, innerRadius * innerRadius, outerRadius * outerRadius));
+		const float angle = uniform(rng, 0.0f, 2.0f * Pi);
+		instance.position = glm::vec3{ distance * std::cos(angle), uniform(rng, -0.5f, 0.5f), distance * std::sin(angle) };
+		// many small, few large
+		const float size = uniform(rng);
+		instance.scale = 0.03f + 0.3f * size * size * size;
+		instance.rotationAxis = randomDirection(rng);
+		instance.rotationAngle = uniform(rng, 0.0f, 2.0f * Pi);
+		const float tone = uniform(rng, 0.7f, 1.2f);
+		instance.albedo = glm::vec3{ tone * uniform(rng, 0.95f, 1.05f), tone, tone * uniform(rng, 0.9f, 1.0f) };
+		instance.roughness = uniform(rng, 0.75f, 0.95f);
+		instance.metalness = uniform(rng, 0.02f, 0.1f);
+		instance.seed = static_cast<uint32_t>(rng());
+		instances.push_back(instance);
+	}
+	return instances;
+}
+
+glm::mat3 AsteroidField::noiseRotation(int variant)
+{
+	if (0 == variant)
+	{
+		return glm::mat3{ 1.0f };
+	}
+	// uniformly distributed rotation (Shoemake) from a generator seeded by the variant
+	std::mt19937 rng{ static_cast<uint32_t>(variant) * 2654435761u };
+	const float u1 = uniform(rng), u2 = uniform(rng), u3 = uniform(rng);
+	const float a = std::sqrt(1.0f - u1), b = std::sqrt(u1);
+	const float x = a * std::sin(2.0f * Pi * u2);
+	const float y = a * std::cos(2.0f * Pi * u2);
+	const float z = b * std::sin(2.0f * Pi * u3);
+	const float w = b * std::cos(2.0f * Pi * u3);
+	return glm::mat3{
+		glm::vec3{ 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y) },
+		glm::vec3{ 2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x) },
+		glm::vec3{ 2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y) } };
+}
@@ -0,0 +1,40 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Deterministic placement of asteroids around the scene asteroid.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class AsteroidField
+{
+public:
+	// instances pick one of the noise variants by their seed; every variant costs one
+	// evaluation of the base displacement on load, so the count is kept small
+	static constexpr int NoiseVariants = 8;
+
+	struct Instance
+	{
+		glm::vec3 position;
+		float scale;				// relative to the scene asteroid
+		glm::vec3 rotationAxis;
+		float rotationAngle;
+		glm::vec3 albedo;			// multiplier of the albedo texture
+		float roughness;
+		float metalness;
+		uint32_t seed;
+	};
+
+	// count instances in a belt around the origin, distances in radii of the scene asteroid
+	static std::vector<Instance> generate(int count, uint32_t seed, float innerRadius = 3.0f, float outerRadius = 12.0f);
+
+	// rotation of the noise domain for a variant, variant 0 is the identity
+	static glm::mat3 noiseRotation(int variant);
+	static int noiseVariant(uint32_t seed) { return static_cast<int>(seed % NoiseVariants); }
+};
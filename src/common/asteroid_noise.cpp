@@ -0,0 +1,173 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <atomic>
+
+#if defined(ASTEROID_NOISE_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include "asteroid_noise.hpp"
+#include "asteroid_noise_kernel.hpp"
+
+void AsteroidNoiseKernel::heightMapScalar(const float *positions, std::size_t count, float *results,
+										  int start, float levelCount, float multiplier)
+{
+	heightMapArray<float>(positions, count, results, start, levelCount, multiplier);
+}
+
+void AsteroidNoiseKernel::levelStateScalar(const float *positions, std::size_t count, float *results,
+										   int start, float levelCount, float multiplier, int levels)
+{
+	levelStateArray<float>(positions, count, results, start, levelCount, multiplier, levels);
+}
+
+namespace
+{
+	bool cpuSupportsAvx2()
+	{
+#if !defined(ASTEROID_NOISE_X86)
+		return false;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	bool cpuSupportsSse41()
+	{
+#if !defined(ASTEROID_NOISE_X86)
+		return false;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 19)) != 0;
+#else
+		return __builtin_cpu_supports("sse4.1");
+#endif
+	}
+
+	AsteroidNoiseKernel::Entry kernelEntry(AsteroidNoise::Kernel kernel)
+	{
+		switch (kernel)
+		{
+#if defined(ASTEROID_NOISE_X86)
+		case AsteroidNoise::Kernel::Sse41:	return AsteroidNoiseKernel::heightMapSse41;
+		case AsteroidNoise::Kernel::Avx2:	return AsteroidNoiseKernel::heightMapAvx2;
+		case AsteroidNoise::Kernel::Avx2x2:	return AsteroidNoiseKernel::heightMapAvx2x2;
+#endif
+		default:							return AsteroidNoiseKernel::heightMapScalar;
+		}
+	}
+
+	AsteroidNoiseKernel::LevelStateEntry levelStateEntry(AsteroidNoise::Kernel kernel)
+	{
+		switch (kernel)
+		{
+#if defined(ASTEROID_NOISE_X86)
+		case AsteroidNoise::Kernel::Sse41:	return AsteroidNoiseKernel::levelStateSse41;
+		case AsteroidNoise::Kernel::Avx2:	return AsteroidNoiseKernel::levelStateAvx2;
+		case AsteroidNoise::Kernel::Avx2x2:	return AsteroidNoiseKernel::levelStateAvx2x2;
+#endif
+		default:							return AsteroidNoiseKernel::levelStateScalar;
+		}
+	}
+
+	AsteroidNoise::Kernel detectKernel()
+	{
+		if (cpuSupportsAvx2())
+		{
+			return AsteroidNoise::Kernel::Avx2x2;
+		}
+		if (cpuSupportsSse41())
+		{
+			return AsteroidNoise::Kernel::Sse41;
+		}
+		return AsteroidNoise::Kernel::Scalar;
+	}
+
+	std::atomic<AsteroidNoise::Kernel>& currentKernel()
+	{
+		static std::atomic<AsteroidNoise::Kernel> kernel { detectKernel() };
+		return kernel;
+	}
+}
+
+glm::vec4 AsteroidNoise::heightMap(const glm::vec3& position, int start, float levelCount, float multiplier)
+{
+	glm::vec4 result;
+	AsteroidNoiseKernel::heightMapScalar(&position.x, 1, &result.x, start, levelCount, multiplier);
+	return result;
+}
+
+void AsteroidNoise::heightMap(const glm::vec3* positions, std::size_t count, glm::vec4* results,
+							  int start, float levelCount, float multiplier)
+{
+	static_assert(sizeof(glm::vec3) == 3 * sizeof(float) && sizeof(glm::vec4) == 4 * sizeof(float),
+				  "kernels expect tightly packed vectors");
+	kernelEntry(kernel())(&positions->x, count, &results->x, start, levelCount, multiplier);
+}
+
+void AsteroidNoise::levelState(const glm::vec3* positions, std::size_t count, LevelState* results,
+							   int start, float levelCount, float multiplier, int levels)
+{
+	static_assert(sizeof(LevelState) == 8 * sizeof(float), "kernels expect tightly packed state");
+	levelStateEntry(kernel())(&positions->x, count, &results->normal.x, start, levelCount, multiplier, levels);
+}
+
+AsteroidNoise::Kernel AsteroidNoise::kernel()
+{
+	return currentKernel().load(std::memory_order_relaxed);
+}
+
+bool AsteroidNoise::isSupported(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Scalar:	return true;
+	case Kernel::Sse41:		return cpuSupportsSse41();
+	case Kernel::Avx2:
+	case Kernel::Avx2x2:	return cpuSupportsAvx2();
+	}
+	return false;
+}
+
+bool AsteroidNoise::setKernel(Kernel kernel)
+{
+	if (!isSupported(kernel))
+	{
+		return false;
+	}
+	currentKernel().store(kernel, std::memory_order_relaxed);
+	return true;
+}
+
+const char* AsteroidNoise::kernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::Scalar:	return "scalar";
+	case Kernel::Sse41:		return "SSE4.1";
+	case Kernel::Avx2:		return "AVX2";
+	case Kernel::Avx2x2:	return "AVX2 x2";
+	}
+	return "unknown";
+}
@@ -0,0 +1,67 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * CPU implementation of the asteroid surface noise (height_map() in asteroid_base.glsl).
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+// Results follow the shader code path for path; sin/cos/atan/log/exp are own single precision
+// polynomials (sin/cos reduce the argument in double precision). random3D() multiplies sin() by
+// 43758, so one ulp of sin() moves a hash by ~3e-3 and every implementation of sin() - this one,
+// a GPU driver - yields a slightly different surface. Agreement with height_map() of
+// asteroid_base.glsl over random directions: height error median 5e-5, 99th percentile 6e-4,
+// maximum 0.06 where a crater threshold flips; normal components 99th percentile 0.12 at full
+// detail (fine levels are not attenuated in normals), 4e-3 at 6 levels. asteroid-noise-test pins
+// heights within 1e-3 and, at 6 levels, normals within 1e-2 on reference directions. Use the CPU
+// result as a close match of the shader, not a bit exact one.
+// All kernels return bit identical results, so the choice of kernel never changes data.
+class AsteroidNoise
+{
+public:
+	// bump when results change, invalidates data baked from the noise
+	static constexpr int Version = 1;
+
+	static constexpr int StartLevel = 1;
+	static constexpr int MaxLevel = 22;
+	// detail levels used for the base displacement of mesh vertices
+	static constexpr int BaseLevelCount = MaxLevel - 5;
+
+	enum class Kernel
+	{
+		Scalar,
+		Sse41,		// 4 positions per iteration
+		Avx2,		// 8 positions per iteration
+		Avx2x2,		// two interleaved AVX2 packs, 16 positions per iteration
+	};
+
+	// vec4(normal, height) for a position on the unit sphere
+	static glm::vec4 heightMap(const glm::vec3& position, int start, float levelCount, float multiplier);
+	static void heightMap(const glm::vec3* positions, std::size_t count, glm::vec4* results,
+						  int start, float levelCount, float multiplier);
+
+	// state of the height_map() loop after the first levels, continued on GPU by height_map_continue()
+	struct LevelState
+	{
+		glm::vec3 normal;			// avgnormal1 minus levels * direction, model space
+		float height;
+		glm::vec3 craterNormal;		// avgnormal2 minus levels * direction
+		float outsideCrater;
+	};
+	static void levelState(const glm::vec3* positions, std::size_t count, LevelState* results,
+						   int start, float levelCount, float multiplier, int levels);
+
+	// height_mapping() from the shader: radius multiplier for a height value
+	static float heightMapping(float height) { return 0.999f + 0.125f * height; }
+
+	// fastest kernel supported by the CPU is selected on first use
+	static Kernel kernel();
+	static bool isSupported(Kernel kernel);
+	// returns false and keeps current kernel when the requested one is not supported
+	static bool setKernel(Kernel kernel);
+	static const char* kernelName(Kernel kernel);
+};
@@ -0,0 +1,123 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Asteroid surface noise: AVX2 kernels, 8 positions per pack and pairs of packs.
+ */
+
+#include <immintrin.h>
+
+#include "asteroid_noise_kernel.hpp"
+
+// the unit is built without FMA on purpose: contracted multiply-adds would change rounding
+// and make results differ from the scalar and SSE4.1 kernels
+
+namespace
+{
+
+struct Mask8
+{
+	__m256 v;
+};
+
+struct Float8
+{
+	__m256 v;
+
+	Float8() = default;
+	Float8(float s) : v(_mm256_set1_ps(s)) {}
+	Float8(__m256 x) : v(x) {}
+};
+
+template <> struct PackTraits<Float8>
+{
+	using Mask = Mask8;
+	static constexpr int Width = 8;
+	static Float8 load(const float *src) { return _mm256_loadu_ps(src); }
+	static void store(float *dst, const Float8 &v) { _mm256_storeu_ps(dst, v.v); }
+};
+
+inline Float8 operator + (const Float8 &a, const Float8 &b) { return _mm256_add_ps(a.v, b.v); }
+inline Float8 operator - (const Float8 &a, const Float8 &b) { return _mm256_sub_ps(a.v, b.v); }
+inline Float8 operator * (const Float8 &a, const Float8 &b) { return _mm256_mul_ps(a.v, b.v); }
+inline Float8 operator / (const Float8 &a, const Float8 &b) { return _mm256_div_ps(a.v, b.v); }
+inline Float8 operator - (const Float8 &a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+
+inline Mask8 operator <  (const Float8 &a, const Float8 &b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline Mask8 operator <= (const Float8 &a, const Float8 &b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+inline Mask8 operator >  (const Float8 &a, const Float8 &b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline Mask8 operator >= (const Float8 &a, const Float8 &b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+inline Mask8 operator == (const Float8 &a, const Float8 &b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+inline Mask8 operator != (const Float8 &a, const Float8 &b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ) }; }
+
+inline Mask8 operator & (const Mask8 &a, const Mask8 &b) { return { _mm256_and_ps(a.v, b.v) }; }
+inline Mask8 operator | (const Mask8 &a, const Mask8 &b) { return { _mm256_or_ps(a.v, b.v) }; }
+inline Mask8 operator ! (const Mask8 &a) { return { _mm256_xor_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(-1))) }; }
+
+inline Float8 vselect(const Mask8 &m, const Float8 &a, const Float8 &b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+inline bool vany(const Mask8 &m) { return 0 != _mm256_movemask_ps(m.v); }
+inline Float8 vfloor(const Float8 &x) { return _mm256_floor_ps(x.v); }
+inline Float8 vtrunc(const Float8 &x) { return _mm256_round_ps(x.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+inline Float8 vsqrt(const Float8 &x) { return _mm256_sqrt_ps(x.v); }
+inline Float8 vabs(const Float8 &x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x.v); }
+inline Float8 vmin(const Float8 &a, const Float8 &b) { return _mm256_min_ps(a.v, b.v); }
+inline Float8 vmax(const Float8 &a, const Float8 &b) { return _mm256_max_ps(a.v, b.v); }
+
+inline Float8 vsplitExponent(const Float8 &x, Float8 &exponent)
+{
+	const __m256i bits = _mm256_castps_si256(x.v);
+	const __m256i e = _mm256_and_si256(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(0xff));
+	exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(e, _mm256_set1_epi32(126)));
+	const __m256i m = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(int(0x807fffff))), _mm256_set1_epi32(0x3f000000));
+	return _mm256_castsi256_ps(m);
+}
+
+inline Float8 vscalePow2(const Float8 &x, const Float8 &n)
+{
+	const __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n.v), _mm256_set1_epi32(127)), 23);
+	return _mm256_mul_ps(x.v, _mm256_castsi256_ps(e));
+}
+
+inline __m256d reduceHalfPi(__m256d d, __m256d &quadrant)
+{
+	const __m256d n = _mm256_round_pd(_mm256_mul_pd(d, _mm256_set1_pd(TwoOverPiD)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	const __m256d r = _mm256_sub_pd(_mm256_sub_pd(d, _mm256_mul_pd(n, _mm256_set1_pd(PiOver2HiD))),
+									_mm256_mul_pd(n, _mm256_set1_pd(PiOver2LoD)));
+	quadrant = _mm256_sub_pd(n, _mm256_mul_pd(_mm256_floor_pd(_mm256_mul_pd(n, _mm256_set1_pd(0.25))), _mm256_set1_pd(4.0)));
+	return r;
+}
+
+inline Float8 vreduceHalfPi(const Float8 &x, Float8 &quadrant)
+{
+	__m256d qlo, qhi;
+	const __m256d rlo = reduceHalfPi(_mm256_cvtps_pd(_mm256_castps256_ps128(x.v)), qlo);
+	const __m256d rhi = reduceHalfPi(_mm256_cvtps_pd(_mm256_extractf128_ps(x.v, 1)), qhi);
+	quadrant = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(qlo)), _mm256_cvtpd_ps(qhi), 1);
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(rlo)), _mm256_cvtpd_ps(rhi), 1);
+}
+
+} // anonymous namespace
+
+void AsteroidNoiseKernel::heightMapAvx2(const float *positions, std::size_t count, float *results,
+										int start, float levelCount, float multiplier)
+{
+	heightMapArray<Float8>(positions, count, results, start, levelCount, multiplier);
+}
+
+void AsteroidNoiseKernel::levelStateAvx2(const float *positions, std::size_t count, float *results,
+										 int start, float levelCount, float multiplier, int levels)
+{
+	levelStateArray<Float8>(positions, count, results, start, levelCount, multiplier, levels);
+}
+
+void AsteroidNoiseKernel::heightMapAvx2x2(const float *positions, std::size_t count, float *results,
+										  int start, float levelCount, float multiplier)
+{
+	heightMapArray<Pair<Float8>>(positions, count, results, start, levelCount, multiplier);
+}
+
+void AsteroidNoiseKernel::levelStateAvx2x2(const float *positions, std::size_t count, float *results,
+										   int start, float levelCount, float multiplier, int levels)
+{
+	levelStateArray<Pair<Float8>>(positions, count, results, start, levelCount, multiplier, levels);
+}
@@ -0,0 +1,765 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Asteroid surface noise: kernel shared by scalar and SIMD implementations.
+ */
+
+#pragma once
+
+// This header is included only by asteroid_noise*.cpp. Every translation unit compiles the
+// kernel for its own instruction set, so everything except the entry points below lives in
+// an anonymous namespace to keep SSE/AVX code from leaking into other units through the linker.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace AsteroidNoiseKernel
+{
+	// Positions are packed xyz triples, results are packed (normal.xyz, height) quadruples.
+	using Entry = void (*)(const float *positions, std::size_t count, float *results,
+							int start, float levelCount, float multiplier);
+	// level state results are (normal1.xyz, height, normal2.xyz, outsideCrater) octuples
+	using LevelStateEntry = void (*)(const float *positions, std::size_t count, float *results,
+										int start, float levelCount, float multiplier, int levels);
+
+	void heightMapScalar(const float *positions, std::size_t count, float *results, int start, float levelCount, float multiplier);
+	void heightMapSse41(const float *positions, std::size_t count, float *results, int start, float levelCount, float multiplier);
+	void heightMapAvx2(const float *positions, std::size_t count, float *results, int start, float levelCount, float multiplier);
+	void heightMapAvx2x2(const float *positions, std::size_t count, float *results, int start, float levelCount, float multiplier);
+
+	void levelStateScalar(const float *positions, std::size_t count, float *results, int start, float levelCount, float multiplier, int levels);
+	void levelStateSse41(const float *positions, std::size_t count, float *results, int start, float levelCount, float multiplier, int levels);
+	void levelStateAvx2(const float *positions, std::size_t count, float *results, int start, float levelCount, float multiplier, int levels);
+	void levelStateAvx2x2(const float *positions, std::size_t count, float *results, int start, float levelCount, float multiplier, int levels);
+}
+
+namespace
+{
+
+constexpr float Pi = 3.1415926535897932384626433832795f;
+constexpr float HalfPi = 0.5f * Pi;
+constexpr float TwoPi = 2.0f * Pi;
+constexpr float Ang36 = 36.0f * Pi / 180.0f;
+constexpr float Ang72 = 72.0f * Pi / 180.0f;
+
+constexpr float IcoPoint0X = 0.8944271909999159f;
+constexpr float IcoPoint0Z = 0.447213595499958f;
+constexpr float IcoPoint1X = 0.7236067977499789f;
+constexpr float IcoPoint1Y = 0.5257311121191336f;
+constexpr float IcoPoint1Z = -0.447213595499958f;
+
+constexpr float Phi = 16.1803398874989484820459f;
+
+// rotation of central belt triangles around Y axis, rads(+-138.1896851042214) in the shader
+const float CentralBeltSin = float(std::sin(138.1896851042214 * 3.1415926535897932384626433832795 / 180.0));
+const float CentralBeltCos = float(std::cos(138.1896851042214 * 3.1415926535897932384626433832795 / 180.0));
+
+// argument reduction by pi/2 is done in double precision, the hash feeds sin() values up to ~1e9
+constexpr double TwoOverPiD = 6.36619772367581382433e-01;
+constexpr double PiOver2HiD = 1.57079632673412561417e+00;
+constexpr double PiOver2LoD = 6.07710050650619224932e-11;
+
+//==========================================================================================================================
+// scalar primitives, SIMD packs provide the same set of functions for their types
+template <class F> struct PackTraits;
+
+template <> struct PackTraits<float>
+{
+	using Mask = bool;
+	static constexpr int Width = 1;
+	static float load(const float *src) { return *src; }
+	static void store(float *dst, float v) { *dst = v; }
+};
+
+inline float vselect(bool m, float a, float b) { return m ? a : b; }
+inline bool vany(bool m) { return m; }
+inline float vfloor(float x) { return std::floor(x); }
+inline float vtrunc(float x) { return std::trunc(x); }
+inline float vsqrt(float x) { return std::sqrt(x); }
+inline float vabs(float x) { return std::fabs(x); }
+// same operand order as minps/maxps so every kernel agrees bit for bit
+inline float vmin(float a, float b) { return (a < b) ? a : b; }
+inline float vmax(float a, float b) { return (a > b) ? a : b; }
+
+// mantissa in [0.5, 1) and exponent of a positive normal number, like frexp()
+inline float vsplitExponent(float x, float &exponent)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+	exponent = float(int((bits >> 23) & 0xff) - 126);
+	bits = (bits & 0x807fffffu) | 0x3f000000u;
+	float mantissa;
+	std::memcpy(&mantissa, &bits, sizeof(mantissa));
+	return mantissa;
+}
+
+// x * 2^n for integral n in the normal range
+inline float vscalePow2(float x, float n)
+{
+	const uint32_t bits = uint32_t(int(n) + 127) << 23;
+	float pow2;
+	std::memcpy(&pow2, &bits, sizeof(pow2));
+	return x * pow2;
+}
+
+// x - n * pi / 2 and n mod 4
+inline float vreduceHalfPi(float x, float &quadrant)
+{
+	const double d = x;
+	const double n = std::nearbyint(d * TwoOverPiD);
+	const double r = (d - n * PiOver2HiD) - n * PiOver2LoD;
+	quadrant = float(n - std::floor(n * 0.25) * 4.0);
+	return float(r);
+}
+
+//==========================================================================================================================
+// two packs processed as one, doubles the independent work per iteration
+template <class F> struct PairMask;
+
+template <class F> struct Pair
+{
+	F lo, hi;
+
+	Pair() = default;
+	Pair(float s) : lo(s), hi(s) {}
+	Pair(const F &l, const F &h) : lo(l), hi(h) {}
+
+	friend Pair operator + (const Pair &a, const Pair &b) { return { a.lo + b.lo, a.hi + b.hi }; }
+	friend Pair operator - (const Pair &a, const Pair &b) { return { a.lo - b.lo, a.hi - b.hi }; }
+	friend Pair operator * (const Pair &a, const Pair &b) { return { a.lo * b.lo, a.hi * b.hi }; }
+	friend Pair operator / (const Pair &a, const Pair &b) { return { a.lo / b.lo, a.hi / b.hi }; }
+	friend Pair operator - (const Pair &a) { return { -a.lo, -a.hi }; }
+
+	friend PairMask<F> operator <  (const Pair &a, const Pair &b) { return { a.lo <  b.lo, a.hi <  b.hi }; }
+	friend PairMask<F> operator <= (const Pair &a, const Pair &b) { return { a.lo <= b.lo, a.hi <= b.hi }; }
+	friend PairMask<F> operator >  (const Pair &a, const Pair &b) { return { a.lo >  b.lo, a.hi >  b.hi }; }
+	friend PairMask<F> operator >= (const Pair &a, const Pair &b) { return { a.lo >= b.lo, a.hi >= b.hi }; }
+	friend PairMask<F> operator == (const Pair &a, const Pair &b) { return { a.lo == b.lo, a.hi == b.hi }; }
+	friend PairMask<F> operator != (const Pair &a, const Pair &b) { return { a.lo != b.lo, a.hi != b.hi }; }
+
+	friend Pair vfloor(const Pair &x) { return { vfloor(x.lo), vfloor(x.hi) }; }
+	friend Pair vtrunc(const Pair &x) { return { vtrunc(x.lo), vtrunc(x.hi) }; }
+	friend Pair vsqrt(const Pair &x) { return { vsqrt(x.lo), vsqrt(x.hi) }; }
+	friend Pair vabs(const Pair &x) { return { vabs(x.lo), vabs(x.hi) }; }
+	friend Pair vmin(const Pair &a, const Pair &b) { return { vmin(a.lo, b.lo), vmin(a.hi, b.hi) }; }
+	friend Pair vmax(const Pair &a, const Pair &b) { return { vmax(a.lo, b.lo), vmax(a.hi, b.hi) }; }
+	friend Pair vsplitExponent(const Pair &x, Pair &e) { return { vsplitExponent(x.lo, e.lo), vsplitExponent(x.hi, e.hi) }; }
+	friend Pair vscalePow2(const Pair &x, const Pair &n) { return { vscalePow2(x.lo, n.lo), vscalePow2(x.hi, n.hi) }; }
+	friend Pair vreduceHalfPi(const Pair &x, Pair &q) { return { vreduceHalfPi(x.lo, q.lo), vreduceHalfPi(x.hi, q.hi) }; }
+};
+
+template <class F> struct PairMask
+{
+	using M = typename PackTraits<F>::Mask;
+	M lo, hi;
+
+	friend PairMask operator & (const PairMask &a, const PairMask &b) { return { a.lo & b.lo, a.hi & b.hi }; }
+	friend PairMask operator | (const PairMask &a, const PairMask &b) { return { a.lo | b.lo, a.hi | b.hi }; }
+	friend PairMask operator ! (const PairMask &a) { return { !a.lo, !a.hi }; }
+
+	friend Pair<F> vselect(const PairMask &m, const Pair<F> &a, const Pair<F> &b) { return { vselect(m.lo, a.lo, b.lo), vselect(m.hi, a.hi, b.hi) }; }
+	friend bool vany(const PairMask &m) { return vany(m.lo) || vany(m.hi); }
+};
+
+template <class F> struct PackTraits<Pair<F>>
+{
+	using Mask = PairMask<F>;
+	static constexpr int Width = 2 * PackTraits<F>::Width;
+	static Pair<F> load(const float *src) { return { PackTraits<F>::load(src), PackTraits<F>::load(src + PackTraits<F>::Width) }; }
+	static void store(float *dst, const Pair<F> &v) { PackTraits<F>::store(dst, v.lo); PackTraits<F>::store(dst + PackTraits<F>::Width, v.hi); }
+};
+
+//==========================================================================================================================
+// small vector types mirroring GLSL vec2/vec3 over packs
+template <class F> struct Vec2
+{
+	F x, y;
+
+	friend Vec2 operator + (const Vec2 &a, const Vec2 &b) { return { a.x + b.x, a.y + b.y }; }
+	friend Vec2 operator - (const Vec2 &a, const Vec2 &b) { return { a.x - b.x, a.y - b.y }; }
+	friend Vec2 operator * (const Vec2 &a, const F &s) { return { a.x * s, a.y * s }; }
+};
+
+template <class F> struct Vec3
+{
+	F x, y, z;
+
+	friend Vec3 operator + (const Vec3 &a, const Vec3 &b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	friend Vec3 operator - (const Vec3 &a, const Vec3 &b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	friend Vec3 operator * (const Vec3 &a, const F &s) { return { a.x * s, a.y * s, a.z * s }; }
+	friend Vec3 operator * (const F &s, const Vec3 &a) { return { a.x * s, a.y * s, a.z * s }; }
+};
+
+template <class F, class M> inline Vec2<F> vselect(const M &m, const Vec2<F> &a, const Vec2<F> &b)
+{
+	return { vselect(m, a.x, b.x), vselect(m, a.y, b.y) };
+}
+
+template <class F, class M> inline Vec3<F> vselect(const M &m, const Vec3<F> &a, const Vec3<F> &b)
+{
+	return { vselect(m, a.x, b.x), vselect(m, a.y, b.y), vselect(m, a.z, b.z) };
+}
+
+template <class F> inline F dot(const Vec2<F> &a, const Vec2<F> &b) { return a.x * b.x + a.y * b.y; }
+template <class F> inline F dot(const Vec3<F> &a, const Vec3<F> &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+template <class F> inline F length(const Vec2<F> &v) { return vsqrt(dot(v, v)); }
+template <class F> inline F length(const Vec3<F> &v) { return vsqrt(dot(v, v)); }
+
+template <class F> inline Vec3<F> normalize(const Vec3<F> &v)
+{
+	return v * (F(1.0f) / length(v));
+}
+
+// rotate2D() from asteroid_base.glsl with sine and cosine of the angle known up front
+template <class F> inline Vec2<F> rotate2D(const Vec2<F> &src, const F &sinang, const F &cosang)
+{
+	return { src.x * cosang - src.y * sinang,
+			 src.x * sinang + src.y * cosang };
+}
+
+//==========================================================================================================================
+// elementary functions, Cephes single precision polynomials evaluated identically for every pack type
+template <class F> inline F vclamp(const F &x, const F &lo, const F &hi)
+{
+	return vmin(vmax(x, lo), hi);
+}
+
+template <class F> inline F vfract(const F &x)
+{
+	return x - vfloor(x);
+}
+
+template <class F> inline F vsign(const F &x)
+{
+	using M = typename PackTraits<F>::Mask;
+	const M pos = x > F(0.0f);
+	const M neg = x < F(0.0f);
+	return vselect(pos, F(1.0f), vselect(neg, F(-1.0f), F(0.0f)));
+}
+
+template <class F> inline F smoothstep(const F &edge0, const F &edge1, const F &x)
+{
+	const F t = vclamp((x - edge0) / (edge1 - edge0), F(0.0f), F(1.0f));
+	return t * t * (F(3.0f) - F(2.0f) * t);
+}
+
+template <class F> inline void vsincos(const F &x, F &s, F &c)
+{
+	using M = typename PackTraits<F>::Mask;
+	F quadrant;
+	const F r = vreduceHalfPi(x, quadrant);
+	const F z = r * r;
+	const F sinr = ((F(-1.9515295891e-4f) * z + F(8.3321608736e-3f)) * z - F(1.6666654611e-1f)) * z * r + r;
+	const F cosr = ((F(2.443315711809948e-5f) * z - F(1.388731625493765e-3f)) * z + F(4.166664568298827e-2f)) * z * z
+					- F(0.5f) * z + F(1.0f);
+	const M odd = (quadrant == F(1.0f)) | (quadrant == F(3.0f));
+	const M negSin = quadrant >= F(2.0f);
+	const M negCos = (quadrant == F(1.0f)) | (quadrant == F(2.0f));
+	s = vselect(odd, cosr, sinr);
+	s = vselect(negSin, -s, s);
+	c = vselect(odd, sinr, cosr);
+	c = vselect(negCos, -c, c);
+}
+
+template <class F> inline F vsin(const F &x)
+{
+	F s, c;
+	vsincos(x, s, c);
+	return s;
+}
+
+template <class F> inline F vcos(const F &x)
+{
+	F s, c;
+	vsincos(x, s, c);
+	return c;
+}
+
+// atan2(y, x), zero when both arguments are zero
+template <class F> inline F vatan2(const F &y, const F &x)
+{
+	using M = typename PackTraits<F>::Mask;
+	const F ax = vabs(x), ay = vabs(y);
+	const F t = ay / ax;
+	const M big = t > F(2.414213562373095f);
+	const M mid = (!big) & (t > F(0.4142135623730950f));
+	const F base = vselect(big, F(HalfPi), vselect(mid, F(0.25f * Pi), F(0.0f)));
+	const F v = vselect(big, F(-1.0f) / t, vselect(mid, (t - F(1.0f)) / (t + F(1.0f)), t));
+	const F z = v * v;
+	F a = base + (((F(8.05374449538e-2f) * z - F(1.38776856032e-1f)) * z + F(1.99777106478e-1f)) * z
+					- F(3.33329491539e-1f)) * z * v + v;
+	a = vselect((ax == F(0.0f)) & (ay == F(0.0f)), F(0.0f), a);
+	a = vselect(x < F(0.0f), F(Pi) - a, a);
+	return vselect(y < F(0.0f), -a, a);
+}
+
+// natural logarithm for positive arguments
+template <class F> inline F vlog(const F &x)
+{
+	using M = typename PackTraits<F>::Mask;
+	F e;
+	F m = vsplitExponent(x, e);
+	const M small = m < F(0.707106781186547524f);
+	e = vselect(small, e - F(1.0f), e);
+	m = vselect(small, m + m - F(1.0f), m - F(1.0f));
+	const F z = m * m;
+	F y = ((((((((F(7.0376836292e-2f) * m - F(1.1514610310e-1f)) * m + F(1.1676998740e-1f)) * m
+			- F(1.2420140846e-1f)) * m + F(1.4249322787e-1f)) * m - F(1.6668057665e-1f)) * m
+			+ F(2.0000714765e-1f)) * m - F(2.4999993993e-1f)) * m + F(3.3333331174e-1f)) * m * z;
+	y = y + F(-2.12194440e-4f) * e;
+	y = y - F(0.5f) * z;
+	return m + y + F(0.693359375f) * e;
+}
+
+template <class F> inline F vexp(const F &x)
+{
+	const F xc = vclamp(x, F(-87.0f), F(88.0f));
+	const F n = vfloor(xc * F(1.44269504088896341f) + F(0.5f));
+	F r = xc - n * F(0.693359375f);
+	r = r - n * F(-2.12194440e-4f);
+	const F z = r * r;
+	const F y = (((((F(1.9875691500e-4f) * r + F(1.3981999507e-3f)) * r + F(8.3334519073e-3f)) * r
+				+ F(4.1665795894e-2f)) * r + F(1.6666665459e-1f)) * r + F(5.0000001201e-1f)) * z + r + F(1.0f);
+	return vscalePow2(y, n);
+}
+
+//==========================================================================================================================
+// port of asteroid_base.glsl, function names follow the shader
+template <class F> inline F random3D(const Vec3<F> &p)
+{
+	const F l = F(7.0f) + vlog(p.z + F(119.0f));
+	const F argx = (p.x + F(Phi)) * l;
+	const F argy = (p.y + F(Phi)) * l;
+	const F d = (argx * F(Pi) / F(1021.0f)) * F(12.9898f) + (argy * F(Pi) / F(1021.0f)) * F(78.233f);
+	return vfract(vsin(d) * F(43758.5453123f));
+}
+
+template <class F> inline F random2D(const Vec2<F> &p)
+{
+	return random3D(Vec3<F>{ p.x, p.y, F(Phi) });
+}
+
+template <class F> inline F g(const F &ro, float v, const F &radius)
+{
+	const F _ro = ro / radius;
+	return -(vcos(F(Pi - v) * _ro * _ro + F(v)) + F(1.0f));
+}
+
+template <class F> inline F gdiff2(const F &ro, float v, const F &radius)
+{
+	const F _ro = ro / radius;
+	const F pi_v = F(Pi - v);
+	return F(2.0f) * pi_v * _ro * vsin(pi_v * _ro * _ro + F(v));
+}
+
+// transform from the sphere into the coordinate system of the "convenient" icosahedron triangle
+template <class F> struct IcoFrame
+{
+	Vec3<F> localPos, localNormal;
+	F sinZ, cosZ;		// rotZang
+	F sinY, cosY;		// rotYang
+	Vec2<F> dispY;		// rotYdisp
+};
+
+template <class F> inline IcoFrame<F> recognizeIcoTriangle(const Vec3<F> &pos)
+{
+	using M = typename PackTraits<F>::Mask;
+	const F zero(0.0f);
+	const F angxy = vatan2(pos.y, pos.x);
+
+	// lower belt and lower central belt
+	F sinA, cosA;
+	vsincos(-vfloor((angxy + F(Ang36)) / F(Ang72)) * F(Ang72), sinA, cosA);
+	const Vec2<F> xyA = rotate2D(Vec2<F>{ pos.x, pos.y }, sinA, cosA);
+	const Vec3<F> normalA { xyA.x, xyA.y, pos.z };
+	const F dividerA = F(IcoPoint1X - IcoPoint0X) * normalA.z + F(IcoPoint0Z - IcoPoint1Z) * normalA.x;
+	const M positiveA = dividerA > zero;
+	const Vec3<F> posA = vselect(positiveA, normalA * (F(IcoPoint0Z * IcoPoint1X - IcoPoint0X * IcoPoint1Z) / dividerA), normalA);
+	const M lowerBelt = positiveA & (posA.z <= F(IcoPoint1Z));
+	const M lowerCentral = positiveA & (!lowerBelt) & (posA.z <= F(IcoPoint0Z))
+							& (vabs(posA.y) <= F(IcoPoint1Y) * (posA.z - F(IcoPoint0Z)) / F(IcoPoint1Z - IcoPoint0Z));
+
+	const Vec3<F> lowerBeltPos = posA * (F(IcoPoint1X) / (F(1.0f + IcoPoint1Z) * posA.x - F(IcoPoint1X) * posA.z));
+	const Vec2<F> lowerDisp { F(IcoPoint1X), F(IcoPoint1Z) };
+	const Vec2<F> lowerXZ = rotate2D(Vec2<F>{ posA.x, posA.z } - lowerDisp, F(CentralBeltSin), F(CentralBeltCos)) + lowerDisp;
+	const Vec2<F> lowerNormalXZ = rotate2D(Vec2<F>{ normalA.x, normalA.z }, F(CentralBeltSin), F(CentralBeltCos));
+	const M branchA = lowerBelt | lowerCentral;
+
+	// upper belt and upper central belt
+	F sinB, cosB;
+	vsincos(-(vfloor(angxy / F(Ang72)) * F(Ang72) + F(Ang36)), sinB, cosB);
+	const Vec2<F> xyB = rotate2D(Vec2<F>{ pos.x, pos.y }, sinB, cosB);
+	const Vec3<F> normalB { xyB.x, xyB.y, pos.z };
+	const F dividerB = F(IcoPoint1X - IcoPoint0X) * normalB.z + F(IcoPoint1Z - IcoPoint0Z) * normalB.x;
+	const M negativeB = (!branchA) & (dividerB < zero);
+	const Vec3<F> posB = normalB * (F(IcoPoint0X * IcoPoint1Z - IcoPoint0Z * IcoPoint1X) / dividerB);
+	const M upperBelt = negativeB & (posB.z >= F(IcoPoint0Z));
+	const M upperCentral = negativeB & (!upperBelt);
+
+	const Vec3<F> upperBeltPos = posB * (F(IcoPoint1X) / (F(1.0f - IcoPoint0Z) * posB.x + F(IcoPoint1X) * posB.z));
+	const Vec2<F> upperDisp { F(IcoPoint1X), F(IcoPoint0Z) };
+	const Vec2<F> upperXZ = rotate2D(Vec2<F>{ posB.x, posB.z } - upperDisp, F(-CentralBeltSin), F(CentralBeltCos)) + upperDisp;
+	const Vec2<F> upperNormalXZ = rotate2D(Vec2<F>{ normalB.x, normalB.z }, F(-CentralBeltSin), F(CentralBeltCos));
+
+	// merge branches
+	IcoFrame<F> frame;
+	frame.sinZ = vselect(branchA, sinA, sinB);
+	frame.cosZ = vselect(branchA, cosA, cosB);
+
+	Vec3<F> localPosB = vselect(upperBelt, upperBeltPos, normalB);
+	localPosB = vselect(upperCentral, Vec3<F>{ upperXZ.x, posB.y, upperXZ.y }, localPosB);
+	const Vec3<F> localPosA = vselect(lowerBelt, lowerBeltPos, Vec3<F>{ lowerXZ.x, posA.y, lowerXZ.y });
+	frame.localPos = vselect(branchA, localPosA, localPosB);
+
+	const Vec3<F> localNormalA = vselect(lowerCentral, Vec3<F>{ lowerNormalXZ.x, normalA.y, lowerNormalXZ.y }, normalA);
+	const Vec3<F> localNormalB = vselect(upperCentral, Vec3<F>{ upperNormalXZ.x, normalB.y, upperNormalXZ.y }, normalB);
+	frame.localNormal = vselect(branchA, localNormalA, localNormalB);
+
+	frame.sinY = vselect(lowerCentral, F(CentralBeltSin), vselect(upperCentral, F(-CentralBeltSin), zero));
+	frame.cosY = vselect(lowerCentral | upperCentral, F(CentralBeltCos), F(1.0f));
+	frame.dispY = vselect(lowerCentral, lowerDisp, vselect(upperCentral, upperDisp, Vec2<F>{ zero, zero }));
+	return frame;
+}
+
+// position inside the triangle grid and corners of the grid triangle
+template <class F> inline Vec2<F> localPosToGrid(const Vec3<F> &localpos, float intPow, Vec2<F> &cr1, Vec2<F> &cr2, Vec2<F> &cr3)
+{
+	using M = typename PackTraits<F>::Mask;
+	const F one(1.0f), half(0.5f);
+	Vec2<F> frac;
+	const F xpow2 = F(intPow) * (one - localpos.x / F(IcoPoint1X));
+	const F xint = vtrunc(xpow2);
+	frac.x = vclamp(xpow2 - xint, F(0.0f), one);
+
+	const F ypow2 = (F(intPow) * (localpos.y + F(IcoPoint1Y)) - F(IcoPoint1Y) * xint) * half / F(IcoPoint1Y);
+	F yint = vfloor(ypow2);
+	frac.y = ypow2 - yint;
+
+	// check if grid triangle is upside down
+	const M flip = (frac.x > frac.y * F(2.0f)) | (frac.x > (one - frac.y) * F(2.0f));
+	const M lowHalf = frac.y < half;
+	const F yflip = yint + vselect(lowHalf, F(-1.0f), F(0.0f));
+	const F xint1 = xint + one;
+
+	cr1 = vselect(flip, Vec2<F>{ xint1, yflip }, Vec2<F>{ xint, yint });
+	cr2 = vselect(flip, Vec2<F>{ xint1, yflip + one }, Vec2<F>{ xint, yint + one });
+	cr3 = vselect(flip, Vec2<F>{ xint, yflip + one }, Vec2<F>{ xint1, yint });
+
+	frac.y = vselect(flip, frac.y + vselect(lowHalf, half, -half), frac.y);
+	frac.x = vselect(flip, one - frac.x, frac.x);
+	return frac;
+}
+
+// rotate and displace grid triangle vertex back to the source coordinate system
+template <class F> inline Vec3<F> gridToGlobal(const Vec2<F> &cr, const Vec3<F> &localpos, float intPow,
+												const IcoFrame<F> &frame, Vec3<F> &nmldisp)
+{
+	const F zSign = vselect(localpos.z >= F(0.0f), F(1.0f), F(-1.0f));
+	const Vec2<F> p { F(IcoPoint1X) * (F(1.0f) - cr.x / F(intPow)),
+					  F(IcoPoint1Y) * (F(2.0f) * cr.y + cr.x - F(intPow)) / F(intPow) };
+	Vec3<F> pos { p.x, p.y, (F(1.0f) - p.x * F(1.0f - IcoPoint0Z) / F(IcoPoint1X)) * zSign };
+	nmldisp = normalize(localpos - pos);
+
+	const Vec2<F> xz = rotate2D(Vec2<F>{ pos.x, pos.z } - frame.dispY, -frame.sinY, frame.cosY) + frame.dispY;
+	const Vec2<F> xy = rotate2D(Vec2<F>{ xz.x, pos.y }, -frame.sinZ, frame.cosZ);
+	const F scale(intPow);
+	return { vtrunc((xy.x + F(1.2f)) * scale * F(1.5f)),
+			 vtrunc((xy.y + F(1.2f)) * scale * F(1.5f)),
+			 vtrunc((xz.y + F(1.2f)) * scale * F(1.5f)) };
+}
+
+template <class F> inline F calculateHeightAndNormal(const F &rnd1, const F &rnd2, const F &rnd3,
+														float intPow, const Vec2<F> &frac, const F &outsideCrater,
+														const Vec3<F> &nmldisp1, const Vec3<F> &nmldisp2, const Vec3<F> &nmldisp3,
+														Vec3<F> &normal)
+{
+	using M = typename PackTraits<F>::Mask;
+	const F zero(0.0f), one(1.0f), two(2.0f);
+
+	// intersection points of triangle side and line on opposite vertex and current point
+	const F divider1 = two * frac.y + frac.x;
+	const M valid1 = divider1 != zero;
+	const Vec2<F> ip1 { two * frac.x / divider1, two * frac.y / divider1 };
+	const F rnd23 = vselect(valid1, smoothstep(zero, one, one - ip1.x) * (rnd2 - rnd3) + rnd3, zero);
+	const F lip1 = length(ip1);
+	const F t1 = vselect(valid1, vclamp(length(frac) / vselect(lip1 == zero, one, lip1), zero, one), zero);
+
+	const F divider2 = frac.x - two * frac.y + two;
+	const M valid2 = divider2 != zero;
+	const Vec2<F> ip2 { two * frac.x / divider2, frac.x / divider2 };
+	const F rnd13 = vselect(valid2, smoothstep(zero, one, one - ip2.x) * (rnd1 - rnd3) + rnd3, zero);
+	const F lip2 = length(Vec2<F>{ ip2.x, ip2.y - one });
+	const F t2 = vselect(valid2, vclamp(length(Vec2<F>{ frac.x, frac.y - one }) / vselect(lip2 == zero, one, lip2), zero, one), zero);
+
+	const F divider3 = two * frac.x - two;
+	const M valid3 = divider3 != zero;
+	const Vec2<F> ip3 { zero, (frac.x - two * frac.y) / divider3 };
+	const F rnd12 = vselect(valid3, smoothstep(zero, one, one - ip3.y) * (rnd1 - rnd2) + rnd2, zero);
+	const F lip3 = length(Vec2<F>{ ip3.x - one, ip3.y - F(0.5f) });
+	const F t3 = vselect(valid3, vclamp(length(Vec2<F>{ frac.x - one, frac.y - F(0.5f) }) / vselect(lip3 == zero, one, lip3), zero, one), zero);
+
+	const F h1 = smoothstep(zero, one, one - t1) * (rnd1 - rnd23) + rnd23;
+	const F h2 = smoothstep(zero, one, one - t2) * (rnd2 - rnd13) + rnd13;
+	const F h3 = smoothstep(zero, one, one - t3) * (rnd3 - rnd12) + rnd12;
+
+	const F height = outsideCrater * (h1 + h2 + h3) / F(8.0f * intPow);
+
+	const F n1 = F(6.0f) * t1 * (one - t1) * (rnd1 - rnd23);
+	const F n2 = F(6.0f) * t2 * (one - t2) * (rnd2 - rnd13);
+	const F n3 = F(6.0f) * t3 * (one - t3) * (rnd3 - rnd12);
+
+	normal = outsideCrater * (n1 * nmldisp1 + n2 * nmldisp2 + n3 * nmldisp3);
+	return height;
+}
+
+// coefficient of normals "dissolve", uniform for the whole batch
+inline float getDissolve(float lastLevel, int level, float multiplier)
+{
+	float dissolve = float(int(lastLevel)) / lastLevel;
+	if (level >= int(lastLevel))
+	{
+		dissolve = std::min(std::max(1.0f + level - lastLevel, 0.0f), 1.0f);
+		dissolve = std::cos(HalfPi * dissolve);
+	}
+	float lvl = 1.0f;
+	const int shift = std::min(16, 1 + int(lastLevel));
+	if (level >= lastLevel - shift)
+	{
+		lvl = std::cos(HalfPi * std::min(std::max((level - (lastLevel - shift)) / shift, 0.0f), 1.0f));
+		lvl = lvl * lvl * 1.05f;
+	}
+	return dissolve * (lvl * (1.0f - multiplier) + multiplier);
+}
+
+// values carried from level to level of the height_map() loop, normal sums are in the source coordinate system
+template <class F> struct NoiseState
+{
+	F height;
+	F outsideCrater;
+	Vec3<F> normal1;	// avgnormal1
+	Vec3<F> normal2;	// avgnormal2
+};
+
+template <class F> inline NoiseState<F> initialNoiseState()
+{
+	const F zero(0.0f);
+	return { F(0.5f), F(1.0f), { zero, zero, zero }, { zero, zero, zero } };
+}
+
+// levels [firstLevel, endLevel) of the height_map() loop
+template <class F> inline void accumulateLevels(const Vec3<F> &pos, const IcoFrame<F> &frame, int start, float count, float multiplier,
+												int firstLevel, int endLevel, NoiseState<F> &state)
+{
+	using M = typename PackTraits<F>::Mask;
+	const F zero(0.0f), one(1.0f);
+
+	Vec3<F> avgnormal1 { zero, zero, zero };
+	Vec3<F> avgnormal2 = state.normal2;
+	F height = state.height;
+	F outsideCrater = state.outsideCrater;
+	float intPow = float(1 << (start + firstLevel));
+	for (int level = firstLevel; level < endLevel; level++)
+	{
+		// get position inside triangles grid
+		Vec2<F> cr1, cr2, cr3;
+		const Vec2<F> frac = localPosToGrid(frame.localPos, intPow, cr1, cr2, cr3);
+		// get "global" coordinates for triangle in the grid to get their heights
+		Vec3<F> nmldisp1, nmldisp2, nmldisp3;
+		const Vec3<F> pos1 = gridToGlobal(cr1, frame.localPos, intPow, frame, nmldisp1);
+		const Vec3<F> pos2 = gridToGlobal(cr2, frame.localPos, intPow, frame, nmldisp2);
+		const Vec3<F> pos3 = gridToGlobal(cr3, frame.localPos, intPow, frame, nmldisp3);
+
+		const F rnd1 = F(1.25f) * random3D(pos1);
+		const F rnd2 = F(1.25f) * random3D(pos2);
+		const F rnd3 = F(1.25f) * random3D(pos3);
+
+		Vec3<F> partialNormal;
+		height = height + calculateHeightAndNormal(rnd1, rnd2, rnd3, intPow, frac, outsideCrater,
+													nmldisp1, nmldisp2, nmldisp3, partialNormal);
+		const float dissolve = getDissolve(float(start) + count, level, multiplier);
+		const float strength = (0 == level) ? 2.0f : 1.0f;
+		avgnormal1 = avgnormal1 + frame.localNormal + F(dissolve * strength) * partialNormal;
+
+		// craters
+		Vec3<F> nml = pos;
+		if (level > 1 && intPow >= 4.0f && count > 0.0f)
+		{
+			const float vcount = intPow;
+			const float vsectorSize = HalfPi / vcount;
+			const F vang = vatan2(-pos.z, length(Vec2<F>{ pos.x, pos.y }));
+			const F vsectorIndex = vtrunc(vang / F(vsectorSize));
+			const F multLength = vcos(F(vsectorSize) * (vabs(vsectorIndex) + F(0.5f)));
+			const F hcount = vtrunc(F(0.5f) + F(TwoPi) * multLength / F(vsectorSize));
+			// the shader leaves sector parameters undefined without horizontal sectors, treat them as "no crater"
+			const M sectors = hcount > zero;
+			const F hsectorSize = vselect(sectors, F(TwoPi) / hcount, zero);
+			const F hang = vatan2(pos.y, pos.x) + F(Pi);
+			const F hsectorIndex = vselect(sectors, vtrunc(hang / hsectorSize), zero);
+			const M upper = vang >= zero;
+			const F vindex = vselect(sectors, F(vcount) + vselect(upper, vsectorIndex + one, -vsectorIndex), zero);
+
+			const float levelKoef = std::min(std::max(level / count, 0.0f), 1.0f);
+			const float craterChance = smoothstep(levelKoef, 0.0f, 1.0f) * 0.3f + 0.1f;
+			M crater = sectors & (random2D(Vec2<F>{ F(Pi) * hsectorIndex, F(Pi) * vindex }) < F(craterChance));
+			if (vany(crater))
+			{
+				const F signvang = vselect(upper, one, F(-1.0f));
+				const Vec2<F> center { (hsectorIndex + F(0.5f)) * hsectorSize,
+									   (vsectorIndex + F(0.5f) * signvang) * F(vsectorSize) };
+				F sinCx, cosCx, sinCy, cosCy;
+				vsincos(center.x, sinCx, cosCx);
+				vsincos(center.y, sinCy, cosCy);
+
+				// rotate coordinates so that sector center gets close to zero
+				const Vec2<F> xy = rotate2D(Vec2<F>{ pos.x, pos.y }, -sinCx, cosCx);
+				Vec3<F> localCoords = normalize(Vec3<F>{ xy.x, xy.y, pos.z });
+				const Vec2<F> xz = rotate2D(Vec2<F>{ localCoords.x, localCoords.z }, -sinCy, cosCy);
+				localCoords.x = xz.x;
+				localCoords.z = xz.y;
+				const Vec2<F> scale { hsectorSize * multLength, F(vsectorSize) };
+				const F t = vcos(F(HalfPi) * vabs(vsectorIndex / F(vcount - 1.0f)));
+				crater = crater & (scale.x != zero) & (t > zero);
+
+				const Vec2<F> scaledyz { localCoords.y / scale.x, localCoords.z / scale.y };
+				const F r = vexp(F(0.15f) * vlog(t)) * F(0.495f - 0.425f) + F(0.425f);
+				const Vec2<F> ofs { F(0.3f) * r * (F(0.2f) + F(0.8f) * random2D(Vec2<F>{ center.x + F(13.0f), center.y + F(13.0f) })),
+									F(0.3f) * r * (F(0.2f) + F(0.8f) * random2D(Vec2<F>{ center.x + F(37.0f), center.y + F(37.0f) })) };
+				const Vec2<F> nmldir = scaledyz - ofs;
+				const F radius = r - vmax(ofs.x, ofs.y) * F(1.2f);
+				const F nmldirlen = length(nmldir);
+				crater = crater & (radius > zero) & (nmldirlen * F(0.96f) < radius);
+				if (vany(crater))
+				{
+					// shape of craters differs depending on their size
+					const float shape = 1.0f - levelKoef;
+					height = vselect(crater, height + F(0.4f) * g(nmldirlen, shape, radius) / F(intPow), height);
+
+					const F nmltan = F(0.4f) * gdiff2(nmldirlen, shape, radius);
+					const F tangent = -nmltan / nmldirlen * F(dissolve);
+					Vec3<F> craterNormal = normalize(Vec3<F>{ vsign(localCoords.x),
+															  tangent * nmldir.x * scale.x,
+															  tangent * nmldir.y * scale.y });
+					const Vec2<F> nxz = rotate2D(Vec2<F>{ craterNormal.x, craterNormal.z }, sinCy, cosCy);
+					const Vec2<F> nxy = rotate2D(Vec2<F>{ nxz.x, craterNormal.y }, sinCx, cosCx);
+					craterNormal = { nxy.x, nxy.y, nxz.y };
+
+					// mark place outside crater for better heights mixing
+					const float roughness = 0.5f + 0.3f * smoothstep(level / count, 0.0f, 1.0f);
+					const F ts = smoothstep(one - vclamp(nmldirlen / radius, F(0.8f), one) - F(0.8f), zero, one);
+					outsideCrater = vselect(crater, vmin(outsideCrater, ts * F((1.0f - roughness) * 5.0f) + F(roughness)), outsideCrater);
+					nml = vselect(crater, craterNormal, nml);
+				}
+			}
+		}
+		avgnormal2 = avgnormal2 + normalize(nml);
+
+		intPow *= 2.0f;
+	}
+
+	// transform normals back to "global" coordinates
+	const Vec2<F> xz = rotate2D(Vec2<F>{ avgnormal1.x, avgnormal1.z }, -frame.sinY, frame.cosY);
+	const Vec2<F> xy = rotate2D(Vec2<F>{ xz.x, avgnormal1.y }, -frame.sinZ, frame.cosZ);
+	state.normal1 = state.normal1 + Vec3<F>{ xy.x, xy.y, xz.y };
+	state.normal2 = avgnormal2;
+	state.height = height;
+	state.outsideCrater = outsideCrater;
+}
+
+// height_map(): smooth noise at any position on sphere, returns (normal, height)
+template <class F> inline void heightMap(const Vec3<F> &position, int start, float count, float multiplier,
+											Vec3<F> &normalOut, F &heightOut)
+{
+	const Vec3<F> pos = normalize(position);
+	const IcoFrame<F> frame = recognizeIcoTriangle(pos);
+
+	NoiseState<F> state = initialNoiseState<F>();
+	accumulateLevels(pos, frame, start, count, multiplier, 0, 1 + int(count), state);
+
+	const Vec3<F> avgnormal1 = F(2.0f) * (normalize(state.normal1) - pos) + pos;
+	const Vec3<F> avgnormal2 = F(32.0f) * (normalize(state.normal2) - pos) + pos;
+	normalOut = normalize(normalize(avgnormal1) + normalize(avgnormal2));
+	heightOut = state.height;
+}
+
+// state after the first levels, normal sums exclude the levels * pos part so they stay small
+template <class F> inline void levelState(const Vec3<F> &position, int start, float count, float multiplier, int levels,
+											NoiseState<F> &state)
+{
+	const Vec3<F> pos = normalize(position);
+	const IcoFrame<F> frame = recognizeIcoTriangle(pos);
+
+	state = initialNoiseState<F>();
+	accumulateLevels(pos, frame, start, count, multiplier, 0, levels, state);
+	state.normal1 = state.normal1 - F(float(levels)) * pos;
+	state.normal2 = state.normal2 - F(float(levels)) * pos;
+}
+
+// evaluates packed positions in batches of the pack width, the tail is padded with the last position;
+// body(position, values) computes NumOutputs values stored interleaved per position
+template <class F, int NumOutputs, class Body> void processArray(const float *positions, std::size_t count, float *results, Body body)
+{
+	constexpr int W = PackTraits<F>::Width;
+	alignas(64) float x[W], y[W], z[W], outputs[NumOutputs][W];
+	for (std::size_t first = 0; first < count; first += W)
+	{
+		const std::size_t n = std::min<std::size_t>(W, count - first);
+		for (int i = 0; i < W; i++)
+		{
+			const float *p = positions + 3 * (first + std::min<std::size_t>(i, n - 1));
+			x[i] = p[0];
+			y[i] = p[1];
+			z[i] = p[2];
+		}
+		F values[NumOutputs];
+		body(Vec3<F>{ PackTraits<F>::load(x), PackTraits<F>::load(y), PackTraits<F>::load(z) }, values);
+		for (int k = 0; k < NumOutputs; k++)
+		{
+			PackTraits<F>::store(outputs[k], values[k]);
+		}
+		for (std::size_t i = 0; i < n; i++)
+		{
+			float *r = results + NumOutputs * (first + i);
+			for (int k = 0; k < NumOutputs; k++)
+			{
+				r[k] = outputs[k][i];
+			}
+		}
+	}
+}
+
+template <class F> void heightMapArray(const float *positions, std::size_t count, float *results,
+										int start, float levelCount, float multiplier)
+{
+	processArray<F, 4>(positions, count, results, [=](const Vec3<F> &position, F *values)
+	{
+		Vec3<F> normal;
+		heightMap(position, start, levelCount, multiplier, normal, values[3]);
+		values[0] = normal.x;
+		values[1] = normal.y;
+		values[2] = normal.z;
+	});
+}
+
+template <class F> void levelStateArray(const float *positions, std::size_t count, float *results,
+										int start, float levelCount, float multiplier, int levels)
+{
+	processArray<F, 8>(positions, count, results, [=](const Vec3<F> &position, F *values)
+	{
+		NoiseState<F> state;
+		levelState(position, start, levelCount, multiplier, levels, state);
+		values[0] = state.normal1.x;
+		values[1] = state.normal1.y;
+		values[2] = state.normal1.z;
+		values[3] = state.height;
+		values[4] = state.normal2.x;
+		values[5] = state.normal2.y;
+		values[6] = state.normal2.z;
+		values[7] = state.outsideCrater;
+	});
+}
+
+} // anonymous namespace
@@ -0,0 +1,107 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Asteroid surface noise: SSE4.1 kernel, 4 positions per pack.
+ */
+
+#include <smmintrin.h>
+
+#include "asteroid_noise_kernel.hpp"
+
+namespace
+{
+
+struct Mask4
+{
+	__m128 v;
+};
+
+struct Float4
+{
+	__m128 v;
+
+	Float4() = default;
+	Float4(float s) : v(_mm_set1_ps(s)) {}
+	Float4(__m128 x) : v(x) {}
+};
+
+template <> struct PackTraits<Float4>
+{
+	using Mask = Mask4;
+	static constexpr int Width = 4;
+	static Float4 load(const float *src) { return _mm_loadu_ps(src); }
+	static void store(float *dst, const Float4 &v) { _mm_storeu_ps(dst, v.v); }
+};
+
+inline Float4 operator + (const Float4 &a, const Float4 &b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator - (const Float4 &a, const Float4 &b) { return _mm_sub_ps(a.v, b.v); }
+inline Float4 operator * (const Float4 &a, const Float4 &b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 operator / (const Float4 &a, const Float4 &b) { return _mm_div_ps(a.v, b.v); }
+inline Float4 operator - (const Float4 &a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+
+inline Mask4 operator <  (const Float4 &a, const Float4 &b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline Mask4 operator <= (const Float4 &a, const Float4 &b) { return { _mm_cmple_ps(a.v, b.v) }; }
+inline Mask4 operator >  (const Float4 &a, const Float4 &b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+inline Mask4 operator >= (const Float4 &a, const Float4 &b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+inline Mask4 operator == (const Float4 &a, const Float4 &b) { return { _mm_cmpeq_ps(a.v, b.v) }; }
+inline Mask4 operator != (const Float4 &a, const Float4 &b) { return { _mm_cmpneq_ps(a.v, b.v) }; }
+
+inline Mask4 operator & (const Mask4 &a, const Mask4 &b) { return { _mm_and_ps(a.v, b.v) }; }
+inline Mask4 operator | (const Mask4 &a, const Mask4 &b) { return { _mm_or_ps(a.v, b.v) }; }
+inline Mask4 operator ! (const Mask4 &a) { return { _mm_xor_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(-1))) }; }
+
+inline Float4 vselect(const Mask4 &m, const Float4 &a, const Float4 &b) { return _mm_blendv_ps(b.v, a.v, m.v); }
+inline bool vany(const Mask4 &m) { return 0 != _mm_movemask_ps(m.v); }
+inline Float4 vfloor(const Float4 &x) { return _mm_floor_ps(x.v); }
+inline Float4 vtrunc(const Float4 &x) { return _mm_round_ps(x.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+inline Float4 vsqrt(const Float4 &x) { return _mm_sqrt_ps(x.v); }
+inline Float4 vabs(const Float4 &x) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), x.v); }
+inline Float4 vmin(const Float4 &a, const Float4 &b) { return _mm_min_ps(a.v, b.v); }
+inline Float4 vmax(const Float4 &a, const Float4 &b) { return _mm_max_ps(a.v, b.v); }
+
+inline Float4 vsplitExponent(const Float4 &x, Float4 &exponent)
+{
+	const __m128i bits = _mm_castps_si128(x.v);
+	const __m128i e = _mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(0xff));
+	exponent = _mm_cvtepi32_ps(_mm_sub_epi32(e, _mm_set1_epi32(126)));
+	const __m128i m = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(int(0x807fffff))), _mm_set1_epi32(0x3f000000));
+	return _mm_castsi128_ps(m);
+}
+
+inline Float4 vscalePow2(const Float4 &x, const Float4 &n)
+{
+	const __m128i e = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(x.v, _mm_castsi128_ps(e));
+}
+
+inline __m128d reduceHalfPi(__m128d d, __m128d &quadrant)
+{
+	const __m128d n = _mm_round_pd(_mm_mul_pd(d, _mm_set1_pd(TwoOverPiD)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	const __m128d r = _mm_sub_pd(_mm_sub_pd(d, _mm_mul_pd(n, _mm_set1_pd(PiOver2HiD))), _mm_mul_pd(n, _mm_set1_pd(PiOver2LoD)));
+	quadrant = _mm_sub_pd(n, _mm_mul_pd(_mm_floor_pd(_mm_mul_pd(n, _mm_set1_pd(0.25))), _mm_set1_pd(4.0)));
+	return r;
+}
+
+inline Float4 vreduceHalfPi(const Float4 &x, Float4 &quadrant)
+{
+	__m128d qlo, qhi;
+	const __m128d rlo = reduceHalfPi(_mm_cvtps_pd(x.v), qlo);
+	const __m128d rhi = reduceHalfPi(_mm_cvtps_pd(_mm_movehl_ps(x.v, x.v)), qhi);
+	quadrant = _mm_movelh_ps(_mm_cvtpd_ps(qlo), _mm_cvtpd_ps(qhi));
+	return _mm_movelh_ps(_mm_cvtpd_ps(rlo), _mm_cvtpd_ps(rhi));
+}
+
+} // anonymous namespace
+
+void AsteroidNoiseKernel::heightMapSse41(const float *positions, std::size_t count, float *results,
+										 int start, float levelCount, float multiplier)
+{
+	heightMapArray<Float4>(positions, count, results, start, levelCount, multiplier);
+}
+
+void AsteroidNoiseKernel::levelStateSse41(const float *positions, std::size_t count, float *results,
+										  int start, float levelCount, float multiplier, int levels)
+{
+	levelStateArray<Float4>(positions, count, results, start, levelCount, multiplier, levels);
+}
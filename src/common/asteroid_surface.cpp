@@ -0,0 +1,235 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include <glm/glm.hpp>
+
+#include "asteroid_noise.hpp"
+#include "asteroid_surface.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+namespace {
+	const char CacheMagic[8] = { 'A', 'S', 'T', 'S', 'U', 'R', 'F', '\0' };
+	const uint32_t CacheVersion = 1;
+
+	// the map is baked for full detail, see height_map_continue() in asteroid_base.glsl
+	const float BakeLevelCount = float(AsteroidNoise::MaxLevel - AsteroidNoise::StartLevel);
+	const float BakeMultiplier = 1.0f;
+
+	struct CacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t noiseVersion;
+		uint32_t resolution;
+		uint32_t levels;
+		uint32_t mipLevels;
+		uint32_t reserved;
+	};
+
+	// direction to the center of a cube map texel, same convention as equirect2cube_cs.glsl
+	glm::vec3 texelDirection(int face, int x, int y, int size)
+	{
+		const float u = 2.0f * (x + 0.5f) / size - 1.0f;
+		const float v = 1.0f - 2.0f * (y + 0.5f) / size;
+		switch (face)
+		{
+		case 0:  return glm::normalize(glm::vec3{ 1.0f, v, -u });
+		case 1:  return glm::normalize(glm::vec3{ -1.0f, v, u });
+		case 2:  return glm::normalize(glm::vec3{ u, 1.0f, -v });
+		case 3:  return glm::normalize(glm::vec3{ u, -1.0f, v });
+		case 4:  return glm::normalize(glm::vec3{ u, v, 1.0f });
+		default: return glm::normalize(glm::vec3{ -u, v, -1.0f });
+		}
+	}
+}
+
+AsteroidSurfaceMap::AsteroidSurfaceMap(int resolution, int levels)
+	: m_resolution(resolution)
+	, m_levels(levels)
+{
+	std::size_t offset = 0;
+	const int mipLevels = Utility::numMipmapLevels(resolution, resolution);
+	for (int level = 0; level < mipLevels; level++)
+	{
+		m_levelOffsets.push_back(offset);
+		offset += std::size_t(NumFaces) * levelSize(level) * levelSize(level) * 4;
+	}
+	m_normalHeight.resize(offset);
+	m_craterNormal.resize(offset);
+}
+
+int AsteroidSurfaceMap::levelsForResolution(int resolution)
+{
+	int log2Resolution = 0;
+	while ((resolution >> (log2Resolution + 1)) > 0)
+	{
+		log2Resolution++;
+	}
+	return std::max(1, log2Resolution - 3);
+}
+
+std::shared_ptr<AsteroidSurfaceMap> AsteroidSurfaceMap::bake(int resolution)
+{
+	if (!Utility::isPowerOfTwo(resolution))
+	{
+		throw std::runtime_error("Asteroid surface map resolution must be a power of two");
+	}
+	const auto startTime = std::chrono::steady_clock::now();
+
+	std::shared_ptr<AsteroidSurfaceMap> map { new AsteroidSurfaceMap(resolution, levelsForResolution(resolution)) };
+
+	// float texels of one face: 8 channels, (normal, height) then (craterNormal, outsideCrater)
+	std::vector<AsteroidNoise::LevelState> texels(std::size_t(resolution) * resolution);
+	std::vector<AsteroidNoise::LevelState> mip;
+	for (int face = 0; face < NumFaces; face++)
+	{
+		ThreadPool::instance().parallelFor(0, resolution, 4, [&](std::size_t rowBegin, std::size_t rowEnd)
+		{
+			std::vector<glm::vec3> directions(resolution);
+			for (std::size_t y = rowBegin; y < rowEnd; y++)
+			{
+				for (int x = 0; x < resolution; x++)
+				{
+					directions[x] = texelDirection(face, x, int(y), resolution);
+				}
+				AsteroidNoise::levelState(directions.data(), directions.size(), &texels[y * resolution],
+										  AsteroidNoise::StartLevel, BakeLevelCount, BakeMultiplier, map->m_levels);
+			}
+		});
+		for (AsteroidNoise::LevelState& texel : texels)
+		{
+			texel.height -= 0.5f;			// keep half float precision for the small part
+		}
+
+		// box filtered mip chain in full precision, converted to half float level by level
+		int size = resolution;
+		for (int level = 0; level < map->mipLevels(); level++)
+		{
+			const std::vector<AsteroidNoise::LevelState>& source = (0 == level) ? texels : mip;
+			uint16_t* normalHeight = &map->m_normalHeight[map->texelOffset(level, face)];
+			uint16_t* craterNormal = &map->m_craterNormal[map->texelOffset(level, face)];
+			for (std::size_t i = 0; i < std::size_t(size) * size; i++)
+			{
+				const AsteroidNoise::LevelState& texel = source[i];
+				normalHeight[4 * i + 0] = Utility::floatToHalf(texel.normal.x);
+				normalHeight[4 * i + 1] = Utility::floatToHalf(texel.normal.y);
+				normalHeight[4 * i + 2] = Utility::floatToHalf(texel.normal.z);
+				normalHeight[4 * i + 3] = Utility::floatToHalf(texel.height);
+				craterNormal[4 * i + 0] = Utility::floatToHalf(texel.craterNormal.x);
+				craterNormal[4 * i + 1] = Utility::floatToHalf(texel.craterNormal.y);
+				craterNormal[4 * i + 2] = Utility::floatToHalf(texel.craterNormal.z);
+				craterNormal[4 * i + 3] = Utility::floatToHalf(texel.outsideCrater);
+			}
+			if (size > 1)
+			{
+				const int nextSize = size / 2;
+				std::vector<AsteroidNoise::LevelState> next(std::size_t(nextSize) * nextSize);
+				for (int y = 0; y < nextSize; y++)
+				{
+					for (int x = 0; x < nextSize; x++)
+					{
+						const AsteroidNoise::LevelState& t00 = source[std::size_t(2 * y) * size + 2 * x];
+						const AsteroidNoise::LevelState& t01 = source[std::size_t(2 * y) * size + 2 * x + 1];
+						const AsteroidNoise::LevelState& t10 = source[std::size_t(2 * y + 1) * size + 2 * x];
+						const AsteroidNoise::LevelState& t11 = source[std::size_t(2 * y + 1) * size + 2 * x + 1];
+						AsteroidNoise::LevelState& texel = next[std::size_t(y) * nextSize + x];
+						texel.normal = 0.25f * (t00.normal + t01.normal + t10.normal + t11.normal);
+						texel.height = 0.25f * (t00.height + t01.height + t10.height + t11.height);
+						texel.craterNormal = 0.25f * (t00.craterNormal + t01.craterNormal + t10.craterNormal + t11.craterNormal);
+						texel.outsideCrater = 0.25f * (t00.outsideCrater + t01.outsideCrater + t10.outsideCrater + t11.outsideCrater);
+					}
+				}
+				mip = std::move(next);
+				size = nextSize;
+			}
+		}
+	}
+
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+	std::cout << "Baked asteroid surface map: " << resolution << "x" << resolution << ", " << map->m_levels
+			  << " levels in " << elapsed.count() << " ms" << std::endl;
+	return map;
+}
+
+std::shared_ptr<AsteroidSurfaceMap> AsteroidSurfaceMap::load(const std::string& filename, int resolution)
+{
+	std::ifstream file{filename, std::ios::binary};
+	if (!file.is_open())
+	{
+		return nullptr;
+	}
+
+	CacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| 0 != std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic))
+		|| CacheVersion != header.version
+		|| uint32_t(AsteroidNoise::Version) != header.noiseVersion
+		|| uint32_t(resolution) != header.resolution
+		|| uint32_t(levelsForResolution(resolution)) != header.levels)
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<AsteroidSurfaceMap> map { new AsteroidSurfaceMap(resolution, int(header.levels)) };
+	if (uint32_t(map->mipLevels()) != header.mipLevels
+		|| !file.read(reinterpret_cast<char*>(map->m_normalHeight.data()), map->m_normalHeight.size() * sizeof(uint16_t))
+		|| !file.read(reinterpret_cast<char*>(map->m_craterNormal.data()), map->m_craterNormal.size() * sizeof(uint16_t)))
+	{
+		return nullptr;
+	}
+
+	std::cout << "Loading asteroid surface map: " << filename << std::endl;
+	return map;
+}
+
+bool AsteroidSurfaceMap::save(const std::string& filename) const
+{
+	std::ofstream file{filename, std::ios::binary | std::ios::trunc};
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	CacheHeader header = {};
+	std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+	header.version = CacheVersion;
+	header.noiseVersion = uint32_t(AsteroidNoise::Version);
+	header.resolution = uint32_t(m_resolution);
+	header.levels = uint32_t(m_levels);
+	header.mipLevels = uint32_t(mipLevels());
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(m_normalHeight.data()), m_normalHeight.size() * sizeof(uint16_t));
+	file.write(reinterpret_cast<const char*>(m_craterNormal.data()), m_craterNormal.size() * sizeof(uint16_t));
+	return file.good();
+}
+
+std::shared_ptr<AsteroidSurfaceMap> AsteroidSurfaceMap::fromCache(const std::string& cacheDirectory, int resolution)
+{
+	const std::string filename = cacheDirectory + "asteroid_surface_" + std::to_string(resolution) + ".bin";
+	std::shared_ptr<AsteroidSurfaceMap> map = load(filename, resolution);
+	if (nullptr == map)
+	{
+		map = bake(resolution);
+
+		std::error_code error;
+		std::filesystem::create_directories(cacheDirectory, error);
+		if (!map->save(filename))
+		{
+			std::cout << "WARNING: could not write asteroid surface cache " << filename << std::endl;
+		}
+	}
+	return map;
+}
@@ -0,0 +1,55 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Asteroid surface baked into cube maps: the first noise levels are evaluated on CPU once,
+ * the fragment shader continues from the baked state with the remaining levels only.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class AsteroidSurfaceMap
+{
+public:
+	static constexpr int NumFaces = 6;
+
+	// loads the map from cacheDirectory, bakes and stores it there when missing or outdated
+	static std::shared_ptr<AsteroidSurfaceMap> fromCache(const std::string& cacheDirectory, int resolution);
+	// evaluates the surface on all threads of ThreadPool::instance()
+	static std::shared_ptr<AsteroidSurfaceMap> bake(int resolution);
+	static std::shared_ptr<AsteroidSurfaceMap> load(const std::string& filename, int resolution);
+	bool save(const std::string& filename) const;
+
+	// noise levels a map of given resolution resolves: a grid cell of the last baked level spans 4+ texels
+	static int levelsForResolution(int resolution);
+
+	int resolution() const { return m_resolution; }
+	int levels() const { return m_levels; }
+	int mipLevels() const { return static_cast<int>(m_levelOffsets.size()); }
+	int levelSize(int level) const { return (m_resolution >> level) > 0 ? (m_resolution >> level) : 1; }
+
+	// half float RGBA texels of a cube face and mip level, faces in GL order (+X, -X, +Y, -Y, +Z, -Z):
+	// (normal.xyz, height - 0.5) and (craterNormal.xyz, outsideCrater) of AsteroidNoise::LevelState
+	const uint16_t* normalHeight(int level, int face) const { return &m_normalHeight[texelOffset(level, face)]; }
+	const uint16_t* craterNormal(int level, int face) const { return &m_craterNormal[texelOffset(level, face)]; }
+
+private:
+	AsteroidSurfaceMap(int resolution, int levels);
+
+	std::size_t texelOffset(int level, int face) const
+	{
+		return m_levelOffsets[level] + std::size_t(face) * levelSize(level) * levelSize(level) * 4;
+	}
+
+	int m_resolution;
+	int m_levels;
+	std::vector<std::size_t> m_levelOffsets;
+	std::vector<uint16_t> m_normalHeight;
+	std::vector<uint16_t> m_craterNormal;
+};
@@ -0,0 +1,45 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Bounding spheres of asteroid instances, the CPU side of the frustum test of asteroid_cull_cs.glsl.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+class BoundingSphere
+{
+public:
+	// largest scale of the upper 3x3 of a model matrix, object space radii times it bound the world space sphere
+	static float maxColumnLength(const glm::mat4& modelMat)
+	{
+		return std::max({ glm::length(glm::vec3{ modelMat[0] }), glm::length(glm::vec3{ modelMat[1] }),
+						  glm::length(glm::vec3{ modelMat[2] }) });
+	}
+
+	// same planes as isOutsideFrustum of asteroid_cull_cs.glsl: the sides and the near plane, no far plane
+	static bool isOutsideFrustum(const glm::mat4& viewProjectionMat, const glm::vec3& center, float radius)
+	{
+		const glm::vec4 r0 = row(viewProjectionMat, 0);
+		const glm::vec4 r1 = row(viewProjectionMat, 1);
+		const glm::vec4 r2 = row(viewProjectionMat, 2);
+		const glm::vec4 r3 = row(viewProjectionMat, 3);
+		const glm::vec4 planes[5] = { r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2 };
+		for (const glm::vec4& plane : planes)
+		{
+			const glm::vec3 normal{ plane };
+			if (glm::dot(normal, center) + plane.w < -radius * glm::length(normal))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+	static glm::vec4 row(const glm::mat4& m, int i) { return glm::vec4{ m[0][i], m[1][i], m[2][i], m[3][i] }; }
+};
@@ -0,0 +1,82 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "dynamic_resolution.hpp"
+
+void DynamicResolution::setBudget(double budgetMs)
+{
+	m_budget.setBudget(budgetMs);
+	if (!m_budget.enabled())
+	{
+		m_scale = MaxScale;
+	}
+}
+
+bool DynamicResolution::update(double gpuMs, bool mayLower)
+{
+	const FrameBudget::Action action = m_budget.update(gpuMs, mayLower, true);
+	if (FrameBudget::Action::None == action)
+	{
+		return false;
+	}
+
+	// pixels scale with the square of the scale; at least one step, at most four per change
+	const double fit = m_scale * std::sqrt(m_budget.budget() / m_budget.smoothedMs());
+	const int steps = std::clamp(int(std::lround((fit - m_scale) / ScaleStep)), -4, 4);
+	const int direction = (FrameBudget::Action::Lower == action) ? -1 : 1;
+	const int change = direction * std::max(direction * steps, 1);
+	const float scale = std::clamp(m_scale + float(change) * ScaleStep, MinScale, MaxScale);
+	if (std::abs(scale - m_scale) < 0.5f * ScaleStep)
+	{
+		return false;
+	}
+	m_scale = scale;
+	m_budget.changed();
+	return true;
+}
+
+glm::ivec2 DynamicResolution::targetSize(glm::ivec2 output)
+{
+	const glm::ivec2 needed { bucket(output.x), bucket(output.y) };
+	if (needed.x > m_targetSize.x || needed.y > m_targetSize.y)
+	{
+		m_targetSize = glm::max(m_targetSize, needed);
+		m_smallerFrames = 0;
+	}
+	else if (needed != m_targetSize)
+	{
+		if (++m_smallerFrames >= FramesToShrink)
+		{
+			m_targetSize = needed;
+			m_smallerFrames = 0;
+		}
+	}
+	else
+	{
+		m_smallerFrames = 0;
+	}
+	return m_targetSize;
+}
+
+glm::ivec2 DynamicResolution::renderSize(glm::ivec2 output) const
+{
+	return glm::ivec2{ std::max(1, int(std::lround(output.x * m_scale))), std::max(1, int(std::lround(output.y * m_scale))) };
+}
+
+std::string DynamicResolution::describe() const
+{
+	std::ostringstream stream;
+	stream << "Render scale " << m_scale << " (GPU " << m_budget.smoothedMs() << " ms of " << m_budget.budget() << " ms)";
+	return stream.str();
+}
+
+int DynamicResolution::bucket(int size)
+{
+	return std::max(1, (size + Bucket - 1) / Bucket) * Bucket;
+}
@@ -0,0 +1,60 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Render scale driven by measured GPU frame time and the size of the scene targets it renders into.
+ */
+
+#pragma once
+
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "frame_budget.hpp"
+
+class DynamicResolution
+{
+public:
+	// targets are allocated in multiples of Bucket pixels, so small window size changes reuse them
+	static constexpr int Bucket = 256;
+	// limits and step of the scale of both axes
+	static constexpr float MinScale = 0.5f;
+	static constexpr float MaxScale = 1.0f;
+	static constexpr float ScaleStep = 0.05f;
+
+	// budgetMs <= 0 renders at the output size
+	void setBudget(double budgetMs);
+	double budget() const { return m_budget.budget(); }
+	bool enabled() const { return m_budget.enabled(); }
+	// no scale change is cooling down
+	bool settled() const { return m_budget.settled(); }
+
+	// GPU time of a finished frame, frames arrive a few frames late; returns true when the scale changed.
+	// mayLower false holds the scale while another controller is first to give up time
+	bool update(double gpuMs, bool mayLower = true);
+	float scale() const { return m_scale; }
+	bool atFullScale() const { return m_scale >= MaxScale; }
+
+	// size of the scene targets for an output of the given size: grows at once,
+	// shrinks only after the output stayed in a smaller bucket for FramesToShrink frames
+	glm::ivec2 targetSize(glm::ivec2 output);
+	// part of the targets rendered this frame, the scaled output size
+	glm::ivec2 renderSize(glm::ivec2 output) const;
+
+	// current scale and smoothed GPU time in one line
+	std::string describe() const;
+
+private:
+	// a wider dead band than LodGovernor, the scale moves towards the one that fits the budget
+	// assuming GPU time proportional to the rendered pixels
+	static constexpr FrameBudget::Bands Bands { 1.1, 0.85, 8, 45, 20 };
+	static constexpr int FramesToShrink = 120;
+
+	static int bucket(int size);
+
+	FrameBudget m_budget { Bands };
+	float m_scale = MaxScale;
+	glm::ivec2 m_targetSize { 0, 0 };
+	int m_smallerFrames = 0;
+};
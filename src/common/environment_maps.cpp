@@ -0,0 +1,278 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "environment_maps.hpp"
+#include "shader_preprocessor.hpp"
+#include "utils.hpp"
+
+namespace {
+	const char CacheMagic[8] = { 'E', 'N', 'V', 'M', 'A', 'P', 'S', '\0' };
+	const uint32_t CacheVersion = 3;
+
+	struct Tier
+	{
+		const char* name;
+		int specularSize;
+		int specularLevels;
+		int specularSamples;
+	};
+
+	// indexed by EnvironmentMaps::Quality
+	const Tier Tiers[] = {
+		{ "low", 256, 6, 32 },
+		{ "medium", 512, 7, 64 },
+		{ "high", 1024, 8, 128 },
+		{ "reference", 1024, 11, 1024 },
+	};
+	static_assert(sizeof(Tiers) / sizeof(Tiers[0]) == std::size_t(EnvironmentMaps::Quality::NumQualities), "a tier per quality");
+
+	struct CacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t maps;
+		uint64_t key;
+	};
+
+	// one per map after the header, followed by the irradiance coefficients and the texels of all maps
+	struct MapHeader
+	{
+		uint32_t size;
+		uint32_t levels;
+		uint32_t faces;
+		uint32_t channels;
+	};
+}
+
+EnvironmentMaps::EnvironmentMaps(uint64_t key, const Parameters& parameters)
+	: m_key(key)
+{
+	allocate(Specular, parameters.specularSize, parameters.specularLevels, 6, 4);
+	allocate(BrdfLut, parameters.brdfLutSize, 1, 1, 2);
+}
+
+void EnvironmentMaps::allocate(Map map, int size, int levels, int faces, int channels)
+{
+	Storage& storage = m_maps[map];
+	storage.size = size;
+	storage.faces = faces;
+	storage.channels = channels;
+	storage.levelOffsets.resize(levels);
+	std::size_t offset = 0;
+	for (int level = 0; level < levels; level++)
+	{
+		storage.levelOffsets[level] = offset;
+		offset += levelBytes(map, level) / sizeof(uint16_t);
+	}
+	storage.texels.resize(offset);
+}
+
+const char* EnvironmentMaps::qualityName(Quality quality)
+{
+	return Tiers[int(quality)].name;
+}
+
+bool EnvironmentMaps::parseQuality(const std::string& name, Quality& quality)
+{
+	for (int i = 0; i < int(Quality::NumQualities); i++)
+	{
+		if (name == Tiers[i].name)
+		{
+			quality = Quality(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+EnvironmentMaps::Parameters EnvironmentMaps::parameters(Quality quality)
+{
+	const Tier& tier = Tiers[int(quality)];
+	return Parameters{ quality, tier.specularSize, tier.specularLevels, tier.specularSamples, IrradianceSourceSize, BrdfLutSize,
+		{ "data/shaders/equirect2cube_cs.glsl", "data/shaders/spmap_cs.glsl", "data/shaders/irradiance_sh_cs.glsl",
+		  "data/shaders/irradiance_sh.glsl", "data/shaders/spbrdf_cs.glsl" } };
+}
+
+std::size_t EnvironmentMaps::residentBytes(const Parameters& parameters)
+{
+	std::size_t bytes = 0;
+	for (int level = 0; level < parameters.specularLevels; level++)
+	{
+		const std::size_t size = std::max(parameters.specularSize >> level, 1);
+		bytes += size * size * 6 * 4 * sizeof(uint16_t);
+	}
+	return bytes + std::size_t(parameters.brdfLutSize) * parameters.brdfLutSize * 2 * sizeof(uint16_t) + SHFloats * sizeof(float);
+}
+
+std::size_t EnvironmentMaps::transientBytes(const Parameters& parameters)
+{
+	std::size_t bytes = 0;
+	for (int size = parameters.specularSize; size > 0; size /= 2)
+	{
+		bytes += std::size_t(size) * size * 6 * 4 * sizeof(uint16_t);
+	}
+	return bytes;
+}
+
+uint64_t EnvironmentMaps::key(const std::string& sourceFile, const Parameters& parameters)
+{
+	try
+	{
+		return key(File::readBinary(sourceFile), parameters);
+	}
+	catch (const std::runtime_error&)
+	{
+		return 0;
+	}
+}
+
+uint64_t EnvironmentMaps::key(const std::vector<char>& source, const Parameters& parameters)
+{
+	uint64_t key = ShaderPreprocessor::hash(source.data(), source.size(), ShaderPreprocessor::HashSeed);
+	try
+	{
+		for (const std::string& program : parameters.programFiles)
+		{
+			key = ShaderPreprocessor::hash(File::readText(program), key);
+		}
+	}
+	catch (const std::runtime_error&)
+	{
+		return 0;
+	}
+	for (const int value : { int(CacheVersion), parameters.specularSize, parameters.specularLevels, parameters.specularSamples,
+							 parameters.irradianceSourceSize, parameters.brdfLutSize })
+	{
+		key = ShaderPreprocessor::hash(&value, sizeof(value), key);
+	}
+	return key;
+}
+
+std::string EnvironmentMaps::fileName(const std::string& cacheDirectory, uint64_t key)
+{
+	char name[40];
+	std::snprintf(name, sizeof(name), "environment_%016llx.bin", static_cast<unsigned long long>(key));
+	return cacheDirectory + name;
+}
+
+std::shared_ptr<EnvironmentMaps> EnvironmentMaps::load(const std::string& filename, uint64_t key, const Parameters& parameters)
+{
+	if (0 == key)
+	{
+		return nullptr;
+	}
+	std::ifstream file{filename, std::ios::binary};
+	if (!file.is_open())
+	{
+		return nullptr;
+	}
+
+	CacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| 0 != std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic))
+		|| CacheVersion != header.version
+		|| uint32_t(NumMaps) != header.maps
+		|| key != header.key)
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<EnvironmentMaps> maps = std::make_shared<EnvironmentMaps>(key, parameters);
+	// a truncated or overlong file is left by a writer that did not finish, never upload part of it
+	std::size_t expectedSize = sizeof(CacheHeader) + NumMaps * sizeof(MapHeader) + sizeof(maps->m_irradianceSH);
+	for (const Storage& storage : maps->m_maps)
+	{
+		expectedSize += storage.texels.size() * sizeof(uint16_t);
+	}
+	std::error_code error;
+	if (std::filesystem::file_size(filename, error) != expectedSize || error)
+	{
+		return nullptr;
+	}
+	for (Storage& storage : maps->m_maps)
+	{
+		MapHeader mapHeader;
+		if (!file.read(reinterpret_cast<char*>(&mapHeader), sizeof(mapHeader))
+			|| uint32_t(storage.size) != mapHeader.size
+			|| uint32_t(storage.levelOffsets.size()) != mapHeader.levels
+			|| uint32_t(storage.faces) != mapHeader.faces
+			|| uint32_t(storage.channels) != mapHeader.channels)
+		{
+			return nullptr;
+		}
+	}
+	if (!file.read(reinterpret_cast<char*>(maps->m_irradianceSH), sizeof(maps->m_irradianceSH)))
+	{
+		return nullptr;
+	}
+	for (Storage& storage : maps->m_maps)
+	{
+		if (!file.read(reinterpret_cast<char*>(storage.texels.data()), storage.texels.size() * sizeof(uint16_t)))
+		{
+			return nullptr;
+		}
+	}
+	return maps;
+}
+
+bool EnvironmentMaps::save(const std::string& filename) const
+{
+	// written next to the cache file and renamed into place, so readers see either no file or a complete one
+	const std::string tempFilename = filename + ".tmp";
+	if (!write(tempFilename))
+	{
+		std::error_code error;
+		std::filesystem::remove(tempFilename, error);
+		return false;
+	}
+	std::error_code error;
+	std::filesystem::rename(tempFilename, filename, error);
+	if (error)
+	{
+		std::filesystem::remove(tempFilename, error);
+		return false;
+	}
+	return true;
+}
+
+bool EnvironmentMaps::write(const std::string& filename) const
+{
+	std::ofstream file{filename, std::ios::binary | std::ios::trunc};
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	CacheHeader header = {};
+	std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+	header.version = CacheVersion;
+	header.maps = uint32_t(NumMaps);
+	header.key = m_key;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	for (const Storage& storage : m_maps)
+	{
+		MapHeader mapHeader = {};
+		mapHeader.size = uint32_t(storage.size);
+		mapHeader.levels = uint32_t(storage.levelOffsets.size());
+		mapHeader.faces = uint32_t(storage.faces);
+		mapHeader.channels = uint32_t(storage.channels);
+		file.write(reinterpret_cast<const char*>(&mapHeader), sizeof(mapHeader));
+	}
+	file.write(reinterpret_cast<const char*>(m_irradianceSH), sizeof(m_irradianceSH));
+	for (const Storage& storage : m_maps)
+	{
+		file.write(reinterpret_cast<const char*>(storage.texels.data()), storage.texels.size() * sizeof(uint16_t));
+	}
+	file.close();
+	return !file.fail();
+}
@@ -0,0 +1,106 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Image based lighting maps precomputed by Environment (opengl.hpp) in a versioned mip-chain container
+ * with the spherical harmonics of the diffuse lighting, so warm starts upload them instead of running
+ * the precompute programs again.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EnvironmentMaps
+{
+public:
+	enum Map { Specular = 0, BrdfLut, NumMaps };
+
+	// the irradiance is projected from the mip level of this size, the BRDF LUT is the same for every tier
+	static constexpr int IrradianceSourceSize = 64;
+	static constexpr int BrdfLutSize = 256;
+
+	// runtime quality tiers of the specular map: cube size, GGX samples per texel and mip levels.
+	// Filtered importance sampling in spmap_cs.glsl keeps the low sample counts free of fireflies,
+	// Reference is the brute force 1024 samples of the original precompute.
+	enum class Quality { Low = 0, Medium, High, Reference, NumQualities };
+	static const char* qualityName(Quality quality);
+	// Quality of a lower case name, false when there is none
+	static bool parseQuality(const std::string& name, Quality& quality);
+
+	// L2 spherical harmonics as vec4 of std140/std430 arrays, see irradiance_sh.glsl
+	static constexpr int SHCoefficients = 9;
+	static constexpr int SHFloats = 4 * SHCoefficients;
+
+	// everything the precomputed maps depend on besides the source image
+	struct Parameters
+	{
+		Quality quality;
+		int specularSize;
+		int specularLevels;
+		int specularSamples;
+		int irradianceSourceSize;
+		int brdfLutSize;
+		std::vector<std::string> programFiles;	// sources of the precompute programs, their sample counts live there
+	};
+
+	// sizes of the tier and the precompute programs in data/shaders/, shared by the renderer and ibl-bake
+	static Parameters parameters(Quality quality);
+	// resident bytes of the maps, plus the unfiltered cube map and its mip chain while precomputing
+	static std::size_t residentBytes(const Parameters& parameters);
+	static std::size_t transientBytes(const Parameters& parameters);
+
+	// FNV-1a of the source image file chained with the parameters and the program sources, 0 when a file can't be read
+	static uint64_t key(const std::string& sourceFile, const Parameters& parameters);
+	// same for the contents of the source image file read by the caller
+	static uint64_t key(const std::vector<char>& source, const Parameters& parameters);
+	static std::string fileName(const std::string& cacheDirectory, uint64_t key);
+
+	// maps of the cache file or nullptr when it is missing, outdated or truncated
+	static std::shared_ptr<EnvironmentMaps> load(const std::string& filename, uint64_t key, const Parameters& parameters);
+	// through a temporary file renamed over filename, false when either step fails
+	bool save(const std::string& filename) const;
+
+	// storage for all levels of the maps, filled by the caller
+	EnvironmentMaps(uint64_t key, const Parameters& parameters);
+
+	uint64_t key() const { return m_key; }
+	int levels(Map map) const { return static_cast<int>(m_maps[map].levelOffsets.size()); }
+	int faces(Map map) const { return m_maps[map].faces; }
+	int channels(Map map) const { return m_maps[map].channels; }
+	int levelSize(Map map, int level) const { return (m_maps[map].size >> level) > 0 ? (m_maps[map].size >> level) : 1; }
+	// bytes of a level with all its faces
+	std::size_t levelBytes(Map map, int level) const
+	{
+		return std::size_t(levelSize(map, level)) * levelSize(map, level) * faces(map) * channels(map) * sizeof(uint16_t);
+	}
+
+	// half float texels of a level, faces in GL order (+X, -X, +Y, -Y, +Z, -Z) one after another
+	uint16_t* data(Map map, int level) { return &m_maps[map].texels[m_maps[map].levelOffsets[level]]; }
+	const uint16_t* data(Map map, int level) const { return &m_maps[map].texels[m_maps[map].levelOffsets[level]]; }
+
+	// premultiplied coefficients of the diffuse lighting, rgb and an unused w each
+	float* irradianceSH() { return m_irradianceSH; }
+	const float* irradianceSH() const { return m_irradianceSH; }
+
+private:
+	struct Storage
+	{
+		int size = 0;
+		int faces = 0;
+		int channels = 0;
+		std::vector<std::size_t> levelOffsets;
+		std::vector<uint16_t> texels;
+	};
+
+	void allocate(Map map, int size, int levels, int faces, int channels);
+	bool write(const std::string& filename) const;
+
+	uint64_t m_key;
+	Storage m_maps[NumMaps];
+	float m_irradianceSH[SHFloats] = {};
+};
@@ -0,0 +1,48 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <cmath>
+
+#include "frame_budget.hpp"
+
+void FrameBudget::setBudget(double budgetMs)
+{
+	m_budgetMs = budgetMs;
+	m_overBudget = m_underBudget = m_cooldown = 0;
+}
+
+FrameBudget::Action FrameBudget::update(double gpuMs, bool mayLower, bool mayRaise)
+{
+	if (!enabled() || !std::isfinite(gpuMs) || gpuMs <= 0.0)
+	{
+		return Action::None;
+	}
+
+	m_smoothedMs = m_hasSample ? m_smoothedMs + Smoothing * (gpuMs - m_smoothedMs) : gpuMs;
+	m_hasSample = true;
+	if (m_cooldown > 0)
+	{
+		m_cooldown--;
+		return Action::None;
+	}
+
+	m_overBudget = (mayLower && m_smoothedMs > m_bands.upperBand * m_budgetMs) ? m_overBudget + 1 : 0;
+	m_underBudget = (mayRaise && m_smoothedMs < m_bands.lowerBand * m_budgetMs) ? m_underBudget + 1 : 0;
+	if (m_overBudget >= m_bands.framesToLower)
+	{
+		return Action::Lower;
+	}
+	if (m_underBudget >= m_bands.framesToRaise)
+	{
+		return Action::Raise;
+	}
+	return Action::None;
+}
+
+void FrameBudget::changed()
+{
+	m_overBudget = m_underBudget = 0;
+	m_cooldown = m_bands.cooldown;
+}
@@ -0,0 +1,59 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Smoothed GPU frame time against a budget with a dead band around it, shared by the closed loop
+ * controllers of detail (LodGovernor) and render scale (DynamicResolution).
+ */
+
+#pragma once
+
+class FrameBudget
+{
+public:
+	enum class Action
+	{
+		None,
+		Lower,		// stayed above the budget, lower the cost
+		Raise,		// stayed clearly below the budget, raise the quality
+	};
+
+	// the smoothed time has to stay above upperBand * budget for framesToLower frames before Lower and
+	// below lowerBand * budget for framesToRaise frames before Raise; after a change no decision is made
+	// for cooldown frames, while the smoothed time reacts to it
+	struct Bands
+	{
+		double upperBand;
+		double lowerBand;
+		int framesToLower;
+		int framesToRaise;
+		int cooldown;
+	};
+
+	explicit FrameBudget(const Bands& bands) : m_bands(bands) {}
+
+	// budgetMs <= 0 disables the controller; clears the counters and the cooldown
+	void setBudget(double budgetMs);
+	double budget() const { return m_budgetMs; }
+	bool enabled() const { return m_budgetMs > 0.0; }
+	double smoothedMs() const { return m_smoothedMs; }
+	// no change is cooling down
+	bool settled() const { return 0 == m_cooldown; }
+
+	// GPU time of a finished frame; a direction that is not allowed restarts its count, so it takes
+	// the full number of frames once it is allowed again
+	Action update(double gpuMs, bool mayLower = true, bool mayRaise = true);
+	// the controller acted on the last action: clears the counters and starts the cooldown
+	void changed();
+
+private:
+	static constexpr double Smoothing = 0.1;
+
+	Bands m_bands;
+	double m_budgetMs = 0.0;
+	double m_smoothedMs = 0.0;
+	bool m_hasSample = false;
+	int m_overBudget = 0;
+	int m_underBudget = 0;
+	int m_cooldown = 0;
+};
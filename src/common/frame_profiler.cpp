@@ -0,0 +1,302 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <sstream>
+
+#include "frame_profiler.hpp"
+
+namespace {
+	const double Missing = std::numeric_limits<double>::quiet_NaN();
+
+	struct Statistic
+	{
+		const char* name;
+		double (*compute)(const std::vector<double>& sorted);
+	};
+
+	double percentile(const std::vector<double>& sorted, double fraction)
+	{
+		// nearest rank
+		const size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+		return sorted[std::max<size_t>(rank, 1) - 1];
+	}
+
+	const Statistic Statistics[] =
+	{
+		{ "min", [](const std::vector<double>& sorted) { return sorted.front(); } },
+		{ "avg", [](const std::vector<double>& sorted) { return std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size(); } },
+		{ "p95", [](const std::vector<double>& sorted) { return percentile(sorted, 0.95); } },
+		{ "p99", [](const std::vector<double>& sorted) { return percentile(sorted, 0.99); } },
+		{ "max", [](const std::vector<double>& sorted) { return sorted.back(); } },
+	};
+
+	double statistic(const Statistic& stat, std::vector<double> samples)
+	{
+		if (samples.empty())
+		{
+			return Missing;
+		}
+		std::sort(samples.begin(), samples.end());
+		return stat.compute(samples);
+	}
+
+	std::string formatValue(double value, bool json)
+	{
+		if (std::isnan(value))
+		{
+			return json ? "null" : "";
+		}
+		std::ostringstream str;
+		str << std::fixed << std::setprecision(4) << value;
+		return str.str();
+	}
+}
+
+FrameProfiler::FrameProfiler(std::vector<std::string> stages, std::vector<std::string> counters)
+	: m_stages(std::move(stages))
+	, m_counters(std::move(counters))
+	, m_json(false)
+	, m_frame(0)
+	, m_current{ 0, 0.0, std::vector<double>(m_stages.size(), 0.0), {}, std::vector<double>(m_counters.size(), 0.0), false }
+	, m_cpuSamples(m_stages.size())
+	, m_gpuSamples(m_stages.size())
+	, m_counterSamples(m_counters.size())
+{
+}
+
+FrameProfiler::~FrameProfiler()
+{
+	close();
+}
+
+bool FrameProfiler::open(const std::string& filename)
+{
+	close();
+	m_file.open(filename, std::ios::trunc);
+	if (!m_file.is_open())
+	{
+		std::cout << "WARNING: could not open frame report " << filename << std::endl;
+		return false;
+	}
+	const std::string extension = ".json";
+	m_json = filename.size() >= extension.size()
+		&& 0 == filename.compare(filename.size() - extension.size(), extension.size(), extension);
+	writeHeader();
+	return true;
+}
+
+void FrameProfiler::close()
+{
+	if (!m_file.is_open())
+	{
+		return;
+	}
+	for (FrameRecord& record : m_pending)
+	{
+		record.resolved = true;
+	}
+	flushResolved();
+	writeSummary();
+	m_file.close();
+}
+
+void FrameProfiler::beginFrame()
+{
+	m_frameStart = std::chrono::steady_clock::now();
+	m_current = FrameRecord{ m_frame, 0.0, std::vector<double>(m_stages.size(), 0.0), {}, std::vector<double>(m_counters.size(), 0.0), false };
+}
+
+void FrameProfiler::endFrame()
+{
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_frameStart;
+	m_current.cpuFrameTime = elapsed.count();
+	if (isEnabled())
+	{
+		m_pending.push_back(std::move(m_current));
+		flushResolved();
+	}
+	m_frame++;
+}
+
+void FrameProfiler::addCpuTime(int stage, double milliseconds)
+{
+	m_current.cpuTimes[stage] += milliseconds;
+}
+
+void FrameProfiler::setCounter(int counter, double value)
+{
+	m_current.counters[counter] = value;
+}
+
+void FrameProfiler::setGpuTimes(uint64_t frame, const std::vector<double>& milliseconds)
+{
+	if (FrameRecord* record = findPending(frame))
+	{
+		record->gpuTimes = milliseconds;
+		record->resolved = true;
+		flushResolved();
+	}
+}
+
+void FrameProfiler::dropGpuTimes(uint64_t frame)
+{
+	if (FrameRecord* record = findPending(frame))
+	{
+		record->resolved = true;
+		flushResolved();
+	}
+}
+
+FrameProfiler::FrameRecord* FrameProfiler::findPending(uint64_t frame)
+{
+	auto it = std::find_if(m_pending.begin(), m_pending.end(), [frame](const FrameRecord& record) { return record.frame == frame; });
+	return (m_pending.end() != it) ? &*it : nullptr;
+}
+
+void FrameProfiler::flushResolved()
+{
+	// rows stay in frame order
+	while (!m_pending.empty() && m_pending.front().resolved)
+	{
+		const FrameRecord& record = m_pending.front();
+		m_cpuFrameSamples.push_back(record.cpuFrameTime);
+		for (size_t stage = 0; stage < m_stages.size(); stage++)
+		{
+			m_cpuSamples[stage].push_back(record.cpuTimes[stage]);
+			if (stage < record.gpuTimes.size() && !std::isnan(record.gpuTimes[stage]))
+			{
+				m_gpuSamples[stage].push_back(record.gpuTimes[stage]);
+			}
+		}
+		for (size_t counter = 0; counter < m_counters.size(); counter++)
+		{
+			m_counterSamples[counter].push_back(record.counters[counter]);
+		}
+		writeRecord(record);
+		m_pending.pop_front();
+	}
+}
+
+void FrameProfiler::writeHeader()
+{
+	if (m_json)
+	{
+		return;
+	}
+	m_file << "frame,cpu_frame_ms";
+	for (const std::string& stage : m_stages)
+	{
+		m_file << "," << stage << "_cpu_ms," << stage << "_gpu_ms";
+	}
+	for (const std::string& counter : m_counters)
+	{
+		m_file << "," << counter;
+	}
+	m_file << "\n";
+}
+
+void FrameProfiler::writeRecord(const FrameRecord& record)
+{
+	auto gpuTime = [&record](size_t stage) { return (stage < record.gpuTimes.size()) ? record.gpuTimes[stage] : Missing; };
+	if (m_json)
+	{
+		m_file << "{\"frame\":" << record.frame << ",\"cpu_frame_ms\":" << formatValue(record.cpuFrameTime, true);
+		for (size_t stage = 0; stage < m_stages.size(); stage++)
+		{
+			m_file << ",\"" << m_stages[stage] << "_cpu_ms\":" << formatValue(record.cpuTimes[stage], true)
+				   << ",\"" << m_stages[stage] << "_gpu_ms\":" << formatValue(gpuTime(stage), true);
+		}
+		for (size_t counter = 0; counter < m_counters.size(); counter++)
+		{
+			m_file << ",\"" << m_counters[counter] << "\":" << formatValue(record.counters[counter], true);
+		}
+		m_file << "}\n";
+	}
+	else
+	{
+		m_file << record.frame << "," << formatValue(record.cpuFrameTime, false);
+		for (size_t stage = 0; stage < m_stages.size(); stage++)
+		{
+			m_file << "," << formatValue(record.cpuTimes[stage], false) << "," << formatValue(gpuTime(stage), false);
+		}
+		for (size_t counter = 0; counter < m_counters.size(); counter++)
+		{
+			m_file << "," << formatValue(record.counters[counter], false);
+		}
+		m_file << "\n";
+	}
+}
+
+void FrameProfiler::writeSummary()
+{
+	// CSV gets one row per statistic with the statistic name in the frame column,
+	// JSON a final {"summary": {...}} line
+	if (m_json)
+	{
+		m_file << "{\"summary\":{\"frames\":" << m_cpuFrameSamples.size();
+	}
+	for (const Statistic& stat : Statistics)
+	{
+		if (m_json)
+		{
+			m_file << ",\"" << stat.name << "\":{\"cpu_frame_ms\":" << formatValue(statistic(stat, m_cpuFrameSamples), true);
+			for (size_t stage = 0; stage < m_stages.size(); stage++)
+			{
+				m_file << ",\"" << m_stages[stage] << "_cpu_ms\":" << formatValue(statistic(stat, m_cpuSamples[stage]), true)
+					   << ",\"" << m_stages[stage] << "_gpu_ms\":" << formatValue(statistic(stat, m_gpuSamples[stage]), true);
+			}
+			for (size_t counter = 0; counter < m_counters.size(); counter++)
+			{
+				m_file << ",\"" << m_counters[counter] << "\":" << formatValue(statistic(stat, m_counterSamples[counter]), true);
+			}
+			m_file << "}";
+		}
+		else
+		{
+			m_file << stat.name << "," << formatValue(statistic(stat, m_cpuFrameSamples), false);
+			for (size_t stage = 0; stage < m_stages.size(); stage++)
+			{
+				m_file << "," << formatValue(statistic(stat, m_cpuSamples[stage]), false)
+					   << "," << formatValue(statistic(stat, m_gpuSamples[stage]), false);
+			}
+			for (size_t counter = 0; counter < m_counters.size(); counter++)
+			{
+				m_file << "," << formatValue(statistic(stat, m_counterSamples[counter]), false);
+			}
+			m_file << "\n";
+		}
+	}
+	if (m_json)
+	{
+		m_file << "}}\n";
+	}
+
+	std::cout << "Frame report: " << m_cpuFrameSamples.size() << " frames (ms or count, avg / p95 / p99)" << std::endl;
+	auto printLine = [](const std::string& name, const std::vector<double>& samples)
+	{
+		std::cout << "  " << std::left << std::setw(24) << name << std::right;
+		for (size_t i : { size_t(1), size_t(2), size_t(3) })
+		{
+			std::cout << std::setw(10) << formatValue(statistic(Statistics[i], samples), false);
+		}
+		std::cout << std::endl;
+	};
+	printLine("cpu frame", m_cpuFrameSamples);
+	for (size_t stage = 0; stage < m_stages.size(); stage++)
+	{
+		printLine(m_stages[stage] + " cpu", m_cpuSamples[stage]);
+		printLine(m_stages[stage] + " gpu", m_gpuSamples[stage]);
+	}
+	for (size_t counter = 0; counter < m_counters.size(); counter++)
+	{
+		printLine(m_counters[counter], m_counterSamples[counter]);
+	}
+}
@@ -0,0 +1,96 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Per frame CPU and GPU timings of render stages and per frame counters, streamed as CSV or JSON lines.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class FrameProfiler
+{
+public:
+	// stages and counters are fixed up front, so every report row has the same columns
+	explicit FrameProfiler(std::vector<std::string> stages, std::vector<std::string> counters = {});
+	~FrameProfiler();
+
+	// output format follows the extension: ".json" writes JSON lines, anything else CSV
+	bool open(const std::string& filename);
+	bool isEnabled() const { return m_file.is_open(); }
+	// writes the frames still waiting for GPU results and the min/avg/p95/p99/max summary
+	void close();
+
+	int stageCount() const { return static_cast<int>(m_stages.size()); }
+	uint64_t frame() const { return m_frame; }
+
+	void beginFrame();
+	void endFrame();
+	void addCpuTime(int stage, double milliseconds);
+	// value of a counter for the current frame
+	void setCounter(int counter, double value);
+
+	// GPU results arrive frames later; a frame whose queries were not ready is reported without them
+	void setGpuTimes(uint64_t frame, const std::vector<double>& milliseconds);
+	void dropGpuTimes(uint64_t frame);
+
+	// adds the lifetime of the scope to the CPU time of a stage
+	class CpuScope
+	{
+	public:
+		CpuScope(FrameProfiler& profiler, int stage)
+			: m_profiler(profiler), m_stage(stage), m_start(std::chrono::steady_clock::now())
+		{}
+		~CpuScope()
+		{
+			const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_start;
+			m_profiler.addCpuTime(m_stage, elapsed.count());
+		}
+		CpuScope(const CpuScope&) = delete;
+		CpuScope& operator=(const CpuScope&) = delete;
+
+	private:
+		FrameProfiler& m_profiler;
+		int m_stage;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+private:
+	struct FrameRecord
+	{
+		uint64_t frame;
+		double cpuFrameTime;
+		std::vector<double> cpuTimes;
+		std::vector<double> gpuTimes;	// empty until resolved
+		std::vector<double> counters;
+		bool resolved;
+	};
+
+	FrameRecord* findPending(uint64_t frame);
+	void flushResolved();
+	void writeHeader();
+	void writeRecord(const FrameRecord& record);
+	void writeSummary();
+
+	std::vector<std::string> m_stages;
+	std::vector<std::string> m_counters;
+	std::ofstream m_file;
+	bool m_json;
+
+	uint64_t m_frame;
+	std::chrono::steady_clock::time_point m_frameStart;
+	FrameRecord m_current;
+	std::deque<FrameRecord> m_pending;
+
+	// samples for the summary: CPU frame time, then CPU and GPU times of each stage
+	std::vector<double> m_cpuFrameSamples;
+	std::vector<std::vector<double>> m_cpuSamples;
+	std::vector<std::vector<double>> m_gpuSamples;
+	std::vector<std::vector<double>> m_counterSamples;
+};
@@ -0,0 +1,244 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(HDR_IMAGE_F16C) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include "hdr_image.hpp"
+#include "hdr_image_kernel.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+void HdrImageKernel::rgbeToHalfScalar(const uint8_t *planes, int width, uint16_t *rgba)
+{
+	const uint8_t *r = planes, *g = planes + width, *b = planes + 2 * width, *e = planes + 3 * width;
+	for (int x = 0; x < width; x++)
+	{
+		const uint32_t bits = scaleBits(e[x]);
+		float scale;
+		std::memcpy(&scale, &bits, sizeof(scale));
+		rgba[4 * x + 0] = Utility::floatToHalf(float(r[x]) * scale);
+		rgba[4 * x + 1] = Utility::floatToHalf(float(g[x]) * scale);
+		rgba[4 * x + 2] = Utility::floatToHalf(float(b[x]) * scale);
+		rgba[4 * x + 3] = 0x3c00;
+	}
+}
+
+namespace
+{
+	bool cpuSupportsF16C()
+	{
+#if !defined(HDR_IMAGE_F16C)
+		return false;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		const bool f16c = (info[2] & (1 << 29)) != 0;
+		return osxsave && avx && f16c && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+#endif
+	}
+
+	HdrImageKernel::Entry kernelEntry(HdrImage::Kernel kernel)
+	{
+		switch (kernel)
+		{
+#if defined(HDR_IMAGE_F16C)
+		case HdrImage::Kernel::F16C:	return HdrImageKernel::rgbeToHalfF16C;
+#endif
+		default:						return HdrImageKernel::rgbeToHalfScalar;
+		}
+	}
+
+	std::atomic<HdrImage::Kernel>& currentKernel()
+	{
+		static std::atomic<HdrImage::Kernel> kernel { cpuSupportsF16C() ? HdrImage::Kernel::F16C : HdrImage::Kernel::Scalar };
+		return kernel;
+	}
+
+	// next header line without the newline, pos is moved past it; false at the end of the file
+	bool readLine(const std::vector<char>& file, std::size_t& pos, std::string& line)
+	{
+		if (pos >= file.size())
+		{
+			return false;
+		}
+		const auto end = std::find(file.begin() + pos, file.end(), '\n');
+		line.assign(file.begin() + pos, end);
+		pos = std::size_t(end - file.begin()) + (end != file.end() ? 1 : 0);
+		return true;
+	}
+}
+
+std::shared_ptr<HdrImage> HdrImage::fromMemory(std::vector<char> file, const std::string& name)
+{
+	std::size_t pos = 0;
+	std::string line;
+	if (!readLine(file, pos, line) || (line.compare(0, 10, "#?RADIANCE") != 0 && line.compare(0, 6, "#?RGBE") != 0))
+	{
+		return nullptr;
+	}
+	while (readLine(file, pos, line) && !line.empty())
+	{
+		if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe")
+		{
+			return nullptr;
+		}
+	}
+	int width = 0, height = 0;
+	if (!readLine(file, pos, line) || 2 != std::sscanf(line.c_str(), "-Y %d +X %d", &height, &width)
+		|| width <= 0 || height <= 0)
+	{
+		return nullptr;
+	}
+
+	std::cout << "Loading image: " << name << std::endl;
+
+	std::shared_ptr<HdrImage> image { new HdrImage };
+	image->m_width = width;
+	image->m_height = height;
+	image->m_rowOffsets.resize(std::size_t(height) + 1);
+	image->m_rowEncoded.resize(height);
+
+	// only the run headers are read here, the runs themselves are expanded by readPlanes();
+	// like stb_image, a scanline that is not run length encoded makes the rest of the image flat
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(file.data());
+	const std::size_t size = file.size();
+	const auto corrupt = [&name]() { return std::runtime_error("Corrupt Radiance scanlines in image file: " + name); };
+	bool encoded = width >= 8 && width < 32768;
+	for (int row = 0; row < height; row++)
+	{
+		image->m_rowOffsets[row] = pos;
+		if (encoded)
+		{
+			encoded = pos + 4 <= size && 2 == bytes[pos] && 2 == bytes[pos + 1] && 0 == (bytes[pos + 2] & 0x80);
+		}
+		image->m_rowEncoded[row] = encoded;
+		if (!encoded)
+		{
+			pos += std::size_t(width) * 4;
+			if (pos > size)
+			{
+				throw corrupt();
+			}
+			continue;
+		}
+
+		if (((bytes[pos + 2] << 8) | bytes[pos + 3]) != width)
+		{
+			throw corrupt();
+		}
+		pos += 4;
+		for (int channel = 0; channel < 4; channel++)
+		{
+			for (int x = 0; x < width; )
+			{
+				if (pos >= size)
+				{
+					throw corrupt();
+				}
+				const int count = bytes[pos];
+				const int run = count > 128 ? count - 128 : count;
+				pos += count > 128 ? 2 : 1 + std::size_t(count);
+				if (0 == run || x + run > width || pos > size)
+				{
+					throw corrupt();
+				}
+				x += run;
+			}
+		}
+	}
+	image->m_rowOffsets[height] = pos;
+	image->m_file = std::move(file);
+	return image;
+}
+
+void HdrImage::readPlanes(int row, uint8_t* planes) const
+{
+	const uint8_t* src = reinterpret_cast<const uint8_t*>(m_file.data()) + m_rowOffsets[row];
+	if (!m_rowEncoded[row])
+	{
+		for (int x = 0; x < m_width; x++, src += 4)
+		{
+			for (int channel = 0; channel < 4; channel++)
+			{
+				planes[channel * m_width + x] = src[channel];
+			}
+		}
+		return;
+	}
+
+	// validated by fromMemory()
+	src += 4;
+	for (int channel = 0; channel < 4; channel++)
+	{
+		uint8_t* dst = planes + channel * m_width;
+		for (int x = 0; x < m_width; )
+		{
+			const int count = *src++;
+			if (count > 128)
+			{
+				std::memset(dst + x, *src++, count - 128);
+				x += count - 128;
+			}
+			else
+			{
+				std::memcpy(dst + x, src, count);
+				src += count;
+				x += count;
+			}
+		}
+	}
+}
+
+void HdrImage::decode(ThreadPool& pool, int begin, int end, uint16_t* rgba) const
+{
+	const HdrImageKernel::Entry convert = kernelEntry(kernel());
+	const std::size_t grain = std::max<std::size_t>(1, std::size_t(end - begin) / (4 * (pool.size() + 1)));
+	pool.parallelFor(std::size_t(begin), std::size_t(end), grain, [&](std::size_t first, std::size_t last) {
+		std::vector<uint8_t> planes(std::size_t(m_width) * 4);
+		for (std::size_t row = first; row < last; row++)
+		{
+			readPlanes(int(row), planes.data());
+			convert(planes.data(), m_width, rgba + (row - std::size_t(begin)) * m_width * 4);
+		}
+	});
+}
+
+HdrImage::Kernel HdrImage::kernel()
+{
+	return currentKernel().load(std::memory_order_relaxed);
+}
+
+bool HdrImage::setKernel(Kernel kernel)
+{
+	if (Kernel::F16C == kernel && !cpuSupportsF16C())
+	{
+		return false;
+	}
+	currentKernel().store(kernel, std::memory_order_relaxed);
+	return true;
+}
+
+const char* HdrImage::kernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case Kernel::F16C:	return "f16c";
+	default:			return "scalar";
+	}
+}
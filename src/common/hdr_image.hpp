@@ -0,0 +1,58 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Radiance (.hdr) images decoded straight to half float RGBA. The scanlines are indexed once, so any
+ * band of rows can be decoded on the thread pool into a caller buffer, e.g. a mapped pixel unpack
+ * buffer, without a float copy of the whole image.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+class HdrImage
+{
+public:
+	enum class Kernel
+	{
+		Scalar,
+		F16C,		// 4 texels per iteration
+	};
+
+	// image of the file contents; nullptr for Radiance files this decoder doesn't handle (XYZE, old
+	// style RLE, orientations other than -Y +X) and for other formats, which are left to Image::fromFile.
+	// Throws std::runtime_error for truncated or corrupt scanlines.
+	static std::shared_ptr<HdrImage> fromMemory(std::vector<char> file, const std::string& name);
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+	std::size_t rowBytes() const { return std::size_t(m_width) * 4 * sizeof(uint16_t); }
+
+	// rows [begin, end) from the top into rgba, rowBytes() apart, in parallel chunks of rows
+	void decode(ThreadPool& pool, int begin, int end, uint16_t* rgba) const;
+
+	// fastest kernel supported by the CPU is selected on first use
+	static Kernel kernel();
+	// returns false and keeps current kernel when the requested one is not supported
+	static bool setKernel(Kernel kernel);
+	static const char* kernelName(Kernel kernel);
+
+private:
+	HdrImage() = default;
+
+	// R, G, B and E bytes of a scanline one plane after another, width bytes each
+	void readPlanes(int row, uint8_t* planes) const;
+
+	int m_width = 0;
+	int m_height = 0;
+	std::vector<char> m_file;
+	std::vector<std::size_t> m_rowOffsets;		// start of every scanline in m_file, plus the end of the last
+	std::vector<bool> m_rowEncoded;				// run length encoded or flat RGBE
+};
@@ -0,0 +1,59 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Radiance RGBE to half float: F16C kernel, 4 texels per iteration.
+ */
+
+#include <cstring>
+#include <immintrin.h>
+
+#include "hdr_image_kernel.hpp"
+
+namespace
+{
+	// 4 bytes of a plane as 32 bit integers
+	inline __m128i loadBytes(const uint8_t *src)
+	{
+		int32_t bytes;
+		std::memcpy(&bytes, src, sizeof(bytes));
+		const __m128i zero = _mm_setzero_si128();
+		return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+	}
+}
+
+void HdrImageKernel::rgbeToHalfF16C(const uint8_t *planes, int width, uint16_t *rgba)
+{
+	const uint8_t *r = planes, *g = planes + width, *b = planes + 2 * width, *e = planes + 3 * width;
+	const __m128i nine = _mm_set1_epi32(9);
+	const __m128i alpha = _mm_set1_epi16(0x3c00);
+
+	int x = 0;
+	for (; x + 4 <= width; x += 4)
+	{
+		// scaleBits() of four texels
+		const __m128i exponent = loadBytes(e + x);
+		const __m128 scale = _mm_castsi128_ps(_mm_and_si128(_mm_slli_epi32(_mm_sub_epi32(exponent, nine), 23),
+															_mm_cmpgt_epi32(exponent, nine)));
+
+		const __m128i rh = _mm_cvtps_ph(_mm_mul_ps(_mm_cvtepi32_ps(loadBytes(r + x)), scale), _MM_FROUND_TO_NEAREST_INT);
+		const __m128i gh = _mm_cvtps_ph(_mm_mul_ps(_mm_cvtepi32_ps(loadBytes(g + x)), scale), _MM_FROUND_TO_NEAREST_INT);
+		const __m128i bh = _mm_cvtps_ph(_mm_mul_ps(_mm_cvtepi32_ps(loadBytes(b + x)), scale), _MM_FROUND_TO_NEAREST_INT);
+
+		const __m128i rg = _mm_unpacklo_epi16(rh, gh);
+		const __m128i ba = _mm_unpacklo_epi16(bh, alpha);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + 4 * x), _mm_unpacklo_epi32(rg, ba));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + 4 * x + 8), _mm_unpackhi_epi32(rg, ba));
+	}
+	if (x < width)
+	{
+		// the tail goes through the scalar kernel with planes of the remaining texels
+		uint8_t tail[4 * 4];
+		const int count = width - x;
+		for (int c = 0; c < 4; c++)
+		{
+			std::memcpy(tail + c * count, planes + c * width + x, count);
+		}
+		rgbeToHalfScalar(tail, count, rgba + 4 * x);
+	}
+}
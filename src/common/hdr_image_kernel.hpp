@@ -0,0 +1,28 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Radiance RGBE to half float conversion kernels of HdrImage, selected at runtime.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace HdrImageKernel
+{
+	// planes holds width bytes of R, G, B and E one after another, rgba gets width half float RGBA texels
+	// with alpha 1; results are rounded to nearest even like Utility::floatToHalf, so kernels are bit identical
+	using Entry = void (*)(const uint8_t *planes, int width, uint16_t *rgba);
+
+	void rgbeToHalfScalar(const uint8_t *planes, int width, uint16_t *rgba);
+#if defined(HDR_IMAGE_F16C)
+	void rgbeToHalfF16C(const uint8_t *planes, int width, uint16_t *rgba);
+#endif
+
+	// 2^(e - 136) as float bits, zero for the exponents whose values flush to zero in half precision anyway
+	inline uint32_t scaleBits(uint32_t e)
+	{
+		return e > 9 ? (e - 9) << 23 : 0;
+	}
+}
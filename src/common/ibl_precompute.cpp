@@ -0,0 +1,553 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#include "environment_maps.hpp"
+#include "ibl_precompute.hpp"
+#include "image.hpp"
+#include "thread_pool.hpp"
+#include "utils.hpp"
+
+namespace {
+	// constants of the shaders, PI included
+	const float Pi = 3.141592f;
+	const float TwoPi = 2.0f * Pi;
+	const float BasisEpsilon = 0.00001f;
+	const float BrdfEpsilon = 0.001f;
+
+	// the specular sample count is a parameter of the quality tier
+	const unsigned int BrdfSamples = 1024;
+
+	// texels per work item, the workgroup size of the shaders
+	const int TileSize = 32;
+
+	float roundToHalf(float value)
+	{
+		return Utility::halfToFloat(Utility::floatToHalf(value));
+	}
+
+	float radicalInverseVdC(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10f;
+	}
+
+	// Hammersley points and the sin/cos of their azimuth, which does not depend on the roughness
+	struct Hammersley
+	{
+		explicit Hammersley(unsigned int count)
+			: u1(count), u2(count), cosPhi(count), sinPhi(count)
+		{
+			const float invCount = 1.0f / float(count);
+			for (unsigned int i = 0; i < count; i++)
+			{
+				u1[i] = float(i) * invCount;
+				u2[i] = radicalInverseVdC(i);
+				cosPhi[i] = std::cos(TwoPi * u1[i]);
+				sinPhi[i] = std::sin(TwoPi * u1[i]);
+			}
+		}
+
+		std::vector<float> u1, u2, cosPhi, sinPhi;
+	};
+
+	// tangent space directions with their weight and mip level, structure of arrays so the per texel
+	// loops over them vectorize
+	struct SampleTable
+	{
+		void push(const glm::vec3& direction, float w, float l)
+		{
+			x.push_back(direction.x);
+			y.push_back(direction.y);
+			z.push_back(direction.z);
+			weight.push_back(w);
+			lod.push_back(l);
+		}
+
+		std::size_t size() const { return x.size(); }
+
+		std::vector<float> x, y, z, weight, lod;
+	};
+
+	// GGX half vectors in tangent space: cosTheta of the whole set in one pass
+	void sampleGGX(const Hammersley& points, float roughness, std::vector<float>& hx, std::vector<float>& hy, std::vector<float>& hz)
+	{
+		const std::size_t count = points.u1.size();
+		hx.resize(count);
+		hy.resize(count);
+		hz.resize(count);
+		const float alpha = roughness * roughness;
+		const float alphaSqMinusOne = alpha * alpha - 1.0f;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			const float u2 = points.u2[i];
+			const float cosTheta = std::sqrt((1.0f - u2) / (1.0f + alphaSqMinusOne * u2));
+			const float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+			hx[i] = sinTheta * points.cosPhi[i];
+			hy[i] = sinTheta * points.sinPhi[i];
+			hz[i] = cosTheta;
+		}
+	}
+
+	float ndfGGX(float cosLh, float roughness)
+	{
+		const float alpha = roughness * roughness;
+		const float alphaSq = alpha * alpha;
+		const float denom = (cosLh * cosLh) * (alphaSq - 1.0f) + 1.0f;
+		return alphaSq / (Pi * denom * denom);
+	}
+
+	float gaSchlickG1(float cosTheta, float k)
+	{
+		return cosTheta / (cosTheta * (1.0f - k) + k);
+	}
+
+	// getSamplingVector() of the shaders, texel corners rather than centers as there
+	glm::vec3 samplingVector(int face, int x, int y, int size)
+	{
+		const float u = 2.0f * float(x) / float(size) - 1.0f;
+		const float v = 1.0f - 2.0f * float(y) / float(size);
+		glm::vec3 direction;
+		switch (face)
+		{
+		case 0:  direction = glm::vec3{ 1.0f, v, -u }; break;
+		case 1:  direction = glm::vec3{ -1.0f, v, u }; break;
+		case 2:  direction = glm::vec3{ u, 1.0f, -v }; break;
+		case 3:  direction = glm::vec3{ u, -1.0f, v }; break;
+		case 4:  direction = glm::vec3{ u, v, 1.0f }; break;
+		default: direction = glm::vec3{ -u, v, -1.0f }; break;
+		}
+		return glm::normalize(direction);
+	}
+
+	// computeBasisVectors() of the shaders
+	void basisVectors(const glm::vec3& n, glm::vec3& s, glm::vec3& t)
+	{
+		t = glm::cross(n, glm::vec3{ 0.0f, 1.0f, 0.0f });
+		if (glm::dot(t, t) < BasisEpsilon)
+		{
+			t = glm::cross(n, glm::vec3{ 1.0f, 0.0f, 0.0f });
+		}
+		t = glm::normalize(t);
+		s = glm::normalize(glm::cross(n, t));
+	}
+
+	// cube face and [0, 1] coordinates of a direction, OpenGL 4.5 table 8.19
+	int projectToFace(const glm::vec3& d, float& s, float& t)
+	{
+		const glm::vec3 a = glm::abs(d);
+		int face;
+		float sc, tc, ma;
+		if (a.x >= a.y && a.x >= a.z)
+		{
+			face = d.x >= 0.0f ? 0 : 1;
+			ma = a.x;
+			sc = d.x >= 0.0f ? -d.z : d.z;
+			tc = -d.y;
+		}
+		else if (a.y >= a.z)
+		{
+			face = d.y >= 0.0f ? 2 : 3;
+			ma = a.y;
+			sc = d.x;
+			tc = d.y >= 0.0f ? d.z : -d.z;
+		}
+		else
+		{
+			face = d.z >= 0.0f ? 4 : 5;
+			ma = a.z;
+			sc = d.z >= 0.0f ? d.x : -d.x;
+			tc = -d.y;
+		}
+		s = 0.5f * (sc / ma + 1.0f);
+		t = 0.5f * (tc / ma + 1.0f);
+		return face;
+	}
+
+	// inverse of projectToFace for sc, tc in [-1, 1] and beyond
+	glm::vec3 faceDirection(int face, float sc, float tc)
+	{
+		switch (face)
+		{
+		case 0:  return glm::vec3{ 1.0f, -tc, -sc };
+		case 1:  return glm::vec3{ -1.0f, -tc, sc };
+		case 2:  return glm::vec3{ sc, 1.0f, tc };
+		case 3:  return glm::vec3{ sc, -1.0f, -tc };
+		case 4:  return glm::vec3{ sc, -tc, 1.0f };
+		default: return glm::vec3{ -sc, -tc, -1.0f };
+		}
+	}
+
+	// basis of irradiance_sh.glsl
+	void shBasis(const glm::vec3& n, float basis[EnvironmentMaps::SHCoefficients])
+	{
+		basis[0] = 0.282095f;
+		basis[1] = 0.488603f * n.y;
+		basis[2] = 0.488603f * n.z;
+		basis[3] = 0.488603f * n.x;
+		basis[4] = 1.092548f * n.x * n.y;
+		basis[5] = 1.092548f * n.y * n.z;
+		basis[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+		basis[7] = 1.092548f * n.x * n.z;
+		basis[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+	}
+
+	// calls body(face, x0, y0, x1, y1) for the tiles of all faces of a size x size level on the pool
+	template<typename Body> void forEachTile(ThreadPool& pool, int faces, int size, Body&& body)
+	{
+		const int tiles = (size + TileSize - 1) / TileSize;
+		pool.parallelFor(0, std::size_t(faces) * tiles * tiles, 1, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t item = begin; item < end; item++)
+			{
+				const int face = int(item / (std::size_t(tiles) * tiles));
+				const int tile = int(item % (std::size_t(tiles) * tiles));
+				const int x0 = (tile % tiles) * TileSize, y0 = (tile / tiles) * TileSize;
+				body(face, x0, y0, std::min(x0 + TileSize, size), std::min(y0 + TileSize, size));
+			}
+		});
+	}
+
+	void storeTexel(uint16_t* level, int channels, int face, int x, int y, int size, const float* values)
+	{
+		uint16_t* texel = level + ((std::size_t(face) * size + y) * size + x) * channels;
+		for (int c = 0; c < channels; c++)
+		{
+			texel[c] = Utility::floatToHalf(values[c]);
+		}
+	}
+}
+
+IblPrecompute::CubeMap::CubeMap(int size, int levels)
+	: m_size(size)
+	, m_levels(levels)
+{
+	for (int level = 0; level < levels; level++)
+	{
+		m_levels[level].resize(std::size_t(6) * levelSize(level) * levelSize(level) * 3);
+	}
+}
+
+void IblPrecompute::CubeMap::generateMipmaps(ThreadPool& pool)
+{
+	for (int level = 1; level < levels(); level++)
+	{
+		const int size = levelSize(level);
+		pool.parallelFor(0, std::size_t(6) * size, 16, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t row = begin; row < end; row++)
+			{
+				const int face = int(row / size), y = int(row % size);
+				for (int x = 0; x < size; x++)
+				{
+					const float* t00 = texel(level - 1, face, 2 * x, 2 * y);
+					const float* t01 = texel(level - 1, face, 2 * x + 1, 2 * y);
+					const float* t10 = texel(level - 1, face, 2 * x, 2 * y + 1);
+					const float* t11 = texel(level - 1, face, 2 * x + 1, 2 * y + 1);
+					float* result = texel(level, face, x, y);
+					for (int c = 0; c < 3; c++)
+					{
+						result[c] = roundToHalf(0.25f * (t00[c] + t01[c] + t10[c] + t11[c]));
+					}
+				}
+			}
+		});
+	}
+}
+
+glm::vec3 IblPrecompute::CubeMap::fetch(int level, int face, int x, int y) const
+{
+	const int size = levelSize(level);
+	if (x < 0 || y < 0 || x >= size || y >= size)
+	{	// seamless filtering: the texel center continues onto the neighbouring face
+		const glm::vec3 direction = faceDirection(face, 2.0f * (float(x) + 0.5f) / float(size) - 1.0f,
+												  2.0f * (float(y) + 0.5f) / float(size) - 1.0f);
+		float s, t;
+		face = projectToFace(direction, s, t);
+		x = std::clamp(int(s * float(size)), 0, size - 1);
+		y = std::clamp(int(t * float(size)), 0, size - 1);
+	}
+	const float* values = texel(level, face, x, y);
+	return glm::vec3{ values[0], values[1], values[2] };
+}
+
+glm::vec3 IblPrecompute::CubeMap::sampleLevel(const glm::vec3& direction, int level) const
+{
+	float s, t;
+	const int face = projectToFace(direction, s, t);
+	const int size = levelSize(level);
+	const float u = s * float(size) - 0.5f, v = t * float(size) - 0.5f;
+	const float x0 = std::floor(u), y0 = std::floor(v);
+	const float fx = u - x0, fy = v - y0;
+	const int x = int(x0), y = int(y0);
+	return glm::mix(glm::mix(fetch(level, face, x, y), fetch(level, face, x + 1, y), fx),
+					glm::mix(fetch(level, face, x, y + 1), fetch(level, face, x + 1, y + 1), fx), fy);
+}
+
+glm::vec3 IblPrecompute::CubeMap::sample(const glm::vec3& direction, float lod) const
+{
+	lod = std::clamp(lod, 0.0f, float(levels() - 1));
+	const int level = int(lod);
+	const float fraction = lod - float(level);
+	if (fraction <= 0.0f || level + 1 >= levels())
+	{
+		return sampleLevel(direction, level);
+	}
+	return glm::mix(sampleLevel(direction, level), sampleLevel(direction, level + 1), fraction);
+}
+
+IblPrecompute::IblPrecompute(ThreadPool& pool)
+	: m_pool(pool)
+{
+}
+
+template<typename Body> void IblPrecompute::measure(const std::string& name, std::size_t texels, std::size_t samples, Body&& body)
+{
+	const auto start = std::chrono::steady_clock::now();
+	body();
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	m_stats.push_back(StageStats{ name, texels, samples, elapsed.count() });
+}
+
+void IblPrecompute::run(const Image& equirect, const EnvironmentMaps::Parameters& parameters, EnvironmentMaps& maps)
+{
+	CubeMap unfiltered = equirectToCube(equirect, parameters.specularSize);
+	prefilterSpecular(unfiltered, maps, unsigned(parameters.specularSamples));
+	irradianceSH(unfiltered, maps, parameters.irradianceSourceSize);
+	brdfLut(maps);
+}
+
+IblPrecompute::CubeMap IblPrecompute::equirectToCube(const Image& equirect, int size)
+{
+	CubeMap cube{ size, Utility::numMipmapLevels(size, size) };
+	measure("equirect2cube", std::size_t(6) * size * size, std::size_t(6) * size * size, [&]() {
+		const int width = equirect.width(), height = equirect.height(), channels = equirect.channels();
+		const float* pixels = equirect.pixels<float>();
+		// GL_REPEAT in both directions, the source texture is RGB16F
+		auto pixel = [&](int x, int y) {
+			x = ((x % width) + width) % width;
+			y = ((y % height) + height) % height;
+			const float* p = pixels + (std::size_t(y) * width + x) * channels;
+			return glm::vec3{ roundToHalf(p[0]), roundToHalf(p[channels > 1 ? 1 : 0]), roundToHalf(p[channels > 2 ? 2 : 0]) };
+		};
+
+		forEachTile(m_pool, 6, size, [&](int face, int x0, int y0, int x1, int y1) {
+			for (int y = y0; y < y1; y++)
+			{
+				for (int x = x0; x < x1; x++)
+				{
+					const glm::vec3 v = samplingVector(face, x, y, size);
+					const float phi = std::atan2(v.z, v.x);
+					const float theta = std::acos(v.y);
+					const float u = phi / TwoPi * float(width) - 0.5f, w = theta / Pi * float(height) - 0.5f;
+					const float px = std::floor(u), py = std::floor(w);
+					const float fx = u - px, fy = w - py;
+					const int ix = int(px), iy = int(py);
+					const glm::vec3 color = glm::mix(glm::mix(pixel(ix, iy), pixel(ix + 1, iy), fx),
+													 glm::mix(pixel(ix, iy + 1), pixel(ix + 1, iy + 1), fx), fy);
+					float* result = cube.texel(0, face, x, y);
+					result[0] = roundToHalf(color.x);
+					result[1] = roundToHalf(color.y);
+					result[2] = roundToHalf(color.z);
+				}
+			}
+		});
+		cube.generateMipmaps(m_pool);
+	});
+	return cube;
+}
+
+void IblPrecompute::prefilterSpecular(const CubeMap& unfiltered, EnvironmentMaps& maps, unsigned int sampleCount)
+{
+	const Hammersley points{ sampleCount };
+	const int levels = maps.levels(EnvironmentMaps::Specular);
+	const float inputSize = float(unfiltered.size());
+	const float wt = 4.0f * Pi / (6.0f * inputSize * inputSize);
+
+	// level 0 is the unfiltered map
+	for (int face = 0; face < 6; face++)
+	{
+		for (int y = 0; y < unfiltered.size(); y++)
+		{
+			for (int x = 0; x < unfiltered.size(); x++)
+			{
+				const float* texel = unfiltered.texel(0, face, x, y);
+				const float values[4] = { texel[0], texel[1], texel[2], 1.0f };
+				storeTexel(maps.data(EnvironmentMaps::Specular, 0), 4, face, x, y, unfiltered.size(), values);
+			}
+		}
+	}
+
+	// N = V = R, so the direction of the incident light relative to N, its cosine and the mip level
+	// are the same for every texel of a level: only the rotation into the texel basis remains per texel
+	std::vector<SampleTable> tables(levels);
+	std::size_t texels = 0, samples = 0;
+	for (int level = 1; level < levels; level++)
+	{
+		const float roughness = float(level) / float(std::max(levels - 1, 1));
+		std::vector<float> hx, hy, hz;
+		sampleGGX(points, roughness, hx, hy, hz);
+		for (std::size_t i = 0; i < hx.size(); i++)
+		{
+			const float cosLi = 2.0f * hz[i] * hz[i] - 1.0f;
+			if (cosLi > 0.0f)
+			{
+				const float pdf = ndfGGX(std::max(hz[i], 0.0f), roughness) * 0.25f;
+				const float ws = 1.0f / (float(sampleCount) * pdf);
+				const float lod = std::max(0.5f * std::log2(ws / wt) + 1.0f, 0.0f);
+				tables[level].push(glm::vec3{ 2.0f * hz[i] * hx[i], 2.0f * hz[i] * hy[i], cosLi }, cosLi, lod);
+			}
+		}
+		const std::size_t levelTexels = std::size_t(6) * maps.levelSize(EnvironmentMaps::Specular, level) * maps.levelSize(EnvironmentMaps::Specular, level);
+		texels += levelTexels;
+		samples += levelTexels * tables[level].size();
+	}
+
+	measure("spmap", texels, samples, [&]() {
+		for (int level = 1; level < levels; level++)
+		{
+			const SampleTable& table = tables[level];
+			const int size = maps.levelSize(EnvironmentMaps::Specular, level);
+			float totalWeight = 0.0f;
+			for (const float weight : table.weight)
+			{
+				totalWeight += weight;
+			}
+			forEachTile(m_pool, 6, size, [&](int face, int x0, int y0, int x1, int y1) {
+				std::vector<float> lx(table.size()), ly(table.size()), lz(table.size());
+				for (int y = y0; y < y1; y++)
+				{
+					for (int x = x0; x < x1; x++)
+					{
+						const glm::vec3 n = samplingVector(face, x, y, size);
+						glm::vec3 s, t;
+						basisVectors(n, s, t);
+						for (std::size_t i = 0; i < table.size(); i++)
+						{
+							lx[i] = s.x * table.x[i] + t.x * table.y[i] + n.x * table.z[i];
+							ly[i] = s.y * table.x[i] + t.y * table.y[i] + n.y * table.z[i];
+							lz[i] = s.z * table.x[i] + t.z * table.y[i] + n.z * table.z[i];
+						}
+						glm::vec3 color{ 0.0f };
+						for (std::size_t i = 0; i < table.size(); i++)
+						{
+							color += unfiltered.sample(glm::vec3{ lx[i], ly[i], lz[i] }, table.lod[i]) * table.weight[i];
+						}
+						color /= totalWeight;
+						const float values[4] = { color.x, color.y, color.z, 1.0f };
+						storeTexel(maps.data(EnvironmentMaps::Specular, level), 4, face, x, y, size, values);
+					}
+				}
+			});
+		}
+	});
+}
+
+void IblPrecompute::irradianceSH(const CubeMap& unfiltered, EnvironmentMaps& maps, int sourceSize)
+{
+	int level = 0;
+	while (level + 1 < unfiltered.levels() && unfiltered.levelSize(level) > sourceSize)
+	{
+		level++;
+	}
+	const int size = unfiltered.levelSize(level);
+	const std::size_t texels = std::size_t(6) * size * size;
+	measure("irradiance sh", texels, texels, [&]() {
+		// per face sums added in face order, the result does not depend on the thread count
+		std::vector<double> faceSums(std::size_t(6) * EnvironmentMaps::SHFloats, 0.0);
+		m_pool.parallelFor(0, 6, 1, [&](std::size_t begin, std::size_t end) {
+			for (std::size_t face = begin; face < end; face++)
+			{
+				double* sum = &faceSums[face * EnvironmentMaps::SHFloats];
+				for (int y = 0; y < size; y++)
+				{
+					for (int x = 0; x < size; x++)
+					{
+						// texel center, solid angle (2 / size)^2 projected onto the unit sphere
+						const float u = 2.0f * (float(x) + 0.5f) / float(size) - 1.0f;
+						const float v = 1.0f - 2.0f * (float(y) + 0.5f) / float(size);
+						const glm::vec3 n = glm::normalize(faceDirection(int(face), u, -v));
+						const float texelArea = 2.0f / float(size);
+						const double solidAngle = texelArea * texelArea / std::pow(1.0f + u * u + v * v, 1.5f);
+
+						float basis[EnvironmentMaps::SHCoefficients];
+						shBasis(n, basis);
+						const float* radiance = unfiltered.texel(level, int(face), x, y);
+						for (int i = 0; i < EnvironmentMaps::SHCoefficients; i++)
+						{
+							for (int c = 0; c < 3; c++)
+							{
+								sum[4 * i + c] += solidAngle * radiance[c] * basis[i];
+							}
+						}
+					}
+				}
+			}
+		});
+
+		float* coefficients = maps.irradianceSH();
+		for (int i = 0; i < EnvironmentMaps::SHCoefficients; i++)
+		{
+			const double band = (0 == i) ? 1.0 : ((i < 4) ? 2.0 / 3.0 : 0.25);
+			for (int c = 0; c < 4; c++)
+			{
+				double total = 0.0;
+				for (int face = 0; face < 6; face++)
+				{
+					total += faceSums[std::size_t(face) * EnvironmentMaps::SHFloats + 4 * i + c];
+				}
+				coefficients[4 * i + c] = float(total * band);
+			}
+		}
+	});
+}
+
+void IblPrecompute::brdfLut(EnvironmentMaps& maps)
+{
+	const Hammersley points{ BrdfSamples };
+	const int size = maps.levelSize(EnvironmentMaps::BrdfLut, 0);
+	const std::size_t texels = std::size_t(size) * size;
+	measure("spbrdf", texels, texels * BrdfSamples, [&]() {
+		forEachTile(m_pool, 1, size, [&](int, int x0, int y0, int x1, int y1) {
+			std::vector<float> hx, hy, hz;
+			for (int y = y0; y < y1; y++)
+			{
+				// one set of half vectors per row, the roughness varies along y
+				const float roughness = float(y) / float(size);
+				const float k = (roughness * roughness) / 2.0f;
+				sampleGGX(points, roughness, hx, hy, hz);
+				for (int x = x0; x < x1; x++)
+				{
+					const float cosLo = std::max(float(x) / float(size), BrdfEpsilon);
+					const glm::vec3 lo{ std::sqrt(1.0f - cosLo * cosLo), 0.0f, cosLo };
+					float dfg1 = 0.0f, dfg2 = 0.0f;
+					for (unsigned int i = 0; i < BrdfSamples; i++)
+					{
+						const glm::vec3 lh{ hx[i], hy[i], hz[i] };
+						const float loLh = glm::dot(lo, lh);
+						const float cosLi = 2.0f * loLh * lh.z - lo.z;
+						if (cosLi > 0.0f)
+						{
+							const float cosLoLh = std::max(loLh, 0.0f);
+							const float g = gaSchlickG1(cosLi, k) * gaSchlickG1(cosLo, k);
+							const float gv = g * cosLoLh / (lh.z * cosLo);
+							const float fc = std::pow(1.0f - cosLoLh, 5.0f);
+							dfg1 += (1.0f - fc) * gv;
+							dfg2 += fc * gv;
+						}
+					}
+					const float values[2] = { dfg1 / float(BrdfSamples), dfg2 / float(BrdfSamples) };
+					storeTexel(maps.data(EnvironmentMaps::BrdfLut, 0), 2, 0, x, y, size, values);
+				}
+			}
+		});
+	});
+}
@@ -0,0 +1,87 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * CPU reference of the image based lighting precompute: equirect2cube_cs.glsl, spmap_cs.glsl, irradiance_sh_cs.glsl
+ * and spbrdf_cs.glsl evaluated on the thread pool, written into EnvironmentMaps as the renderer reads them back.
+ * Sample counts of the quality tier and constants mirror the shaders, which stay the reference for the cache key.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "environment_maps.hpp"
+
+class Image;
+class ThreadPool;
+
+class IblPrecompute
+{
+public:
+	struct StageStats
+	{
+		std::string name;
+		std::size_t texels;
+		std::size_t samples;		// environment lookups, or BRDF evaluations for the LUT
+		double ms;
+	};
+
+	explicit IblPrecompute(ThreadPool& pool);
+
+	// all four stages into maps created with the same parameters
+	void run(const Image& equirect, const EnvironmentMaps::Parameters& parameters, EnvironmentMaps& maps);
+
+	const std::vector<StageStats>& stats() const { return m_stats; }
+
+	// RGB cube map with a box filtered mip chain; texels are rounded to half precision like the RGBA16F
+	// textures of the GPU path. Faces in GL order, rows from t = 0.
+	class CubeMap
+	{
+	public:
+		CubeMap(int size, int levels);
+
+		int size() const { return m_size; }
+		int levels() const { return static_cast<int>(m_levels.size()); }
+		int levelSize(int level) const { return (m_size >> level) > 0 ? (m_size >> level) : 1; }
+
+		float* texel(int level, int face, int x, int y)
+		{
+			return &m_levels[level][3 * ((std::size_t(face) * levelSize(level) + y) * levelSize(level) + x)];
+		}
+		const float* texel(int level, int face, int x, int y) const
+		{
+			return &m_levels[level][3 * ((std::size_t(face) * levelSize(level) + y) * levelSize(level) + x)];
+		}
+
+		// levels 1 and up from level 0
+		void generateMipmaps(ThreadPool& pool);
+
+		// GL_LINEAR_MIPMAP_LINEAR lookup with seamless filtering across the faces
+		glm::vec3 sample(const glm::vec3& direction, float lod) const;
+		glm::vec3 sampleLevel(const glm::vec3& direction, int level) const;
+
+	private:
+		glm::vec3 fetch(int level, int face, int x, int y) const;
+
+		int m_size;
+		std::vector<std::vector<float>> m_levels;
+	};
+
+private:
+	CubeMap equirectToCube(const Image& equirect, int size);
+	// GGX samples per texel of the quality tier, lower mips of the source by their density
+	void prefilterSpecular(const CubeMap& unfiltered, EnvironmentMaps& maps, unsigned int sampleCount);
+	// projection of the box filtered level of sourceSize, or the smallest level above it
+	void irradianceSH(const CubeMap& unfiltered, EnvironmentMaps& maps, int sourceSize);
+	void brdfLut(EnvironmentMaps& maps);
+
+	template<typename Body> void measure(const std::string& name, std::size_t texels, std::size_t samples, Body&& body);
+
+	ThreadPool& m_pool;
+	std::vector<StageStats> m_stats;
+};
@@ -3,12 +3,61 @@
  * Forked from Michał Siejak PBR project
  */
 
+#include <algorithm>
 #include <stdexcept>
+#include <cstdint>
+#include <fstream>
+#include <vector>
 #include <stb_image.h>
 
 #include "image.hpp"
 #include <iostream>
 
+namespace {
+	uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0)
+	{
+		static const std::vector<uint32_t> table = []()
+		{
+			std::vector<uint32_t> values(256);
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+				{
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				}
+				values[n] = c;
+			}
+			return values;
+		}();
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	void appendBigEndian(std::vector<unsigned char>& buffer, uint32_t value)
+	{
+		buffer.push_back(static_cast<unsigned char>(value >> 24));
+		buffer.push_back(static_cast<unsigned char>(value >> 16));
+		buffer.push_back(static_cast<unsigned char>(value >> 8));
+		buffer.push_back(static_cast<unsigned char>(value));
+	}
+
+	void writeChunk(std::ofstream& file, const char* type, const std::vector<unsigned char>& data)
+	{
+		std::vector<unsigned char> chunk;
+		appendBigEndian(chunk, static_cast<uint32_t>(data.size()));
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), data.begin(), data.end());
+		appendBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+		file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+	}
+}
+
 Image::Image()
 	: m_width(0)
 	, m_height(0)
@@ -60,3 +109,59 @@ std::shared_ptr<Image> Image::fromFile(const std::string& filename, int channels
 	}
 	return image;
 }
+
+bool Image::writePng(const std::string& filename, int width, int height, int channels, const unsigned char* pixels)
+{
+	static const unsigned char colorTypes[] = { 0, 4, 2, 6 };	// gray, gray + alpha, RGB, RGBA
+	if (width <= 0 || height <= 0 || channels < 1 || channels > 4)
+	{
+		return false;
+	}
+	std::ofstream file{filename, std::ios::binary | std::ios::trunc};
+	if (!file.is_open())
+	{
+		return false;
+	}
+	static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	std::vector<unsigned char> header;
+	appendBigEndian(header, static_cast<uint32_t>(width));
+	appendBigEndian(header, static_cast<uint32_t>(height));
+	header.insert(header.end(), { 8, colorTypes[channels - 1], 0, 0, 0 });	// bit depth, color type, deflate, no filter, no interlace
+	writeChunk(file, "IHDR", header);
+
+	// scanlines with filter type 0, wrapped into stored deflate blocks of a zlib stream
+	const size_t rowSize = size_t(width) * channels;
+	std::vector<unsigned char> scanlines;
+	scanlines.reserve((rowSize + 1) * height);
+	for (int y = 0; y < height; y++)
+	{
+		scanlines.push_back(0);
+		scanlines.insert(scanlines.end(), pixels + y * rowSize, pixels + (y + 1) * rowSize);
+	}
+
+	std::vector<unsigned char> stream = { 0x78, 0x01 };
+	const size_t MaxBlockSize = 65535;
+	for (size_t offset = 0; offset < scanlines.size(); offset += MaxBlockSize)
+	{
+		const size_t blockSize = std::min(MaxBlockSize, scanlines.size() - offset);
+		stream.push_back((offset + blockSize == scanlines.size()) ? 1 : 0);
+		stream.push_back(static_cast<unsigned char>(blockSize));
+		stream.push_back(static_cast<unsigned char>(blockSize >> 8));
+		stream.push_back(static_cast<unsigned char>(~blockSize));
+		stream.push_back(static_cast<unsigned char>(~blockSize >> 8));
+		stream.insert(stream.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+	}
+	uint32_t adlerA = 1, adlerB = 0;
+	for (unsigned char value : scanlines)
+	{
+		adlerA = (adlerA + value) % 65521;
+		adlerB = (adlerB + adlerA) % 65521;
+	}
+	appendBigEndian(stream, (adlerB << 16) | adlerA);
+	writeChunk(file, "IDAT", stream);
+	writeChunk(file, "IEND", {});
+
+	return file.good();
+}
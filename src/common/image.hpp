@@ -15,6 +15,8 @@ public:
 	~Image();
 
 	static std::shared_ptr<Image> fromFile(const std::string& filename, int channels = 4);
+	// 8 bit PNG (channels 1 - 4), rows from the top; pixel data is stored without compression
+	static bool writePng(const std::string& filename, int width, int height, int channels, const unsigned char* pixels);
 
 	int width() const { return m_width; }
 	int height() const { return m_height; }
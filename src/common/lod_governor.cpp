@@ -0,0 +1,62 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "lod_governor.hpp"
+
+void LodGovernor::setBudget(double budgetMs)
+{
+	m_budget.setBudget(budgetMs);
+	if (!m_budget.enabled())
+	{
+		setLevel(0);
+	}
+}
+
+bool LodGovernor::update(double gpuMs, bool mayRaise)
+{
+	int level = m_level;
+	switch (m_budget.update(gpuMs, true, mayRaise))
+	{
+	case FrameBudget::Action::Lower:	level = std::min(m_level + 1, NumLevels - 1); break;
+	case FrameBudget::Action::Raise:	level = std::max(m_level - 1, 0); break;
+	default:							break;
+	}
+	if (level == m_level)
+	{
+		return false;
+	}
+	setLevel(level);
+	m_budget.changed();
+	return true;
+}
+
+std::string LodGovernor::describe() const
+{
+	std::ostringstream stream;
+	stream << "LOD level " << m_level << ": edge " << m_settings.maxEdgeLength << " px, tess " << m_settings.maxTessLevel
+		   << ", noise bias " << m_settings.noiseLevelBias << " (GPU " << m_budget.smoothedMs() << " ms of " << m_budget.budget() << " ms)";
+	return stream.str();
+}
+
+LodGovernor::Settings LodGovernor::settingsForLevel(int level)
+{
+	// from the shader defaults at level 0 to 3x longer edges, a third of the tessellation and 4 noise levels less
+	const float t = float(std::clamp(level, 0, NumLevels - 1)) / float(NumLevels - 1);
+	Settings settings;
+	settings.maxEdgeLength = 12.0f * (1.0f + 2.0f * t);
+	settings.maxTessLevel = int(std::lround(18.0f - 12.0f * t));
+	settings.noiseLevelBias = -4.0f * t;
+	return settings;
+}
+
+void LodGovernor::setLevel(int level)
+{
+	m_level = level;
+	m_settings = settingsForLevel(level);
+}
@@ -0,0 +1,55 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Closed loop control of asteroid tessellation and noise detail by measured GPU frame time.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "frame_budget.hpp"
+
+class LodGovernor
+{
+public:
+	// level 0 is full quality, every level up coarsens tessellation and drops noise detail
+	static constexpr int NumLevels = 9;
+
+	struct Settings
+	{
+		float maxEdgeLength = 12.0f;	// screen space length of a tessellated edge in pixels
+		int maxTessLevel = 18;			// cap of the patch tessellation levels
+		float noiseLevelBias = 0.0f;	// added to the noise levels evaluated per fragment
+	};
+
+	// budgetMs <= 0 keeps full quality
+	void setBudget(double budgetMs);
+	double budget() const { return m_budget.budget(); }
+	bool enabled() const { return m_budget.enabled(); }
+	// no level change is cooling down
+	bool settled() const { return m_budget.settled(); }
+
+	// GPU time of a finished frame, frames arrive a few frames late; returns true when the settings changed.
+	// mayRaise false holds the level while another controller is first to take the spare time
+	bool update(double gpuMs, bool mayRaise = true);
+
+	int level() const { return m_level; }
+	bool atCoarsestLevel() const { return NumLevels - 1 == m_level; }
+	const Settings& settings() const { return m_settings; }
+	// current level, settings and smoothed GPU time in one line
+	std::string describe() const;
+
+	static Settings settingsForLevel(int level);
+
+private:
+	// quality drops one level when the smoothed time stays above the budget and rises only when it stays clearly below it
+	static constexpr FrameBudget::Bands Bands { 1.05, 0.8, 8, 45, 20 };
+
+	void setLevel(int level);
+
+	FrameBudget m_budget { Bands };
+	int m_level = 0;
+	Settings m_settings;
+};
@@ -4,21 +4,211 @@
  */
 
 #include <cstdio>
+#include <cstdlib>
 #include <string>
 #include <memory>
 #include <vector>
 
 #include "application.hpp"
+#include "utils.hpp"
 
 #include "../opengl.hpp"
 
-int main(int /*argc*/, char* /*argv*/[])
+namespace {
+	void printUsage(const char* program)
+	{
+		std::cerr << "Usage: " << program << " [--headless] [--frames N] [--size WxH] [--out dir/] [--surface-map N] [--report file.csv|file.json] [--asteroids N] [--depth-prepass] [--noise-levels N] [--no-craters] [--gpu-budget MS] [--dynamic-resolution MS] [--taa] [--auto-exposure] [--ibl-quality low|medium|high|reference]" << std::endl
+				  << "  --headless, --frames, --size and --out render offscreen without a window" << std::endl
+				  << "  --surface-map sets the power of two resolution of the baked first noise levels, 512 by default" << std::endl
+				  << "  --report writes per frame CPU and GPU times of render stages" << std::endl
+				  << "  --asteroids draws N asteroids, the scene asteroid and a field around it" << std::endl
+				  << "  --depth-prepass lays down depth before shading the asteroids (F4 toggles it at runtime)" << std::endl
+				  << "  --noise-levels and --no-craters limit the surface detail evaluated per pixel" << std::endl
+				  << "  --gpu-budget lowers tessellation and noise detail to keep the GPU frame time within MS" << std::endl
+				  << "  --dynamic-resolution scales the rendered resolution between 50% and 100% to keep the GPU frame time within MS" << std::endl
+				  << "  --taa renders single sampled with temporal anti-aliasing instead of MSAA (F5 toggles it at runtime)" << std::endl
+				  << "  --auto-exposure adapts the exposure to the scene luminance measured on the GPU (F6 toggles it at runtime)" << std::endl
+				  << "  --ibl-quality sets size, samples and mip levels of the precomputed specular map, high by default (F7 cycles it at runtime)" << std::endl;
+	}
+
+	bool parsePositive(const std::string& text, int& value)
+	{
+		char* end = nullptr;
+		const long parsed = std::strtol(text.c_str(), &end, 10);
+		if (end == text.c_str() || *end != '\0' || parsed <= 0 || parsed > 65536)
+		{
+			return false;
+		}
+		value = int(parsed);
+		return true;
+	}
+
+	bool parsePositive(const std::string& text, double& value)
+	{
+		char* end = nullptr;
+		const double parsed = std::strtod(text.c_str(), &end);
+		if (end == text.c_str() || *end != '\0' || !(parsed > 0.0))
+		{
+			return false;
+		}
+		value = parsed;
+		return true;
+	}
+
+	bool parseArguments(int argc, char* argv[], bool& headless, Application::HeadlessOptions& options, int& surfaceMapResolution, std::string& report, int& asteroids, bool& depthPrePass,
+						int& noiseLevels, bool& craters, double& gpuBudget, double& resolutionBudget, bool& temporalAA, bool& autoExposure,
+						EnvironmentMaps::Quality& environmentQuality)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--headless")
+			{
+				headless = true;
+			}
+			else if (arg == "--frames" && hasValue)
+			{
+				headless = true;
+				if (!parsePositive(argv[++i], options.frames))
+				{
+					return false;
+				}
+			}
+			else if (arg == "--size" && hasValue)
+			{
+				headless = true;
+				const std::string size = argv[++i];
+				const size_t separator = size.find('x');
+				if (std::string::npos == separator
+					|| !parsePositive(size.substr(0, separator), options.width)
+					|| !parsePositive(size.substr(separator + 1), options.height))
+				{
+					return false;
+				}
+			}
+			else if (arg == "--out" && hasValue)
+			{
+				headless = true;
+				options.outputDirectory = argv[++i];
+			}
+			else if (arg == "--surface-map" && hasValue)
+			{
+				if (!parsePositive(argv[++i], surfaceMapResolution) || !Utility::isPowerOfTwo(surfaceMapResolution))
+				{
+					return false;
+				}
+			}
+			else if (arg == "--report" && hasValue)
+			{
+				report = argv[++i];
+			}
+			else if (arg == "--depth-prepass")
+			{
+				depthPrePass = true;
+			}
+			else if (arg == "--asteroids" && hasValue)
+			{
+				if (!parsePositive(argv[++i], asteroids))
+				{
+					return false;
+				}
+			}
+			else if (arg == "--noise-levels" && hasValue)
+			{
+				if (!parsePositive(argv[++i], noiseLevels))
+				{
+					return false;
+				}
+			}
+			else if (arg == "--no-craters")
+			{
+				craters = false;
+			}
+			else if (arg == "--gpu-budget" && hasValue)
+			{
+				if (!parsePositive(argv[++i], gpuBudget))
+				{
+					return false;
+				}
+			}
+			else if (arg == "--taa")
+			{
+				temporalAA = true;
+			}
+			else if (arg == "--auto-exposure")
+			{
+				autoExposure = true;
+			}
+			else if (arg == "--dynamic-resolution" && hasValue)
+			{
+				if (!parsePositive(argv[++i], resolutionBudget))
+				{
+					return false;
+				}
+			}
+			else if (arg == "--ibl-quality" && hasValue)
+			{
+				if (!EnvironmentMaps::parseQuality(argv[++i], environmentQuality))
+				{
+					return false;
+				}
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
 {
+	bool headless = false;
+	Application::HeadlessOptions headlessOptions;
+	int surfaceMapResolution = 512;
+	std::string frameReport;
+	int asteroidCount = 1;
+	bool depthPrePass = false;
+	int noiseLevels = 0;
+	bool craters = true;
+	double gpuBudget = 0.0;
+	double resolutionBudget = 0.0;
+	bool temporalAA = false;
+	bool autoExposure = false;
+	EnvironmentMaps::Quality environmentQuality = EnvironmentMaps::Quality::High;
+	if (!parseArguments(argc, argv, headless, headlessOptions, surfaceMapResolution, frameReport, asteroidCount, depthPrePass, noiseLevels, craters, gpuBudget, resolutionBudget, temporalAA, autoExposure,
+						environmentQuality))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
 	RendererInterface* renderer = new OpenGL::Renderer;
 
 	try
 	{
-		Application().run(std::unique_ptr<RendererInterface>{ renderer });
+		Application application;
+		application.setSurfaceMapResolution(surfaceMapResolution);
+		application.setFrameReport(frameReport);
+		application.setAsteroidCount(asteroidCount);
+		application.setDepthPrePass(depthPrePass);
+		application.setNoiseLevels(noiseLevels);
+		application.setCraters(craters);
+		application.setGpuBudget(gpuBudget);
+		application.setResolutionBudget(resolutionBudget);
+		application.setTemporalAA(temporalAA);
+		application.setAutoExposure(autoExposure);
+		application.setEnvironmentQuality(environmentQuality);
+		if (headless)
+		{
+			application.runHeadless(std::unique_ptr<RendererInterface>{ renderer }, headlessOptions);
+		}
+		else
+		{
+			application.run(std::unique_ptr<RendererInterface>{ renderer });
+		}
 	}
 	catch(const std::exception& e)
 	{
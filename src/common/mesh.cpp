@@ -12,6 +12,7 @@
 
 
 #include <iostream>
+#include <mutex>
 
 namespace
 {
@@ -29,13 +30,18 @@ namespace
 
 struct LogStream : public Assimp::LogStream
 {
+	// meshes may be imported on several threads at once
 	static void initialize()
 	{
-		if (Assimp::DefaultLogger::isNullLogger())
+		static std::once_flag once;
+		std::call_once(once, []()
 		{
-			Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
-			Assimp::DefaultLogger::get()->attachStream(new LogStream, Assimp::Logger::Err | Assimp::Logger::Warn);
-		}
+			if (Assimp::DefaultLogger::isNullLogger())
+			{
+				Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
+				Assimp::DefaultLogger::get()->attachStream(new LogStream, Assimp::Logger::Err | Assimp::Logger::Warn);
+			}
+		});
 	}
 	
 	void write(const char* message) override
@@ -6,7 +6,11 @@
 #pragma once
 #include <glm/mat4x4.hpp>
 #include <functional>
+#include <string>
 #include <unordered_set>
+#include <vector>
+
+#include "environment_maps.hpp"
 
 struct GLFWwindow;
 
@@ -25,6 +29,24 @@ struct SceneSettings
 {
 	float pitch = 0.0f;
 	float yaw = 0.0f;
+	// scene asteroid plus instances of the field around it
+	int asteroidCount = 1;
+	// depth only pass before the opaque pass, shading runs once per visible pixel
+	bool depthPrePass = false;
+	// asteroid shading quality, each combination selects a specialized program: noise levels
+	// evaluated per fragment (0 for all of them) and craters on those levels
+	int noiseLevels = 0;
+	bool craters = true;
+	// GPU time per frame the tessellation and noise detail are adjusted to, 0 keeps full detail
+	double gpuBudgetMs = 0.0;
+	// GPU time per frame the render scale is adjusted to, 0 renders at the output size
+	double resolutionBudgetMs = 0.0;
+	// single sampled rendering with temporal anti-aliasing instead of MSAA
+	bool temporalAA = false;
+	// exposure of the tone mapping measured from the scene luminance instead of the fixed one
+	bool autoExposure = false;
+	// size, samples and mip levels of the precomputed specular map; a change rebuilds the environment
+	EnvironmentMaps::Quality environmentQuality = EnvironmentMaps::Quality::High;
 
 	static const int NumLights = 3;
 	struct Light {
@@ -32,6 +54,9 @@ struct SceneSettings
 		glm::vec3 radiance;
 		bool enabled = false;
 	} lights[NumLights];
+	// texels per cube face edge of the baked first noise levels, a power of two; read by setup(),
+	// every resolution has its own cache file
+	int surfaceMapResolution = 512;
 };
 
 class RendererInterface
@@ -40,7 +65,17 @@ public:
 	virtual ~RendererInterface() = default;
 
 	virtual GLFWwindow* initialize(int width, int height, int maxSamples) = 0;
+	// offscreen context without a window, render() is then called with a null window;
+	// returns false when the build or the system provides no headless context
+	virtual bool initializeHeadless(int width, int height, int maxSamples) = 0;
 	virtual void shutdown() = 0;
-	virtual std::function<void (int w, int h)> setup() = 0;
+	// loads the assets, the environment maps of the scene quality tier
+	virtual std::function<void (int w, int h)> setup(const SceneSettings& scene) = 0;
 	virtual void render(GLFWwindow* window, const ViewSettings& view, const SceneSettings& scene) = 0;
+	// blocks until all submitted rendering is done
+	virtual void finish() = 0;
+	// tonemapped RGBA8 pixels of the last headless frame, rows from the top
+	virtual void readFrame(std::vector<unsigned char>& pixels, int& width, int& height) = 0;
+	// per frame CPU/GPU timings of render stages, written as CSV or JSON lines (".json")
+	virtual bool openFrameReport(const std::string& filename) = 0;
 };
@@ -0,0 +1,278 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "shader_preprocessor.hpp"
+
+namespace {
+	std::string normalPath(const std::string& path)
+	{
+		return std::filesystem::path(path).lexically_normal().generic_string();
+	}
+
+	// directive name of a line starting with '#' after optional white space, position after the name in end
+	std::string directiveName(const std::string& line, std::size_t& end)
+	{
+		std::size_t begin = line.find_first_not_of(" \t");
+		if (std::string::npos == begin || '#' != line[begin])
+		{
+			return std::string();
+		}
+		begin = line.find_first_not_of(" \t", begin + 1);
+		if (std::string::npos == begin)
+		{
+			return std::string();
+		}
+		end = line.find_first_of(" \t\r\n", begin);
+		end = (std::string::npos == end) ? line.size() : end;
+		return line.substr(begin, end - begin);
+	}
+
+	// block comment state at the end of line given the state at its start
+	bool endsInBlockComment(const std::string& line, bool inBlockComment)
+	{
+		for (std::size_t i = 0; i + 1 < line.size(); i++)
+		{
+			if (inBlockComment)
+			{
+				if ('*' == line[i] && '/' == line[i + 1])
+				{
+					inBlockComment = false;
+					i++;
+				}
+			}
+			else if ('/' == line[i] && '/' == line[i + 1])
+			{
+				break;
+			}
+			else if ('/' == line[i] && '*' == line[i + 1])
+			{
+				inBlockComment = true;
+				i++;
+			}
+		}
+		return inBlockComment;
+	}
+}
+
+ShaderPreprocessor& ShaderPreprocessor::instance()
+{
+	static ShaderPreprocessor preprocessor;
+	return preprocessor;
+}
+
+std::string ShaderPreprocessor::process(const std::string& filename, const std::vector<std::string>& defines)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::string output;
+	std::set<int> included;
+	bool versionDone = false;
+	expand(normalPath(filename), defines, 0, included, versionDone, output);
+	if (!versionDone && !defines.empty())
+	{
+		output = addDefines(output, defines);
+	}
+	return output;
+}
+
+std::string ShaderPreprocessor::addDefines(const std::string& source, const std::vector<std::string>& defines)
+{
+	std::string lines;
+	for (const std::string& define : defines)
+	{
+		lines += "#define " + define + "\n";
+	}
+	const std::size_t version = source.find("#version");
+	const std::size_t versionEnd = (std::string::npos == version) ? std::string::npos : source.find('\n', version);
+	if (std::string::npos == versionEnd)
+	{
+		return lines + source;
+	}
+	return source.substr(0, versionEnd + 1) + lines + source.substr(versionEnd + 1);
+}
+
+uint64_t ShaderPreprocessor::hash(const void* data, std::size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (std::size_t i = 0; i < size; i++)
+	{
+		seed = (seed ^ bytes[i]) * 1099511628211ull;
+	}
+	return seed;
+}
+
+std::string ShaderPreprocessor::fileName(int number) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return (number >= 0 && number < static_cast<int>(m_fileNames.size())) ? m_fileNames[number] : std::string();
+}
+
+std::string ShaderPreprocessor::sourceNumbers() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::string numbers;
+	for (std::size_t i = 0; i < m_fileNames.size(); i++)
+	{
+		numbers += std::to_string(i) + ": " + m_fileNames[i] + "\n";
+	}
+	return numbers;
+}
+
+void ShaderPreprocessor::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_files.clear();
+	m_fileNames.clear();
+}
+
+std::shared_ptr<const ShaderPreprocessor::File> ShaderPreprocessor::load(const std::string& filename)
+{
+	std::error_code error;
+	const std::filesystem::file_time_type time = std::filesystem::last_write_time(filename, error);
+	auto cached = m_files.find(filename);
+	if (m_files.end() != cached && !error && cached->second->time == time)
+	{
+		return cached->second;
+	}
+
+	std::ifstream stream{ filename, std::ios::binary };
+	std::stringstream contents;
+	if (!stream.is_open() || !(contents << stream.rdbuf()))
+	{
+		std::cout << "ERROR: ShaderPreprocessor: read failed (" << filename << ")" << std::endl;
+		return nullptr;
+	}
+
+	auto file = std::make_shared<File>();
+	if (m_files.end() != cached)
+	{
+		file->number = cached->second->number;
+	}
+	else
+	{
+		file->number = static_cast<int>(m_fileNames.size());
+		m_fileNames.push_back(filename);
+	}
+	file->time = time;
+	file->segments = parse(filename, contents.str(), file->once);
+	m_files[filename] = file;
+	return file;
+}
+
+std::vector<ShaderPreprocessor::Segment> ShaderPreprocessor::parse(const std::string& filename, const std::string& contents, bool& once)
+{
+	const std::size_t slash = filename.find_last_of('/');
+	const std::string directory = (std::string::npos == slash) ? std::string() : filename.substr(0, slash + 1);
+
+	std::vector<Segment> segments;
+	bool inBlockComment = false;
+	std::size_t lineBegin = 0;
+	for (int lineNumber = 1; lineBegin < contents.size(); lineNumber++)
+	{
+		std::size_t lineEnd = contents.find('\n', lineBegin);
+		lineEnd = (std::string::npos == lineEnd) ? contents.size() : lineEnd + 1;
+		const std::string line = contents.substr(lineBegin, lineEnd - lineBegin);
+		lineBegin = lineEnd;
+
+		std::size_t nameEnd = 0;
+		const std::string directive = inBlockComment ? std::string() : directiveName(line, nameEnd);
+		inBlockComment = endsInBlockComment(line, inBlockComment);
+		if ("include" == directive)
+		{
+			const std::size_t quote1 = line.find_first_not_of(" \t", nameEnd);
+			const std::size_t quote2 = (std::string::npos == quote1) ? std::string::npos : line.find_first_of("'\"", quote1 + 1);
+			if (std::string::npos != quote2 && ('"' == line[quote1] || '\'' == line[quote1]))
+			{
+				segments.push_back(Segment{ Segment::Type::Include, normalPath(directory + line.substr(quote1 + 1, quote2 - quote1 - 1)), lineNumber });
+				continue;
+			}
+			// left in the source, so the compiler reports it at the right line
+			std::cout << "ERROR: expecting file name after #include (" << filename << ":" << lineNumber << ")" << std::endl;
+		}
+		else if ("pragma" == directive)
+		{
+			std::size_t argumentEnd = 0;
+			if ("once" == directiveName("#" + line.substr(nameEnd), argumentEnd))
+			{
+				once = true;
+				continue;
+			}
+		}
+		else if ("version" == directive)
+		{
+			segments.push_back(Segment{ Segment::Type::Version, line, lineNumber });
+			if ('\n' != segments.back().text.back())
+			{
+				segments.back().text += '\n';
+			}
+			continue;
+		}
+
+		if (segments.empty() || Segment::Type::Text != segments.back().type)
+		{
+			segments.push_back(Segment{ Segment::Type::Text, std::string(), lineNumber });
+		}
+		segments.back().text += line;
+	}
+	return segments;
+}
+
+void ShaderPreprocessor::expand(const std::string& filename, const std::vector<std::string>& defines, int depth,
+								std::set<int>& included, bool& versionDone, std::string& output)
+{
+	if (depth > MaxIncludeDepth)
+	{
+		std::cout << "ERROR: ShaderPreprocessor: includes nested too deep (" << filename << "), missing #pragma once?" << std::endl;
+		return;
+	}
+	const std::shared_ptr<const File> file = load(filename);
+	if (nullptr == file)
+	{
+		return;
+	}
+	if (!included.insert(file->number).second && file->once)
+	{
+		return;
+	}
+
+	// #line may not precede #version
+	bool hasVersion = false;
+	for (const Segment& segment : file->segments)
+	{
+		hasVersion = hasVersion || Segment::Type::Version == segment.type;
+	}
+
+	for (const Segment& segment : file->segments)
+	{
+		switch (segment.type)
+		{
+		case Segment::Type::Text:
+			if (depth > 0 || versionDone || !hasVersion)
+			{
+				output += "#line " + std::to_string(segment.line) + " " + std::to_string(file->number) + "\n";
+			}
+			output += segment.text;
+			break;
+		case Segment::Type::Include:
+			expand(segment.text, {}, depth + 1, included, versionDone, output);
+			break;
+		case Segment::Type::Version:
+			output += segment.text;
+			for (const std::string& define : defines)
+			{
+				output += "#define " + define + "\n";
+			}
+			versionDone = true;
+			break;
+		}
+	}
+	if (!output.empty() && '\n' != output.back())
+	{
+		output += '\n';
+	}
+}
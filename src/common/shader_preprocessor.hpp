@@ -0,0 +1,77 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * GLSL #include expansion with in-memory file cache, #pragma once, #line mapping and injected defines.
+ * No GL calls, the output is passed to glShaderSource as it is.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ShaderPreprocessor
+{
+public:
+	static constexpr uint64_t HashSeed = 14695981039346656037ull;
+
+	// preprocessor used to load the shaders of the application
+	static ShaderPreprocessor& instance();
+
+	// Source of filename with includes expanded; includes are resolved relative to the including file.
+	// Every file gets a source string number and every expanded part starts with "#line line number",
+	// so compile errors point into the original files (see fileName). Defines ("NAME" or "NAME VALUE")
+	// are placed after the #version line.
+	std::string process(const std::string& filename, const std::vector<std::string>& defines = {});
+
+	// #define lines placed after the #version line of source
+	static std::string addDefines(const std::string& source, const std::vector<std::string>& defines);
+
+	// FNV-1a of the final source, stable between runs and platforms; seed chains several sources
+	static uint64_t hash(const void* data, std::size_t size, uint64_t seed = HashSeed);
+	static uint64_t hash(const std::string& source, uint64_t seed = HashSeed) { return hash(source.data(), source.size(), seed); }
+
+	// file of a source string number used in #line directives, empty when unknown
+	std::string fileName(int number) const;
+	// "number: file" lines of all files seen so far, printed with compile errors
+	std::string sourceNumbers() const;
+
+	// files are read again when their modification time changes, clear drops everything
+	void clear();
+
+private:
+	struct Segment
+	{
+		enum class Type { Text, Include, Version };
+		Type type;
+		std::string text;		// lines with their line ends, the #version line or the include path
+		int line;				// line of the segment in its file, 1 based
+	};
+
+	struct File
+	{
+		int number;
+		std::filesystem::file_time_type time;
+		bool once = false;
+		std::vector<Segment> segments;
+	};
+
+	std::shared_ptr<const File> load(const std::string& filename);
+	static std::vector<Segment> parse(const std::string& filename, const std::string& contents, bool& once);
+	void expand(const std::string& filename, const std::vector<std::string>& defines, int depth,
+				std::set<int>& included, bool& versionDone, std::string& output);
+
+	static constexpr int MaxIncludeDepth = 32;
+
+	std::unordered_map<std::string, std::shared_ptr<const File>> m_files;
+	std::vector<std::string> m_fileNames;		// by source string number
+	mutable std::mutex m_mutex;
+};
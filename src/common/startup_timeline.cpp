@@ -0,0 +1,56 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+
+#include "startup_timeline.hpp"
+
+StartupTimeline::StartupTimeline()
+	: m_origin(Clock::now())
+	, m_mainThread(std::this_thread::get_id())
+{
+}
+
+void StartupTimeline::add(const std::string& name, Clock::time_point start, Clock::time_point end)
+{
+	const std::chrono::duration<double, std::milli> startMs = start - m_origin;
+	const std::chrono::duration<double, std::milli> endMs = end - m_origin;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.push_back(Entry{ name, std::this_thread::get_id(), startMs.count(), endMs.count() });
+}
+
+void StartupTimeline::print(std::ostream& stream) const
+{
+	std::vector<Entry> entries;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		entries = m_entries;
+	}
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.startMs < b.startMs; });
+
+	// workers are numbered in order of their first job
+	std::map<std::thread::id, int> workers;
+	double serialMs = 0.0;
+	double wallMs = 0.0;
+	stream << "Startup timeline (ms):" << std::endl;
+	for (const Entry& entry : entries)
+	{
+		std::string thread = "gl";
+		if (entry.thread != m_mainThread)
+		{
+			const int worker = workers.emplace(entry.thread, static_cast<int>(workers.size())).first->second;
+			thread = "worker " + std::to_string(worker);
+		}
+		stream << std::fixed << std::setprecision(1)
+			   << std::setw(8) << entry.startMs << " - " << std::setw(8) << entry.endMs
+			   << "  " << std::left << std::setw(10) << thread << std::right << entry.name << std::endl;
+		serialMs += entry.endMs - entry.startMs;
+		wallMs = std::max(wallMs, entry.endMs);
+	}
+	stream << std::fixed << std::setprecision(1) << "Startup: " << wallMs << " ms, " << serialMs << " ms of jobs" << std::endl;
+	stream.unsetf(std::ios_base::floatfield);
+}
@@ -0,0 +1,56 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * Start and end of startup jobs on the GL thread and the worker pool, printed once the first frame can be drawn.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class StartupTimeline
+{
+public:
+	StartupTimeline();
+
+	// runs job on the calling thread and records it, safe to call from any thread
+	template<typename Job> auto measure(const std::string& name, Job&& job) -> decltype(job())
+	{
+		const Clock::time_point start = Clock::now();
+		struct Record
+		{
+			StartupTimeline& timeline;
+			const std::string& name;
+			Clock::time_point start;
+			~Record() { timeline.add(name, start, Clock::now()); }
+		} record{ *this, name, start };
+		return job();
+	}
+
+	// entries sorted by start, the wall time and the sum of all jobs, which is what a serial startup takes
+	void print(std::ostream& stream) const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Entry
+	{
+		std::string name;
+		std::thread::id thread;
+		double startMs;
+		double endMs;
+	};
+
+	void add(const std::string& name, Clock::time_point start, Clock::time_point end);
+
+	Clock::time_point m_origin;
+	std::thread::id m_mainThread;
+	std::vector<Entry> m_entries;
+	mutable std::mutex m_mutex;
+};
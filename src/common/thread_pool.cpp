@@ -0,0 +1,152 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+	: m_stop(false)
+{
+	if (0 == numThreads)
+	{
+		const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		numThreads = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+	}
+	m_workers.reserve(numThreads);
+	for (unsigned int i = 0; i < numThreads; i++)
+	{
+		m_workers.emplace_back([this]() { workerLoop(); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_condition.notify_all();
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+	std::packaged_task<void()> packagedTask(std::move(task));
+	std::future<void> future = packagedTask.get_future();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.emplace_back(std::move(packagedTask));
+	}
+	m_condition.notify_one();
+	return future;
+}
+
+void ThreadPool::parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+							 const std::function<void(std::size_t, std::size_t)>& body)
+{
+	if (end <= begin)
+	{
+		return;
+	}
+
+	// helpers may start after the loop is over (or never, when called from a busy worker),
+	// so they only share reference counted state and the caller waits for chunks, not helpers
+	struct State
+	{
+		std::size_t begin, end, grain, numChunks;
+		const std::function<void(std::size_t, std::size_t)>* body;
+		std::atomic<std::size_t> nextChunk { 0 };
+		std::size_t doneChunks = 0;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto state = std::make_shared<State>();
+	state->begin = begin;
+	state->end = end;
+	state->grain = std::max<std::size_t>(grain, 1);
+	state->numChunks = (end - begin + state->grain - 1) / state->grain;
+	state->body = &body;
+
+	auto runChunks = [](const std::shared_ptr<State>& state)
+	{
+		for (std::size_t chunk = state->nextChunk++; chunk < state->numChunks; chunk = state->nextChunk++)
+		{
+			std::exception_ptr error;
+			bool failed;
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				failed = !!state->error;
+			}
+			if (!failed)
+			{
+				try
+				{
+					const std::size_t chunkBegin = state->begin + chunk * state->grain;
+					(*state->body)(chunkBegin, std::min(state->end, chunkBegin + state->grain));
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (error && !state->error)
+			{
+				state->error = error;
+			}
+			if (++state->doneChunks == state->numChunks)
+			{
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	const std::size_t numHelpers = std::min<std::size_t>(size(), state->numChunks - 1);
+	for (std::size_t i = 0; i < numHelpers; i++)
+	{
+		submit([state, runChunks]() { runChunks(state); });
+	}
+	runChunks(state);
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state]() { return state->doneChunks == state->numChunks; });
+	if (state->error)
+	{
+		std::rethrow_exception(state->error);
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	for (;;)
+	{
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+			if (m_stop && m_tasks.empty())
+			{
+				return;
+			}
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	// numThreads == 0 creates one worker per hardware thread except the calling one
+	explicit ThreadPool(unsigned int numThreads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// pool shared by the whole application, created on first use
+	static ThreadPool& instance();
+
+	unsigned int size() const { return static_cast<unsigned int>(m_workers.size()); }
+
+	std::future<void> submit(std::function<void()> task);
+
+	// calls body(rangeBegin, rangeEnd) for chunks of at most grain items, the calling thread
+	// takes part in the work; exceptions thrown by body are rethrown after all chunks finished
+	void parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+					 const std::function<void(std::size_t, std::size_t)>& body);
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> m_workers;
+	std::deque<std::packaged_task<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stop;
+};
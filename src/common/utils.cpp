@@ -3,6 +3,7 @@
  * Forked from Michał Siejak PBR project
  */
 
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <memory>
@@ -41,3 +42,77 @@ std::vector<char> File::readBinary(const std::string& filename)
 	file.read(buffer.data(), size);
 	return buffer;
 }
+
+uint16_t Utility::floatToHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	const uint32_t sign = (bits >> 16) & 0x8000u;
+	const int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffffu;
+
+	if (exponent >= 31)
+	{	// overflow to infinity, keep NaN
+		return uint16_t(sign | 0x7c00u | (((bits & 0x7fffffffu) > 0x7f800000u) ? 0x200u : 0u));
+	}
+	if (exponent <= 0)
+	{	// denormal or zero
+		if (exponent < -10)
+		{
+			return uint16_t(sign);
+		}
+		mantissa |= 0x800000u;
+		const int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		const uint32_t rest = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1u)))
+		{
+			half++;
+		}
+		return uint16_t(sign | half);
+	}
+	uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+	const uint32_t rest = mantissa & 0x1fffu;
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+	{	// may carry into exponent, which rounds to infinity correctly
+		half++;
+	}
+	return uint16_t(sign | half);
+}
+
+float Utility::halfToFloat(uint16_t value)
+{
+	const uint32_t sign = uint32_t(value & 0x8000u) << 16;
+	const int exponent = (value >> 10) & 0x1f;
+	uint32_t mantissa = value & 0x3ffu;
+	uint32_t bits;
+	if (31 == exponent)
+	{	// infinity or NaN
+		bits = sign | 0x7f800000u | (mantissa << 13);
+	}
+	else if (0 == exponent)
+	{
+		if (0 == mantissa)
+		{
+			bits = sign;
+		}
+		else
+		{	// denormal, normalized in single precision
+			int shift = 0;
+			while (0 == (mantissa & 0x400u))
+			{
+				mantissa <<= 1;
+				shift++;
+			}
+			bits = sign | (uint32_t(127 - 15 + 1 - shift) << 23) | ((mantissa & 0x3ffu) << 13);
+		}
+	}
+	else
+	{
+		bits = sign | (uint32_t(exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+	float result;
+	std::memcpy(&result, &bits, sizeof(result));
+	return result;
+}
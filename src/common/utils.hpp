@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -18,6 +19,10 @@ public:
 class Utility
 {
 public:
+	// IEEE half precision, rounded to nearest even; NaN stays NaN
+	static uint16_t floatToHalf(float value);
+	static float halfToFloat(uint16_t value);
+
 	template<typename T> static constexpr bool isPowerOfTwo(T value)
 	{
 		return value != 0 && (value & (value - 1)) == 0;
@@ -7,15 +7,59 @@
 
 #include <stdexcept>
 #include <memory>
+#include <cstring>
+#include <future>
+#include <cmath>
 
 #include "opengl.hpp"
+#include "common/startup_timeline.hpp"
 
 #include <GLFW/glfw3.h>
 
+#ifdef PBR_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 namespace OpenGL
 {
 
+// scale of the scene asteroid, sizes of the field instances are relative to it
+static const float AsteroidScale = 2.5f;
+// temporal anti-aliasing: length of the jitter sequence and weight of the reprojected history
+static const int JitterSamples = 8;
+static const float HistoryWeight = 0.9f;
+// equirectangular source of the environment and the directory of the precomputed maps
+static const char* SkyboxImageFile = "data/textures/skybox.hdr";
+static const char* EnvironmentCacheDirectory = "data/cache/";
+
+// size, samples and memory of an environment quality tier with the time it took to get it on the GPU
+static void printEnvironment(const EnvironmentMaps::Parameters& parameters, bool precomputed, double ms)
+{
+	const double MB = 1024.0 * 1024.0;
+	std::cout << "Environment " << EnvironmentMaps::qualityName(parameters.quality) << ": " << parameters.specularSize
+			  << "^2 specular map, " << parameters.specularLevels << " levels, " << parameters.specularSamples << " samples per texel, "
+			  << (precomputed ? "precomputed" : "loaded") << " in " << ms << " ms, "
+			  << EnvironmentMaps::residentBytes(parameters) / MB << " MB resident";
+	if (precomputed)
+	{
+		std::cout << ", " << EnvironmentMaps::transientBytes(parameters) / MB << " MB transient";
+	}
+	std::cout << std::endl;
+}
+
+// radical inverse of index in base, the Halton sequence of the TAA jitter
+static float halton(int index, int base)
+{
+	float result = 0.0f;
+	float fraction = 1.0f;
+	for (; index > 0; index /= base)
+	{
+		fraction /= float(base);
+		result += fraction * float(index % base);
+	}
+	return result;
+}
 
 GLFWwindow* Renderer::initialize(int width, int height, int maxSamples)
 {
@@ -44,25 +88,162 @@ GLFWwindow* Renderer::initialize(int width, int height, int maxSamples)
 	{
 		throw std::runtime_error("Failed to initialize OpenGL extensions loader");
 	}
+	ShaderProgram::EnableParallelCompile((GLADloadproc)glfwGetProcAddress);
+
+#ifdef _DEBUG
+	glDebugMessageCallback(Renderer::logMessage, nullptr);
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+
+	createRenderTargets(width, height, maxSamples);
+
+	std::cout << "OpenGL 4.5 renderer [" << glGetString(GL_RENDERER) << "]" << std::endl;
+	return window;
+}
+
+bool Renderer::initializeHeadless(int width, int height, int maxSamples)
+{
+#ifdef PBR_HEADLESS_EGL
+	// surfaceless Mesa platform when available (no X server or GPU device needed), default display otherwise
+	EGLDisplay display = EGL_NO_DISPLAY;
+	const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (nullptr != clientExtensions && nullptr != getPlatformDisplay
+		&& nullptr != std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+	{
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (EGL_NO_DISPLAY == display)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	EGLint major, minor;
+	if (EGL_NO_DISPLAY == display || !eglInitialize(display, &major, &minor))
+	{
+		std::cout << "EGL display is not available" << std::endl;
+		return false;
+	}
+
+	const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	const EGLint contextAttribs[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 5,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifdef _DEBUG
+		EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	EGLContext context = EGL_NO_CONTEXT;
+	if (eglBindAPI(EGL_OPENGL_API)
+		&& eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) && numConfigs > 0)
+	{
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	}
+	if (EGL_NO_CONTEXT == context || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		std::cout << "Failed to create surfaceless OpenGL 4.5 context (EGL " << major << "." << minor << ")" << std::endl;
+		if (EGL_NO_CONTEXT != context)
+		{
+			eglDestroyContext(display, context);
+		}
+		eglTerminate(display);
+		return false;
+	}
+	mEglDisplay = display;
+	mEglContext = context;
+
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+	{
+		throw std::runtime_error("Failed to initialize OpenGL extensions loader");
+	}
+	ShaderProgram::EnableParallelCompile((GLADloadproc)eglGetProcAddress);
 
 #ifdef _DEBUG
 	glDebugMessageCallback(Renderer::logMessage, nullptr);
 	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
 #endif
 
+	createRenderTargets(width, height, maxSamples);
+
+	mOutputFramebuffer = std::make_shared<Framebuffer>();
+	{
+		mOutputFramebuffer->AttachTexture(GL_COLOR_ATTACHMENT0, GL_RGBA8, width, height);
+		auto status = mOutputFramebuffer->CheckStatus();
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			throw std::runtime_error("Framebuffer is not complete: " + std::to_string(status));
+		}
+	}
+
+	std::cout << "OpenGL 4.5 headless renderer [" << glGetString(GL_RENDERER) << "]" << std::endl;
+	return true;
+#else
+	(void)width;
+	(void)height;
+	(void)maxSamples;
+	std::cout << "Headless rendering requires EGL, which was not found at build time" << std::endl;
+	return false;
+#endif
+}
+
+void Renderer::createRenderTargets(int width, int height, int maxSamples)
+{
 	glViewport(0, 0, width, height);
 
 	GLint maxSupportedSamples;
 	glGetIntegerv(GL_MAX_SAMPLES, &maxSupportedSamples);
 
-	const int samples = glm::min(maxSamples, maxSupportedSamples);
+	mSamples = glm::min(maxSamples, maxSupportedSamples);
+	const glm::ivec2 targetSize = mDynamicResolution.targetSize(glm::ivec2{ width, height });
+	createSceneTargets(targetSize.x, targetSize.y, mTransparencyTargets, mTemporalAATargets);	// recreated by render() when the queue, the AA mode or the size bucket changes
+
+	mCameraPtr = std::make_shared<Camera>(glm::radians(60.0f), glm::vec2{ width, height }, 0.25f, 5000.0f);
+	mCameraPtr->SetPosition(glm::vec3{ 0, 0, 1000 });
+}
+
+void Renderer::createSceneTargets(int width, int height, bool transparency, bool temporalAA)
+{
+	// output locations of the shaders: color, OIT accumulation and counter, motion vectors of TAA
+	std::vector<GLenum> drawBuffers = transparency
+		? std::vector<GLenum>{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 }
+		: std::vector<GLenum>{ GL_COLOR_ATTACHMENT0 };
+	if (temporalAA)
+	{
+		drawBuffers.resize(3, GL_NONE);
+		drawBuffers.push_back(GL_COLOR_ATTACHMENT3);
+	}
+
+	// textures in both modes, the resolve passes read them directly: multisampled ones with MSAA,
+	// single sampled ones with TAA
+	auto attachColor = [this, width, height, temporalAA](GLenum Attachment, GLenum Format)
+	{
+		if (temporalAA)
+		{
+			mFramebuffer->AttachTexture(Attachment, Format, width, height);
+		}
+		else
+		{
+			mFramebuffer->AttachMultisampleTexture(Attachment, Format, width, height, mSamples);
+		}
+	};
 	mFramebuffer = std::make_shared<Framebuffer>();
 	{
-		mFramebuffer->AttachRenderbuffer(GL_COLOR_ATTACHMENT0, GL_RGBA16F, width, height, samples);
-		mFramebuffer->AttachRenderbuffer(GL_COLOR_ATTACHMENT1, GL_RGBA16F, width, height, samples);
-		mFramebuffer->AttachRenderbuffer(GL_COLOR_ATTACHMENT2, GL_R16F,    width, height, samples);
-		mFramebuffer->AttachRenderbuffer(GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT, width, height, samples);
-		mFramebuffer->SetDrawBuffers({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 });
+		attachColor(GL_COLOR_ATTACHMENT0, GL_RGBA16F);
+		if (transparency)
+		{
+			attachColor(GL_COLOR_ATTACHMENT1, GL_RGBA16F);
+			attachColor(GL_COLOR_ATTACHMENT2, GL_R16F);
+		}
+		if (temporalAA)
+		{
+			attachColor(GL_COLOR_ATTACHMENT3, GL_RG16F);
+		}
+		mFramebuffer->AttachRenderbuffer(GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT, width, height, temporalAA ? 0 : mSamples);
+		mFramebuffer->SetDrawBuffers(drawBuffers);
 		auto status = mFramebuffer->CheckStatus();
 		if (status != GL_FRAMEBUFFER_COMPLETE)
 		{
@@ -70,85 +251,396 @@ GLFWwindow* Renderer::initialize(int width, int height, int maxSamples)
 		}
 	}
 
-	mResolveFramebuffer = std::make_shared<Framebuffer>();
+	// the rendered part of the output targets is scaled to the window
+	auto createOutputTarget = [width, height](GLenum Format)
 	{
-		mResolveFramebuffer->AttachTexture(GL_COLOR_ATTACHMENT0, GL_RGBA16F, width, height);
-		mResolveFramebuffer->AttachTexture(GL_COLOR_ATTACHMENT1, GL_RGBA16F, width, height);
-		mResolveFramebuffer->AttachTexture(GL_COLOR_ATTACHMENT2, GL_R16F,    width, height);
-		mResolveFramebuffer->SetDrawBuffers({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 });
-		auto status = mResolveFramebuffer->CheckStatus();
+		auto framebuffer = std::make_shared<Framebuffer>();
+		framebuffer->AttachTexture(GL_COLOR_ATTACHMENT0, Format, width, height);
+		framebuffer->SetDrawBuffers({ GL_COLOR_ATTACHMENT0 });
+		auto status = framebuffer->CheckStatus();
 		if (status != GL_FRAMEBUFFER_COMPLETE)
 		{
 			throw std::runtime_error("Framebuffer is not complete: " + std::to_string(status));
 		}
-	}
-
-	mCameraPtr = std::make_shared<Camera>(glm::radians(60.0f), glm::vec2{ width, height }, 0.25f, 5000.0f);
-	mCameraPtr->SetPosition(glm::vec3{ 0, 0, 1000 });
+		return framebuffer;
+	};
 
-	std::cout << "OpenGL 4.5 renderer [" << glGetString(GL_RENDERER) << "]" << std::endl;
-	return window;
+	if (temporalAA)
+	{
+		// the resolve writes one history target while it reprojects the other, the tonemap pass
+		// samples them bilinearly
+		mResolveFramebuffer = nullptr;
+		for (auto &history : mHistoryFramebuffers)
+		{
+			history = createOutputTarget(GL_RGBA16F);
+			const auto texture = std::dynamic_pointer_cast<const Texture>(history->GetRenderTarget(GL_COLOR_ATTACHMENT0));
+			texture->SetFilter(GL_LINEAR, GL_LINEAR);
+			texture->SetWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+		}
+		mHistoryValid = false;
+	}
+	else
+	{
+		// tone mapped by the resolve compute pass
+		mResolveFramebuffer = createOutputTarget(GL_RGBA8);
+		mHistoryFramebuffers = {};
+	}
+	mTransparencyTargets = transparency;
+	mTemporalAATargets = temporalAA;
+	mTargetSize = glm::ivec2{ width, height };
 }
 
 void Renderer::shutdown()
 {
+	if (mGpuTimers.IsCreated())
+	{
+		// deliver timings of the frames still in flight before the report is closed
+		glFinish();
+		mGpuTimers.Collect([this](uint64_t frame, const std::vector<double>& times) { onGpuTimes(frame, times); });
+		mGpuTimers.Release();
+	}
+	mProfiler.close();
+
 	mCameraPtr = nullptr;
 
-	mResolveFramebuffer->Release();
+	if (nullptr != mOutputFramebuffer)
+	{
+		mOutputFramebuffer->Release();
+	}
+	if (nullptr != mResolveFramebuffer)
+	{
+		mResolveFramebuffer->Release();
+	}
+	for (const auto &history : mHistoryFramebuffers)
+	{
+		if (nullptr != history)
+		{
+			history->Release();
+		}
+	}
 	mFramebuffer->Release();
 
 	mEmptyVao.Release();
 
 	mSkyboxUB.Release();
+	mAutoExposure.Release();
+	UniformRing::Instance().Release();
 
 	mSkybox.Release();
 	mPbrAsteroid.Release();
 	mFullScreenQuad.Release();
 
+	mResolveProgram.Release();
+	mResolveOpaqueProgram.Release();
 	mTonemapProgram.Release();
+	mTaaProgram.Release();
+	mTaaOpaqueProgram.Release();
 	mSkyboxProgram.Release();
 
 	mEnvPtr->Release();
+
+#ifdef PBR_HEADLESS_EGL
+	if (nullptr != mEglDisplay)
+	{
+		eglMakeCurrent(mEglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(mEglDisplay, mEglContext);
+		eglTerminate(mEglDisplay);
+		mEglDisplay = mEglContext = nullptr;
+	}
+#endif
 }
 
-std::function<void (int w, int h)> Renderer::setup()
+std::function<void (int w, int h)> Renderer::setup(const SceneSettings& scene)
 {
+	StartupTimeline timeline;
+
+	// File decoding and mesh import run on the worker pool while this thread compiles programs,
+	// each result is uploaded as soon as this thread gets to it.
+	ThreadPool &pool = ThreadPool::instance();
+	std::shared_ptr<HdrImage> skyboxHdr;
+	std::shared_ptr<Image> skyboxImage;
+	std::shared_ptr<EnvironmentMaps> environmentMaps;
+	const EnvironmentMaps::Parameters environmentParameters = EnvironmentMaps::parameters(scene.environmentQuality);
+	uint64_t environmentKey = 0;
+	std::shared_ptr<Mesh> skyboxMesh, asteroidMesh;
+	PbrMeshBase::MaterialImages asteroidImages;
+	std::shared_ptr<AsteroidSurfaceMap> surfaceMap;
+	// cube2sphere skybox_front.png skybox_back.png skybox_left.png skybox_right.png skybox_top.png skybox_bottom.png -r 4096 2048 -fHDR -oskybox_equirectangular
+	// the image is only decoded when the precomputed environment maps are not in the cache; Radiance scanlines
+	// are indexed here and decoded in parallel into the environment texture, other formats go through stb_image
+	std::future<void> skyboxImageJob = pool.submit([&]() {
+		std::vector<char> skyboxFile = timeline.measure("read skybox.hdr", []() { return File::readBinary(SkyboxImageFile); });
+		environmentMaps = timeline.measure("load environment cache", [&]() {
+			environmentKey = EnvironmentMaps::key(skyboxFile, environmentParameters);
+			return EnvironmentMaps::load(EnvironmentMaps::fileName(EnvironmentCacheDirectory, environmentKey), environmentKey, environmentParameters);
+		});
+		if (nullptr == environmentMaps)
+		{
+			skyboxHdr = timeline.measure("index skybox.hdr", [&]() { return HdrImage::fromMemory(std::move(skyboxFile), SkyboxImageFile); });
+			if (nullptr == skyboxHdr)
+			{
+				skyboxImage = timeline.measure("decode skybox.hdr", []() { return Image::fromFile(SkyboxImageFile, 3); });
+			}
+		}
+	});
+	std::future<void> skyboxMeshJob = pool.submit([&]() {
+		skyboxMesh = timeline.measure("import skybox.obj", []() { return Mesh::fromFile("data/meshes/skybox.obj"); });
+	});
+	std::future<void> asteroidJob = pool.submit([&]() {
+		asteroidMesh = timeline.measure("import asteroid7.fbx", []() { return Mesh::fromFile("data/meshes/asteroid7.fbx"); });
+		asteroidImages = timeline.measure("decode asteroid textures", [&]() { return PbrMeshBase::MaterialImages::Load(asteroidMesh); });
+	});
+	std::future<void> surfaceMapJob = pool.submit([&]() {
+		surfaceMap = timeline.measure("load asteroid surface map", [resolution = scene.surfaceMapResolution]() { return AsteroidSurfaceMap::fromCache("data/cache/", resolution); });
+	});
+
 	// Set global OpenGL state.
-	glEnable(GL_CULL_FACE);
-	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	StateCache::Instance().Invalidate();
+	StateCache::Instance().Enable(GL_CULL_FACE, true);
+	StateCache::Instance().Enable(GL_TEXTURE_CUBE_MAP_SEAMLESS, true);
 	glFrontFace(GL_CCW);
 
 	// Create empty VAO for rendering full screen triangle
 	mEmptyVao = MeshGeometry(nullptr, true);
 
 	// Create uniform buffers.
+	UniformRing::Instance().Create();
 	mSkyboxUB.Create();
 
-	// Load assets & compile/link rendering programs
-	mTonemapProgram =
-		ShaderProgram{{ std::make_tuple(GL_VERTEX_SHADER,   Shader::GetFileContents("data/shaders/tonemap_vs.glsl")),
-						std::make_tuple(GL_FRAGMENT_SHADER, Shader::GetFileContents("data/shaders/tonemap_fs.glsl")) }};
+	// Compile/link rendering programs, with parallel shader compilation they are only waited for on first use
+	timeline.measure("compile programs", [&]() {
+		mResolveProgram =
+			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/resolve_cs.glsl")) }};
+		mResolveOpaqueProgram =
+			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::AddDefines(Shader::GetFileContents("data/shaders/resolve_cs.glsl"), { "NO_TRANSPARENCY" })) }};
+		mTonemapProgram =
+			ShaderProgram{{ std::make_tuple(GL_VERTEX_SHADER,   Shader::GetFileContents("data/shaders/tonemap_vs.glsl")),
+							std::make_tuple(GL_FRAGMENT_SHADER, Shader::GetFileContents("data/shaders/tonemap_fs.glsl")) }};
+		mTaaProgram =
+			ShaderProgram{{ std::make_tuple(GL_VERTEX_SHADER,   Shader::GetFileContents("data/shaders/tonemap_vs.glsl")),
+							std::make_tuple(GL_FRAGMENT_SHADER, Shader::GetFileContents("data/shaders/taa_fs.glsl")) }};
+		mTaaOpaqueProgram =
+			ShaderProgram{{ std::make_tuple(GL_VERTEX_SHADER,   Shader::GetFileContents("data/shaders/tonemap_vs.glsl")),
+							std::make_tuple(GL_FRAGMENT_SHADER, Shader::AddDefines(Shader::GetFileContents("data/shaders/taa_fs.glsl"), { "NO_TRANSPARENCY" })) }};
 
-	mSkyboxProgram =
-		ShaderProgram{{ std::make_tuple(GL_VERTEX_SHADER,   Shader::GetFileContents("data/shaders/skybox_vs.glsl")),
-						std::make_tuple(GL_FRAGMENT_SHADER, Shader::GetFileContents("data/shaders/skybox_fs.glsl")) }};
+		mSkyboxProgram =
+			ShaderProgram{{ std::make_tuple(GL_VERTEX_SHADER,   Shader::GetFileContents("data/shaders/skybox_vs.glsl")),
+							std::make_tuple(GL_FRAGMENT_SHADER, Shader::GetFileContents("data/shaders/skybox_fs.glsl")) }};
 
-	// cube2sphere skybox_front.png skybox_back.png skybox_left.png skybox_right.png skybox_top.png skybox_bottom.png -r 4096 2048 -fHDR -oskybox_equirectangular
-	mEnvPtr = std::make_shared<Environment>(Image::fromFile("data/textures/skybox.hdr", 3));
+		PbrAsteroid::CreatePrograms(scene);
+		mAutoExposure.Create();
+	});
+
+	// waits for a loader job, the programs the driver finishes meanwhile get their compile time noted
+	auto waitForJob = [](std::future<void> &job) {
+		while (std::future_status::ready != job.wait_for(std::chrono::milliseconds(1)))
+		{
+			ShaderProgram::PollPending();
+		}
+		job.get();
+	};
+
+	// Upload assets in the order the jobs are expected to finish, the environment is needed by the asteroid.
+	try
+	{
+		waitForJob(skyboxMeshJob);
+		timeline.measure("upload skybox mesh", [&]() { mSkybox = MeshGeometry{ skyboxMesh }; });
+		waitForJob(skyboxImageJob);
+		const auto environmentStart = std::chrono::steady_clock::now();
+		if (nullptr != environmentMaps)
+		{
+			timeline.measure("upload environment", [&]() { mEnvPtr = std::make_shared<Environment>(*environmentMaps); });
+		}
+		else
+		{
+			if (nullptr != skyboxHdr)
+			{
+				timeline.measure("decode skybox.hdr, precompute environment", [&]() { mEnvPtr = std::make_shared<Environment>(*skyboxHdr, environmentParameters); });
+				skyboxHdr.reset();
+			}
+			else
+			{
+				timeline.measure("precompute environment", [&]() { mEnvPtr = std::make_shared<Environment>(skyboxImage, environmentParameters); });
+				skyboxImage.reset();
+			}
+			if (0 != environmentKey)
+			{
+				timeline.measure("read back environment", [&]() { saveEnvironment(environmentKey, environmentParameters); });
+			}
+		}
+		mEnvQuality = scene.environmentQuality;
+		printEnvironment(environmentParameters, nullptr == environmentMaps,
+						 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - environmentStart).count());
+		waitForJob(asteroidJob);
+		timeline.measure("create asteroid", [&]() { mPbrAsteroid = PbrAsteroid{ asteroidMesh, asteroidImages, mEnvPtr }; });
+		waitForJob(surfaceMapJob);
+		timeline.measure("upload surface map", [&]() { mPbrAsteroid.SetSurfaceMap(*surfaceMap); });
+	}
+	catch (...)
+	{
+		// jobs still running write to locals of this function
+		for (std::future<void> *job : { &skyboxImageJob, &skyboxMeshJob, &asteroidJob, &surfaceMapJob })
+		{
+			if (job->valid())
+			{
+				job->wait();
+			}
+		}
+		throw;
+	}
 
-	mSkybox = MeshGeometry{ Mesh::fromFile("data/meshes/skybox.obj") };
-	mPbrAsteroid = PbrAsteroid{ Mesh::fromFile("data/meshes/asteroid7.fbx"), mEnvPtr };
+	timeline.measure("link programs", [&]() {
+		ShaderProgram::PollPending();
+		for (const ShaderProgram *program : { &mResolveProgram, &mResolveOpaqueProgram, &mTonemapProgram, &mTaaProgram, &mTaaOpaqueProgram, &mSkyboxProgram })
+		{
+			program->Finish();
+		}
+		PbrAsteroid::FinishPrograms();
+		mAutoExposure.Finish();
+	});
+	mLastFrameTime = std::chrono::steady_clock::now();
+	timeline.print(std::cout);
 
 	return [&](int w, int h) { glViewport(0, 0, w, h); };
 }
 
+void Renderer::updateAsteroidField(int count)
+{
+	const uint32_t FieldSeed = 7;
+	const float sceneRadius = AsteroidScale * mPbrAsteroid.GetBoundingRadius();
+
+	std::vector<AsteroidInstanceData> instances{ mPbrAsteroid.GetInstance(0) };
+	for (const AsteroidField::Instance& field : AsteroidField::generate(count - 1, FieldSeed))
+	{
+		const float scale = AsteroidScale * field.scale;
+		AsteroidInstanceData instance{};
+		instance.modelMat = glm::translate(glm::mat4{ 1.0f }, sceneRadius * field.position) *
+							glm::rotate(glm::mat4{ 1.0f }, field.rotationAngle, field.rotationAxis) *
+							glm::scale(glm::mat4{ 1.0f }, glm::vec3{ scale });
+		instance.albedoRoughness = glm::vec4{ field.albedo, field.roughness };
+		instance.metalness = field.metalness;
+		instance.noiseVariant = static_cast<GLuint>(AsteroidField::noiseVariant(field.seed));
+		instance.boundingRadius = BoundingSphere::maxColumnLength(instance.modelMat) * mPbrAsteroid.GetBoundingRadius();
+		instances.push_back(instance);
+	}
+	mPbrAsteroid.SetInstances(instances);
+	mAsteroidCount = count;
+}
+
+void Renderer::updateEnvironment(EnvironmentMaps::Quality quality)
+{
+	const EnvironmentMaps::Parameters parameters = EnvironmentMaps::parameters(quality);
+	const auto start = std::chrono::steady_clock::now();
+	// also on failure, the tier is not retried every frame
+	mEnvQuality = quality;
+	bool precomputed = false;
+	try
+	{
+		std::vector<char> source = File::readBinary(SkyboxImageFile);
+		const uint64_t key = EnvironmentMaps::key(source, parameters);
+		std::shared_ptr<EnvironmentMaps> maps = EnvironmentMaps::load(EnvironmentMaps::fileName(EnvironmentCacheDirectory, key), key, parameters);
+		if (nullptr != maps)
+		{
+			*mEnvPtr = Environment{ *maps };
+		}
+		else
+		{
+			std::shared_ptr<HdrImage> hdr = HdrImage::fromMemory(std::move(source), SkyboxImageFile);
+			*mEnvPtr = nullptr != hdr ? Environment{ *hdr, parameters } : Environment{ Image::fromFile(SkyboxImageFile, 3), parameters };
+			precomputed = true;
+			if (0 != key)
+			{
+				saveEnvironment(key, parameters);
+			}
+		}
+	}
+	catch (const std::runtime_error& error)
+	{
+		std::cout << "ERROR: " << error.what() << std::endl;
+		return;
+	}
+	printEnvironment(parameters, precomputed,
+					 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void Renderer::saveEnvironment(uint64_t key, const EnvironmentMaps::Parameters& parameters)
+{
+	// read back here, written on a worker while rendering continues
+	std::shared_ptr<EnvironmentMaps> maps = mEnvPtr->Download(key, parameters);
+	ThreadPool::instance().submit([maps]() {
+		const std::string filename = EnvironmentMaps::fileName(EnvironmentCacheDirectory, maps->key());
+		std::error_code error;
+		std::filesystem::create_directories(EnvironmentCacheDirectory, error);
+		if (!maps->save(filename))
+		{
+			std::cout << "WARNING: could not write environment cache " << filename << std::endl;
+		}
+	});
+}
+
 void Renderer::renderScene(bool OpaquePass)
 {
-	mPbrAsteroid.Render(OpaquePass);
+	mRenderQueue.Render(OpaquePass);
+}
+
+void Renderer::onGpuTimes(uint64_t frame, const std::vector<double>& times)
+{
+	mProfiler.setGpuTimes(frame, times);
+
+	double frameMs = 0.0;
+	for (double stageMs : times)
+	{
+		frameMs += std::isnan(stageMs) ? 0.0 : stageMs;
+	}
+	// with both budgets set, detail is given up first and the render scale only once the governor is
+	// at its coarsest level and settled; on the way back full scale returns before any detail does
+	const bool lodMayRaise = !mDynamicResolution.enabled() || (mDynamicResolution.atFullScale() && mDynamicResolution.settled());
+	const bool resolutionMayLower = !mLodGovernor.enabled() || (mLodGovernor.atCoarsestLevel() && mLodGovernor.settled());
+	if (mLodGovernor.update(frameMs, lodMayRaise))
+	{
+		std::cout << mLodGovernor.describe() << std::endl;
+	}
+	if (mDynamicResolution.update(frameMs, resolutionMayLower))
+	{
+		std::cout << mDynamicResolution.describe() << std::endl;
+	}
 }
 
 void Renderer::render(GLFWwindow* window, const ViewSettings& view, const SceneSettings& scene)
 {
+	// scene changes that rebuild GPU resources run before anything of the frame is bound or drawn; the
+	// environment precompute binds programs, images and textures behind the state cache
+	const bool rebuildField = std::max(scene.asteroidCount, 1) != mAsteroidCount;
+	const bool rebuildEnvironment = scene.environmentQuality != mEnvQuality;
+	if (rebuildField)
+	{
+		updateAsteroidField(std::max(scene.asteroidCount, 1));
+	}
+	if (rebuildEnvironment)
+	{
+		updateEnvironment(scene.environmentQuality);
+	}
+	if (rebuildField || rebuildEnvironment)
+	{
+		StateCache::Instance().Invalidate();
+	}
+
+	mProfiler.beginFrame();
+	if (mGpuTimers.IsCreated())
+	{
+		mGpuTimers.BeginFrame(mProfiler.frame(),
+			[this](uint64_t frame, const std::vector<double>& times) { onGpuTimes(frame, times); },
+			[this](uint64_t frame) { mProfiler.dropGpuTimes(frame); });
+	}
+	UniformRing::Instance().BeginFrame();
+	StateCache &state = StateCache::Instance();
+	state.TakeCounters();
+
+	// time since the last frame for the adaptation of the exposure, long stalls do not jump it
+	const auto frameTime = std::chrono::steady_clock::now();
+	const float deltaSeconds = std::min(std::chrono::duration<float>(frameTime - mLastFrameTime).count(), 0.1f);
+	mLastFrameTime = frameTime;
+
 	// process rotation
 	float roll = 0;
 	if (view.m_keyMapping.count(GLFW_KEY_Z) > 0)
@@ -184,44 +676,97 @@ void Renderer::render(GLFWwindow* window, const ViewSettings& view, const SceneS
 	mCameraPtr->Move(move * speedMult);
 
 	int fbWidth, fbHeight;
-	glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+	if (nullptr != window)
+	{
+		glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+	}
+	else
+	{
+		const auto &outputRt = mOutputFramebuffer->GetRenderTarget(GL_COLOR_ATTACHMENT0);
+		fbWidth = outputRt->GetWidth();
+		fbHeight = outputRt->GetHeight();
+	}
 
-	mFramebuffer->ResizeAll(fbWidth, fbHeight);
-	mResolveFramebuffer->ResizeAll(fbWidth, fbHeight);
+	// the targets follow the output size in buckets and are reallocated only when the bucket changes,
+	// the render scale only changes the viewport
+	if (scene.resolutionBudgetMs != mDynamicResolution.budget())
+	{
+		mDynamicResolution.setBudget(scene.resolutionBudgetMs);
+	}
+	const glm::ivec2 outputSize{ fbWidth, fbHeight };
+	const glm::ivec2 targetSize = mDynamicResolution.targetSize(outputSize);
+	const glm::ivec2 renderSize = glm::min(mDynamicResolution.renderSize(outputSize), targetSize);
+
+	mRenderQueue.Clear();
+	mRenderQueue.Submit(mPbrAsteroid);
+	const bool transparency = mRenderQueue.HasTransparent();
+	const bool temporalAA = scene.temporalAA;
+	if (transparency != mTransparencyTargets || temporalAA != mTemporalAATargets || targetSize != mTargetSize)
+	{
+		createSceneTargets(targetSize.x, targetSize.y, transparency, temporalAA);
+	}
+	// the history of another render size does not line up with this frame
+	if (renderSize != mHistorySize)
+	{
+		mHistoryValid = false;
+		mHistorySize = renderSize;
+	}
 
 	const auto &colorRb = mFramebuffer->GetRenderTarget(GL_COLOR_ATTACHMENT0);
-	assert(colorRb->GetWidth() == fbWidth);
-	assert(colorRb->GetHeight() == fbHeight);
+	assert(colorRb->GetWidth() == targetSize.x);
+	assert(colorRb->GetHeight() == targetSize.y);
 
-	const glm::mat4 projectionMatrix = mCameraPtr->GetProjection();
+	// with TAA the projection moves by a sub-pixel offset of the Halton (2, 3) sequence every frame
+	glm::vec2 jitter{ 0.0f, 0.0f };
+	if (temporalAA)
+	{
+		mJitterIndex = (mJitterIndex + 1) % JitterSamples;
+		jitter = glm::vec2{ halton(mJitterIndex + 1, 2), halton(mJitterIndex + 1, 3) } - 0.5f;
+	}
+	const glm::vec2 jitterNdc = 2.0f * jitter / glm::vec2{ renderSize };
+	const glm::mat4 projectionMatrix = mCameraPtr->GetJitteredProjection(jitter, glm::vec2{ renderSize });
 	const glm::mat4 viewMatrix = mCameraPtr->GetView();
 	const glm::mat4 viewRotationMatrix = glm::mat4(glm::mat3(viewMatrix));
+	const glm::mat4 viewProjectionMatrix = projectionMatrix * viewMatrix;
+	const glm::mat4 skyViewProjectionMatrix = projectionMatrix * viewRotationMatrix;
+	if (!mHistoryValid)
+	{
+		mPrevViewProjection = viewProjectionMatrix;
+		mPrevSkyViewProjection = skyViewProjectionMatrix;
+		mPrevJitter = jitterNdc;
+	}
 
 	// Prepare framebuffer for rendering
 	mFramebuffer->Bind();
+	glViewport(0, 0, renderSize.x, renderSize.y);
 	// opaque pass
-	glDepthMask(GL_TRUE);								// enable write to depth buffer to clear it
+	state.DepthMask(true);								// enable write to depth buffer to clear it
 	glClearColor(0.f, 0.f, 0.f, 0.f);					// zero color buffer, necessary only for transparency targets,
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	//  since every pixel will be overwritten by skybox
 
 	// Draw skybox
-	glDisable(GL_BLEND);								// disable blending
-	glDepthMask(GL_FALSE);								// disable write to depth buffer for skybox
-	glDisable(GL_DEPTH_TEST);
-
-	// Update skybox uniform buffer
 	{
-		auto &skyboxUniforms = mSkyboxUB.GetReference();
-		skyboxUniforms.skyViewProjectionMatrix = projectionMatrix * viewRotationMatrix;
-		mSkyboxUB.Bind(0);
-	}
+		StageTimer timer(*this, StageSkybox);
+		state.Enable(GL_BLEND, false);								// disable blending
+		state.DepthMask(false);								// disable write to depth buffer for skybox
+		state.Enable(GL_DEPTH_TEST, false);
+
+		// Update skybox uniform buffer
+		{
+			auto &skyboxUniforms = mSkyboxUB.GetReference();
+			skyboxUniforms.skyViewProjectionMatrix = skyViewProjectionMatrix;
+			skyboxUniforms.prevSkyViewProjectionMatrix = mPrevSkyViewProjection;
+			skyboxUniforms.jitter = glm::vec4{ jitterNdc, mPrevJitter };
+			mSkyboxUB.Bind(0);
+		}
 
-	mSkyboxProgram.Use();
-	mEnvPtr->BindTextureUnit(0);
-	mSkybox.Render();
+		mSkyboxProgram.Use();
+		mEnvPtr->BindTextureUnit(0);
+		mSkybox.Render();
+	}
 
-	glDepthMask(GL_TRUE);					// enable write to depth buffer to clear it
-	glEnable(GL_DEPTH_TEST);
+	state.DepthMask(true);					// enable write to depth buffer to clear it
+	state.Enable(GL_DEPTH_TEST, true);
 
 	// Draw scene
 	std::array<SceneSettings::Light, SceneSettings::NumLights> lightsArr;
@@ -230,53 +775,237 @@ void Renderer::render(GLFWwindow* window, const ViewSettings& view, const SceneS
 		lightsArr[i] = scene.lights[i];
 	}
 	glm::mat4 pbrModelMat =
-								glm::scale(glm::mat4{ 1.0f }, 2.5f * glm::vec3{ 1.0f, 1.0f, 1.0f }) *
+								glm::scale(glm::mat4{ 1.0f }, AsteroidScale * glm::vec3{ 1.0f, 1.0f, 1.0f }) *
 								glm::eulerAngleXY(glm::radians(scene.pitch), glm::radians(scene.yaw));
-	const glm::vec4 viewport = glm::vec4{ 0, 0, fbWidth, fbHeight };
+	const glm::vec4 viewport = glm::vec4{ 0, 0, renderSize.x, renderSize.y };
 	mPbrAsteroid.SetShadingUniforms(lightsArr, viewport, projectionMatrix, viewMatrix, pbrModelMat);
+	mPbrAsteroid.SetTemporal(mPrevViewProjection, glm::vec4{ jitterNdc, mPrevJitter }, (mJitterIndex & 1) ? -1.5f : 1.0f);
+	mPbrAsteroid.SetTemporalAA(temporalAA);
+	if (scene.gpuBudgetMs != mLodGovernor.budget())
+	{
+		mLodGovernor.setBudget(scene.gpuBudgetMs);
+	}
+	mPbrAsteroid.SetLod(mLodGovernor.settings());
+
+	{
+		StageTimer timer(*this, StageCull);
+		mPbrAsteroid.CullPatches();
+	}
+
+	mPbrAsteroid.SetDepthPrePass(scene.depthPrePass);
+	mPbrAsteroid.SetNoiseLevels(scene.noiseLevels);
+	mPbrAsteroid.SetCraters(scene.craters);
+	if (scene.depthPrePass)
+	{
+		StageTimer timer(*this, StageDepth);
+		state.ColorMask(false);
+		mPbrAsteroid.RenderDepth();
+		state.ColorMask(true);
+		state.DepthMask(false);				// shade only the fragments that won the pre-pass
+		state.DepthFunc(GL_EQUAL);
+	}
 
-	renderScene(true);
+	{
+		StageTimer timer(*this, StageOpaque);
+		renderScene(true);
+	}
+	state.DepthFunc(GL_LESS);
 
 	// transparency pass (Order Independent Transparency (OIT), see https://developer.download.nvidia.com/SDK/10/opengl/src/dual_depth_peeling/doc/DualDepthPeeling.pdf)
-	glDepthMask(GL_FALSE);					// do not write new data to depth buffer
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);						// enable blending so that transparent geometry sum up
-	glBlendFunc(GL_ONE, GL_ONE);			// weights for data in FB and new data
+	// only when something transparent was submitted
+	if (transparency)
+	{
+		state.DepthMask(false);					// do not write new data to depth buffer
+		state.Enable(GL_DEPTH_TEST, true);
+		state.Enable(GL_BLEND, true);						// enable blending so that transparent geometry sum up
+		state.BlendFunc(GL_ONE, GL_ONE);			// weights for data in FB and new data
 
-	// Draw scene
-	renderScene(false);	//, view, scene
+		// Draw scene
+		StageTimer timer(*this, StageTransparency);
+		renderScene(false);	//, view, scene
+	}
 
 	mFramebuffer->Unbind();
 
-	glDisable(GL_BLEND);					// disable blending
+	state.Enable(GL_BLEND, false);					// disable blending
 
-	// Resolve multisample framebuffer (copy renderbuffers to textures)
-	mFramebuffer->Resolve(*mResolveFramebuffer,
+	// Exposure of the tone mapping measured from the opaque colour of this frame, stays on the GPU
+	{
+		StageTimer timer(*this, StageExposure);
+		if (scene.autoExposure)
 		{
-			{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT0, GL_COLOR_BUFFER_BIT, GL_NEAREST },
-			{ GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT1, GL_COLOR_BUFFER_BIT, GL_NEAREST },
-			{ GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT2, GL_COLOR_BUFFER_BIT, GL_NEAREST },
-		});
-	mFramebuffer->InvalidateAttachments({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 });
+			const auto sceneColor = std::dynamic_pointer_cast<const Texture>(mFramebuffer->GetRenderTarget(GL_COLOR_ATTACHMENT0));
+			mAutoExposure.Measure(*sceneColor, !temporalAA, renderSize, deltaSeconds);
+		}
+		else if (mAutoExposure.IsAdapting())
+		{
+			mAutoExposure.SetFixed();
+		}
+		mAutoExposure.Bind();
+	}
 
-	// Draw a full screen triangle for postprocessing/tone mapping and transparency processing
-	mTonemapProgram.Use();
-	try
+	// texture coordinates of the rendered part, clamped to its last texel centres so that the
+	// bilinear upscale does not fetch stale texels outside of it
+	const glm::vec2 targetExtent{ targetSize };
+	const glm::vec4 sourceRect{ glm::vec2{ renderSize } / targetExtent, (glm::vec2{ renderSize } - 0.5f) / targetExtent };
+
+	// Resolve the multisampled targets into the tone mapped output image, with TAA accumulate the frame into the history
+	{
+		StageTimer timer(*this, StageResolve);
+		if (temporalAA)
+		{
+			const auto &history = mHistoryFramebuffers[mHistoryIndex];
+			mHistoryIndex ^= 1;
+			mHistoryFramebuffers[mHistoryIndex]->Bind();
+			const std::vector<std::pair<GLenum, GLuint>> inputs = transparency
+				? std::vector<std::pair<GLenum, GLuint>>{ { GL_COLOR_ATTACHMENT0, 0 }, { GL_COLOR_ATTACHMENT1, 1 }, { GL_COLOR_ATTACHMENT2, 2 }, { GL_COLOR_ATTACHMENT3, 3 } }
+				: std::vector<std::pair<GLenum, GLuint>>{ { GL_COLOR_ATTACHMENT0, 0 }, { GL_COLOR_ATTACHMENT3, 3 } };
+			for (const auto &input : inputs)
+			{
+				std::dynamic_pointer_cast<const Texture>(mFramebuffer->GetRenderTarget(input.first))->BindTextureUnit(input.second);
+			}
+			std::dynamic_pointer_cast<const Texture>(history->GetRenderTarget(GL_COLOR_ATTACHMENT0))->BindTextureUnit(4);
+			ShaderProgram &taaProgram = transparency ? mTaaProgram : mTaaOpaqueProgram;
+			taaProgram.Use();
+			taaProgram.SetVector(0, sourceRect);
+			taaProgram.SetFloat(1, mHistoryValid ? HistoryWeight : 0.0f);
+			mEmptyVao.Render();
+			mHistoryFramebuffers[mHistoryIndex]->Unbind();
+			mHistoryValid = true;
+		}
+		else
+		{
+			// resolve, OIT composition and tone mapping of the rendered part in one compute pass
+			const std::vector<GLenum> attachments = transparency
+				? std::vector<GLenum>{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 }
+				: std::vector<GLenum>{ GL_COLOR_ATTACHMENT0 };
+			for (GLuint unit = 0; unit < attachments.size(); unit++)
+			{
+				std::dynamic_pointer_cast<const Texture>(mFramebuffer->GetRenderTarget(attachments[unit]))->BindTextureUnit(unit);
+			}
+			std::dynamic_pointer_cast<const Texture>(mResolveFramebuffer->GetRenderTarget(GL_COLOR_ATTACHMENT0))
+				->BindImageTexture(0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+			ShaderProgram &resolveProgram = transparency ? mResolveProgram : mResolveOpaqueProgram;
+			resolveProgram.Use();
+			resolveProgram.SetVector(0, renderSize);
+			ShaderProgram::DispatchCompute((renderSize.x + 7) / 8, (renderSize.y + 7) / 8, 1);
+			glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+			mFramebuffer->InvalidateAttachments(attachments);
+		}
+	}
+
+	// Scale the tone mapped image to the output: a blit with MSAA, the tone mapping of the history with TAA
+	{
+		StageTimer timer(*this, StageTonemap);
+		if (temporalAA)
+		{
+			if (nullptr == window)
+			{
+				mOutputFramebuffer->Bind();
+			}
+			glViewport(0, 0, fbWidth, fbHeight);
+			try
+			{
+				const auto attachment0 = mHistoryFramebuffers[mHistoryIndex]->GetRenderTarget(GL_COLOR_ATTACHMENT0);
+				std::dynamic_pointer_cast<const Texture>(attachment0)->BindTextureUnit(0);
+				mTonemapProgram.Use();
+				mTonemapProgram.SetVector(0, sourceRect);
+				mEmptyVao.Render();
+			}
+			catch (std::exception &e)
+			{
+				std::cout << e.what() << std::endl;
+			}
+		}
+		else
+		{
+			const GLuint output = (nullptr == window) ? mOutputFramebuffer->GetId() : 0;
+			mResolveFramebuffer->Blit(glm::ivec2{ 0, 0 }, renderSize, output, glm::ivec2{ 0, 0 }, outputSize,
+									  GL_COLOR_BUFFER_BIT, (renderSize == outputSize) ? GL_NEAREST : GL_LINEAR);
+		}
+	}
+
+	mPrevViewProjection = viewProjectionMatrix;
+	mPrevSkyViewProjection = skyViewProjectionMatrix;
+	mPrevJitter = jitterNdc;
+
+	UniformRing::Instance().EndFrame();
+	const StateCache::Counters stateCounters = state.TakeCounters();
+	mProfiler.setCounter(CounterGlCalls, double(stateCounters.issued));
+	mProfiler.setCounter(CounterGlCallsElided, double(stateCounters.elided));
+	mProfiler.setCounter(CounterLodLevel, double(mLodGovernor.level()));
+	mProfiler.setCounter(CounterRenderScale, double(mDynamicResolution.scale()));
+	mProfiler.endFrame();
+
+	if (nullptr != window)
+	{
+		glfwSwapBuffers(window);
+	}
+	else
+	{
+		mOutputFramebuffer->Unbind();
+	}
+}
+
+bool Renderer::openFrameReport(const std::string& filename)
+{
+	if (!mProfiler.open(filename))
+	{
+		return false;
+	}
+	mGpuTimers.Create(NumStages);
+	std::cout << "Writing frame report to " << filename << std::endl;
+	return true;
+}
+
+Renderer::StageTimer::StageTimer(Renderer& renderer, Stage stage)
+	: m_cpuScope(renderer.mProfiler, stage)
+	, m_gpuTimers(renderer.mGpuTimers)
+	, m_stage(stage)
+{
+	if (m_gpuTimers.IsCreated())
+	{
+		m_gpuTimers.BeginStage(m_stage);
+	}
+}
+
+Renderer::StageTimer::~StageTimer()
+{
+	if (m_gpuTimers.IsCreated())
 	{
-		const auto attachment0 = mResolveFramebuffer->GetRenderTarget(GL_COLOR_ATTACHMENT0);
-		const auto attachment1 = mResolveFramebuffer->GetRenderTarget(GL_COLOR_ATTACHMENT1);
-		const auto attachment2 = mResolveFramebuffer->GetRenderTarget(GL_COLOR_ATTACHMENT2);
-		std::dynamic_pointer_cast<const Texture>(attachment0)->BindTextureUnit(0);
-		std::dynamic_pointer_cast<const Texture>(attachment1)->BindTextureUnit(1);
-		std::dynamic_pointer_cast<const Texture>(attachment2)->BindTextureUnit(2);
-		mEmptyVao.Render();
+		m_gpuTimers.EndStage(m_stage);
 	}
-	catch (std::exception &e)
+}
+
+void Renderer::finish()
+{
+	glFinish();
+}
+
+void Renderer::readFrame(std::vector<unsigned char>& pixels, int& width, int& height)
+{
+	if (nullptr == mOutputFramebuffer)
 	{
-		std::cout << e.what() << std::endl;
+		throw std::runtime_error("Frame read back is available in headless mode only");
 	}
+	const auto &outputRt = mOutputFramebuffer->GetRenderTarget(GL_COLOR_ATTACHMENT0);
+	width = outputRt->GetWidth();
+	height = outputRt->GetHeight();
+
+	const size_t rowSize = size_t(width) * 4;
+	std::vector<unsigned char> rows(rowSize * height);
+	mOutputFramebuffer->Bind();
+	mOutputFramebuffer->SetReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rows.data());
+	mOutputFramebuffer->Unbind();
 
-	glfwSwapBuffers(window);
+	// OpenGL rows start at the bottom
+	pixels.resize(rows.size());
+	for (int y = 0; y < height; y++)
+	{
+		std::copy_n(&rows[(height - 1 - y) * rowSize], rowSize, &pixels[y * rowSize]);
+	}
 }
 
 #ifdef _DEBUG
@@ -13,6 +13,17 @@
 #include "common/utils.hpp"
 #include "common/renderer.hpp"
 #include "common/mesh.hpp"
+#include "common/asteroid_noise.hpp"
+#include "common/asteroid_surface.hpp"
+#include "common/asteroid_field.hpp"
+#include "common/bounding_sphere.hpp"
+#include "common/frame_profiler.hpp"
+#include "common/dynamic_resolution.hpp"
+#include "common/environment_maps.hpp"
+#include "common/hdr_image.hpp"
+#include "common/lod_governor.hpp"
+#include "common/thread_pool.hpp"
+#include "common/shader_preprocessor.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -21,6 +32,12 @@
 #include <glm/gtx/quaternion.hpp>
 
 #include <string>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <array>
+#include <limits>
+#include <chrono>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -29,6 +46,7 @@
 #include <memory>
 #include <algorithm>
 #include <unordered_map>
+#include <filesystem>
 
 namespace OpenGL {
 
@@ -51,6 +69,15 @@ public:
 
 	glm::mat4 GetProjection() { return mProjection; }
 
+	// projection moved by Offset pixels of a ViewportSize viewport, the sub-pixel jitter of temporal anti-aliasing
+	glm::mat4 GetJitteredProjection(glm::vec2 Offset, glm::vec2 ViewportSize)
+	{
+		glm::mat4 projection = mProjection;
+		projection[2][0] -= 2.0f * Offset.x / ViewportSize.x;
+		projection[2][1] -= 2.0f * Offset.y / ViewportSize.y;
+		return projection;
+	}
+
 	glm::mat4 GetView()
 	{
 		return glm::lookAt(mPosition, mPosition + Forward * mRotation, Up * mRotation);//glm::translate(glm::toMat4(mRotation), mPosition);//
@@ -94,22 +121,260 @@ protected:
 	void operator = (const NonCopyable &) = delete;
 };
 
+// Last GL state set through the cache, calls that would not change it are dropped. Objects are
+// forgotten on deletion since GL reuses names; code changing tracked state directly calls Invalidate.
+class StateCache
+{
+public:
+	struct Counters
+	{
+		uint64_t issued = 0;
+		uint64_t elided = 0;
+	};
+
+	// cache of the GL context
+	static StateCache &Instance()
+	{
+		static StateCache cache;
+		return cache;
+	}
+
+	void UseProgram(GLuint Program)
+	{
+		if (track(mProgram, Program))
+		{
+			glUseProgram(Program);
+		}
+	}
+
+	void BindVertexArray(GLuint VertexArray)
+	{
+		if (track(mVertexArray, VertexArray))
+		{
+			glBindVertexArray(VertexArray);
+		}
+	}
+
+	void BindTextureUnit(GLuint Unit, GLuint Texture)
+	{
+		if (Unit >= mTextures.size())
+		{
+			mTextures.resize(Unit + 1, Unknown);
+		}
+		if (track(mTextures[Unit], Texture))
+		{
+			glBindTextureUnit(Unit, Texture);
+		}
+	}
+
+	// Size 0 binds the whole buffer
+	void BindUniformBuffer(GLuint Slot, GLuint Buffer, GLintptr Offset = 0, GLsizeiptr Size = 0)
+	{
+		if (Slot >= mUniformBuffers.size())
+		{
+			mUniformBuffers.resize(Slot + 1);
+		}
+		if (track(mUniformBuffers[Slot], BufferRange{ Buffer, Offset, Size }))
+		{
+			if (0 == Size)
+			{
+				glBindBufferBase(GL_UNIFORM_BUFFER, Slot, Buffer);
+			}
+			else
+			{
+				glBindBufferRange(GL_UNIFORM_BUFFER, Slot, Buffer, Offset, Size);
+			}
+		}
+	}
+
+	void BindFramebuffer(GLuint Framebuffer)
+	{
+		if (track(mFramebuffer, Framebuffer))
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+		}
+	}
+
+	// GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE and other glEnable capabilities
+	void Enable(GLenum Capability, bool Enabled)
+	{
+		if (track(mCapabilities.emplace(Capability, -1).first->second, Enabled ? 1 : 0))
+		{
+			Enabled ? glEnable(Capability) : glDisable(Capability);
+		}
+	}
+
+	void DepthMask(bool Enabled)
+	{
+		if (track(mDepthMask, Enabled ? 1 : 0))
+		{
+			glDepthMask(Enabled ? GL_TRUE : GL_FALSE);
+		}
+	}
+
+	void DepthFunc(GLenum Func)
+	{
+		if (track(mDepthFunc, Func))
+		{
+			glDepthFunc(Func);
+		}
+	}
+
+	void BlendFunc(GLenum SrcFactor, GLenum DstFactor)
+	{
+		if (track(mBlendFunc, std::make_pair(SrcFactor, DstFactor)))
+		{
+			glBlendFunc(SrcFactor, DstFactor);
+		}
+	}
+
+	void ColorMask(bool Enabled)
+	{
+		if (track(mColorMask, Enabled ? 1 : 0))
+		{
+			const GLboolean mask = Enabled ? GL_TRUE : GL_FALSE;
+			glColorMask(mask, mask, mask, mask);
+		}
+	}
+
+	void ForgetProgram(GLuint Program)
+	{
+		forget(mProgram, Program);
+	}
+
+	void ForgetVertexArray(GLuint VertexArray)
+	{
+		forget(mVertexArray, VertexArray);
+	}
+
+	void ForgetTexture(GLuint Texture)
+	{
+		for (GLuint &texture : mTextures)
+		{
+			forget(texture, Texture);
+		}
+	}
+
+	void ForgetBuffer(GLuint Buffer)
+	{
+		for (BufferRange &range : mUniformBuffers)
+		{
+			range = (Buffer == range.buffer) ? BufferRange{} : range;
+		}
+	}
+
+	void ForgetFramebuffer(GLuint Framebuffer)
+	{
+		forget(mFramebuffer, Framebuffer);
+	}
+
+	void Invalidate()
+	{
+		const Counters counters = mCounters;
+		*this = StateCache{};
+		mCounters = counters;
+	}
+
+	// calls issued and elided since the last call
+	Counters TakeCounters()
+	{
+		const Counters counters = mCounters;
+		mCounters = Counters{};
+		return counters;
+	}
+
+protected:
+	static constexpr GLuint Unknown = ~0u;
+
+	struct BufferRange
+	{
+		GLuint buffer = Unknown;
+		GLintptr offset = 0;
+		GLsizeiptr size = 0;
+
+		bool operator == (const BufferRange &Other) const
+		{
+			return buffer == Other.buffer && offset == Other.offset && size == Other.size;
+		}
+	};
+
+	StateCache() = default;
+
+	template <typename V>
+	bool track(V &Current, const V &Value)
+	{
+		if (Current == Value)
+		{
+			mCounters.elided++;
+			return false;
+		}
+		Current = Value;
+		mCounters.issued++;
+		return true;
+	}
+
+	static void forget(GLuint &Current, GLuint Name)
+	{
+		Current = (Name == Current) ? Unknown : Current;
+	}
+
+	GLuint mProgram = Unknown;
+	GLuint mVertexArray = Unknown;
+	GLuint mFramebuffer = Unknown;
+	std::vector<GLuint> mTextures;
+	std::vector<BufferRange> mUniformBuffers;
+	std::unordered_map<GLenum, int> mCapabilities;	// -1 unknown
+	int mDepthMask = -1;
+	GLenum mDepthFunc = Unknown;
+	std::pair<GLenum, GLenum> mBlendFunc { Unknown, Unknown };
+	int mColorMask = -1;
+	Counters mCounters;
+};
+
 class Shader : public NonCopyable
 {
 public:
 	Shader(GLenum ShaderType, const std::string ShaderSourceStr)
 	{
-		// compile shader from file
+		// compile shader from file, the result is checked by CheckStatus so that parallel
+		// compilation is not waited for here
 		mShader = glCreateShader(ShaderType);
 		const GLchar *const p = &ShaderSourceStr[0];
 		glShaderSource(mShader, 1, &p, NULL);
 		glCompileShader(mShader);
+	}
+
+	Shader(Shader &&Other)
+		: mShader(std::move(Other.mShader))
+	{
+		Other.mShader = 0;
+	}
+
+	Shader &operator = (Shader &&Other)
+	{
+		if (&Other != this)
+		{
+			Release();
+
+			std::swap(mShader, Other.mShader);
+		}
+
+		return *this;
+	}
+
+	bool IsUsable() const { return 0 != mShader; }
 
+	// waits for the compilation and prints the info log on failure
+	bool CheckStatus() const
+	{
 		int success;
 		glGetShaderiv(mShader, GL_COMPILE_STATUS, &success);
 
 		if (!success)
 		{
+			GLint type = 0;
+			glGetShaderiv(mShader, GL_SHADER_TYPE, &type);
+			const GLenum ShaderType = GLenum(type);
 			std::vector<char> infoLog(512);
 			glGetShaderInfoLog(mShader, infoLog.size() - 1, NULL, &infoLog[0]);
 			const std::unordered_map<GLenum, std::string> typeNameStr =
@@ -131,108 +396,192 @@ public:
 			{
 				std::cout << e.what() << std::endl;
 			}
-			std::cout << "ERROR:shader compilation failed: " << std::endl << tn << std::endl << &infoLog[0] << std::endl;
+			std::cout << "ERROR:shader compilation failed: " << std::endl << tn << std::endl << &infoLog[0] << std::endl
+					  << "source string numbers:" << std::endl << ShaderPreprocessor::instance().sourceNumbers();
 		}
+		return !!success;
 	}
 
-	Shader(Shader &&Other)
-		: mShader(std::move(Other.mShader))
+	void AttachTo(GLuint Program) const
 	{
-		Other.mShader = 0;
+		glAttachShader(Program, mShader);
 	}
 
-	Shader &operator = (Shader &&Other)
+	// source with includes expanded and #line directives mapping it back to the files
+	static std::string GetFileContents(std::string PathStr)
 	{
-		if (&Other != this)
-		{
-			Release();
+		return ShaderPreprocessor::instance().process(PathStr);
+	}
 
-			std::swap(mShader, Other.mShader);
-		}
+	// #define lines placed after the #version line of Source
+	static std::string AddDefines(const std::string &Source, const std::vector<std::string> &Defines)
+	{
+		return ShaderPreprocessor::addDefines(Source, Defines);
+	}
 
-		return *this;
+	void Release() override
+	{
+		glDeleteShader(mShader);
+		mShader = 0;
 	}
 
-	bool IsUsable() const { return 0 != mShader; }
+protected:
+	GLuint mShader;
+};
 
-	void AttachTo(GLuint Program) const
+// Linked program binaries stored on disk, keyed by the sources of all stages (defines included, they are
+// part of the source) and the driver strings. Binaries the driver rejects are compiled from source again.
+class ProgramCache
+{
+public:
+	using List = std::initializer_list<std::tuple<GLenum, std::string>>;
+
+	static ProgramCache &Instance()
 	{
-		glAttachShader(Program, mShader);
+		static ProgramCache cache;
+		return cache;
 	}
 
-	static std::string GetFileContents(std::string PathStr)
+	// empty directory disables the cache
+	void SetDirectory(const std::string &Directory)
 	{
-		const std::string includeStr = "#include";
-		std::string fileContents = getFileContents(PathStr);
-		std::size_t found = 0;
-		while (std::string::npos != (found = fileContents.find(includeStr, found)))
-		{
-			bool commented1 = found >= 2 && fileContents.substr(found - 2, 2) == "//";
-			bool commented2 = found >= 3 && fileContents.substr(found - 3, 2) == "//";
-			if (!commented1 && !commented2)
-			{
-				std::size_t fnIndex1 = fileContents.find_first_not_of(" \t", found + includeStr.length());
-				const char ch = fileContents[fnIndex1];
-				if (ch != '\"' && ch != '\'')
-				{
-					std::cout << "ERROR:: expecting file name after #include" << std::endl;
-					break;
-				}
-				std::size_t fnIndex2 = fileContents.find_first_of("'\"", fnIndex1 + 1);
-				std::string filename = fileContents.substr(fnIndex1 + 1, fnIndex2 - fnIndex1 - 1);
-				std::size_t fnIndex = PathStr.find_last_of("/\\");
-				if (std::string::npos != fnIndex)
-				{
-					filename = PathStr.substr(0, fnIndex + 1) + filename;
-				}
+		mDirectory = Directory;
+	}
 
-				std::string includeStr = getFileContents(filename);
-				fileContents = fileContents.substr(0, found)
-								+ includeStr
-								+ fileContents.substr(fnIndex2 + 1);
-				found += includeStr.length();
-			}
-			else
-			{
-				found ++;
-			}
+	uint64_t GetKey(const List &ShaderList) const
+	{
+		uint64_t key = ShaderPreprocessor::HashSeed;
+		for (const GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+		{
+			const GLubyte *str = glGetString(name);
+			key = ShaderPreprocessor::hash(str, nullptr != str ? std::strlen(reinterpret_cast<const char *>(str)) : 0, key);
+		}
+		for (const auto &shader : ShaderList)
+		{
+			const GLenum type = std::get<0>(shader);
+			key = ShaderPreprocessor::hash(&type, sizeof(type), key);
+			key = ShaderPreprocessor::hash(std::get<1>(shader), key);
 		}
-		return fileContents;
+		return key;
 	}
 
-	void Release() override
+	// linked program or 0 when the binary is missing or not accepted by the driver
+	GLuint Load(uint64_t Key)
 	{
-		glDeleteShader(mShader);
-		mShader = 0;
+		if (!IsEnabled())
+		{
+			return 0;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		std::ifstream file{ GetFileName(Key), std::ios::binary };
+		if (!file.is_open())
+		{
+			return 0;
+		}
+
+		Header header;
+		std::vector<char> binary;
+		if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))
+			|| 0 != std::memcmp(header.magic, Magic, sizeof(Magic))
+			|| Key != header.key)
+		{
+			return 0;
+		}
+		binary.resize(header.length);
+		if (!file.read(binary.data(), binary.size()))
+		{
+			return 0;
+		}
+
+		GLuint program = glCreateProgram();
+		glProgramBinary(program, header.format, binary.data(), GLsizei(binary.size()));
+		int success;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		mSavedMs += header.compileMs - elapsed.count();
+		std::cout << "Program cache: loaded " << GetFileName(Key) << " in " << elapsed.count() << " ms, "
+				  << header.compileMs << " ms to compile (" << mSavedMs << " ms saved in total)" << std::endl;
+		return program;
 	}
 
-protected:
-	static std::string getFileContents(const std::string PathStr)
+	// stores the binary of a program linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	void Store(uint64_t Key, GLuint Program, double CompileMs)
 	{
-		std::ifstream file;
-		file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
+		if (!IsEnabled())
 		{
-			file.open(PathStr);
-			std::stringstream stream;
-			stream << file.rdbuf();
-			file.close();
-			return stream.str();
+			return;
 		}
-		catch (std::ifstream::failure &e)
+
+		int length = 0;
+		glGetProgramiv(Program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+		{
+			return;
+		}
+		Header header = {};
+		std::memcpy(header.magic, Magic, sizeof(Magic));
+		header.key = Key;
+		header.compileMs = CompileMs;
+		std::vector<char> binary(length);
+		glGetProgramBinary(Program, length, &length, &header.format, binary.data());
+		header.length = uint32_t(length);
+
+		std::error_code error;
+		std::filesystem::create_directories(mDirectory, error);
+		std::ofstream file{ GetFileName(Key), std::ios::binary | std::ios::trunc };
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(binary.data(), length);
+		if (!file.good())
 		{
-			std::cout << "ERROR: Shader::GetFileContents: read failed (" << PathStr << ": " << e.what() << ")" << std::endl;
+			std::cout << "WARNING: could not write program cache " << GetFileName(Key) << std::endl;
 		}
-		return "";
 	}
 
-	GLuint mShader;
+protected:
+	struct Header
+	{
+		char magic[8];
+		uint64_t key;
+		double compileMs;			// source compilation time, reported as saved on load
+		GLenum format;
+		uint32_t length;
+	};
+
+	static constexpr char Magic[8] = { 'G', 'L', 'P', 'R', 'O', 'G', '1', '\0' };
+
+	bool IsEnabled() const
+	{
+		if (mDirectory.empty())
+		{
+			return false;
+		}
+		int formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	std::string GetFileName(uint64_t Key) const
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(Key));
+		return mDirectory + name;
+	}
+
+	std::string mDirectory = "data/cache/programs/";
+	double mSavedMs = 0.0;
 };
 
 class ShaderProgram : public NonCopyable
 {
 public:
-	using List = std::initializer_list<std::tuple<GLenum, std::string>>;
+	using List = ProgramCache::List;
 
 	ShaderProgram()
 		: mProgram(0)
@@ -241,6 +590,7 @@ public:
 
 	ShaderProgram(ShaderProgram &&Other)
 		: mProgram(Other.mProgram)
+		, mPending(std::move(Other.mPending))
 	{
 		Other.mProgram = 0;
 	}
@@ -252,6 +602,7 @@ public:
 			Release();
 
 			std::swap(mProgram, Other.mProgram);
+			std::swap(mPending, Other.mPending);
 		}
 
 		return *this;
@@ -259,19 +610,66 @@ public:
 
 	ShaderProgram(const List &ShaderList)
 	{
+		ProgramCache &cache = ProgramCache::Instance();
+		const uint64_t key = cache.GetKey(ShaderList);
+		mProgram = cache.Load(key);
+		if (0 != mProgram)
+		{
+			return;
+		}
+
 		mProgram = glCreateProgram();
-		std::vector<Shader> shaderList;
+		mPending = std::make_unique<PendingLink>(mProgram, key);
 		for (const auto &shader : ShaderList)
 		{
-			shaderList.emplace_back(std::get<0>(shader), std::get<1>(shader));
+			mPending->shaders.emplace_back(std::get<0>(shader), std::get<1>(shader));
 		}
-		for (const auto &shader : shaderList)
+		for (const auto &shader : mPending->shaders)
 		{
 			shader.AttachTo(mProgram);
 		}
 
+		glProgramParameteri(mProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(mProgram);
 
+		if (!IsParallelCompile())
+		{
+			Finish();
+		}
+	}
+
+	bool IsUsable() const { return 0 != mProgram; }
+
+	// false while the driver still compiles or links the program, never waits
+	bool IsReady() const
+	{
+		if (nullptr == mPending)
+		{
+			return true;
+		}
+		return mPending->Poll();
+	}
+
+	// waits for a link running in the background, reports errors and stores the binary in the cache
+	void Finish() const
+	{
+		if (nullptr == mPending)
+		{
+			return;
+		}
+		const std::unique_ptr<PendingLink> pending = std::move(mPending);
+		if (!IsParallelCompile() || !pending->Poll())
+		{
+			// the link status waits for the link, it is complete when the query returns
+			GLint linked = GL_FALSE;
+			glGetProgramiv(mProgram, GL_LINK_STATUS, &linked);
+			pending->Complete();
+		}
+		for (const auto &shader : pending->shaders)
+		{
+			shader.CheckStatus();
+		}
+
 		int success;
 		glGetProgramiv(mProgram, GL_LINK_STATUS, &success);
 		if (!success)
@@ -280,26 +678,68 @@ public:
 			glGetProgramInfoLog(mProgram, infoLog.size(), NULL, &infoLog[0]);
 			std::cout << "ERROR: shader program compilation failed" << std::endl << &infoLog[0] << std::endl;
 		}
+		else
+		{
+			ProgramCache::Instance().Store(pending->key, mProgram, pending->compileMs);
+		}
 	}
 
-	bool IsUsable() const { return 0 != mProgram; }
-
 	void Use() const
 	{
 		if (IsUsable())
 		{
-			glUseProgram(mProgram);
+			Finish();
+			StateCache::Instance().UseProgram(mProgram);
 		}
 	}
 
-	static void DispatchCompute(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z)
-	{
-		glDispatchCompute(num_groups_x, num_groups_y, num_groups_z);
-	}
-
-	void Release() override
+	// GL_KHR_parallel_shader_compile (or the ARB variant): compiles and links run on driver threads and
+	// programs are waited for on first use; Loader is the one the GL functions were loaded with
+	static void EnableParallelCompile(GLADloadproc Loader)
 	{
-		glDeleteProgram(mProgram);
+		typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+		MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+		if (HasExtension("GL_KHR_parallel_shader_compile"))
+		{
+			maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(Loader("glMaxShaderCompilerThreadsKHR"));
+		}
+		else if (HasExtension("GL_ARB_parallel_shader_compile"))
+		{
+			maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(Loader("glMaxShaderCompilerThreadsARB"));
+		}
+		IsParallelCompile() = nullptr != maxShaderCompilerThreads;
+		if (nullptr != maxShaderCompilerThreads)
+		{
+			maxShaderCompilerThreads(0xFFFFFFFFu);		// as many threads as the driver likes
+		}
+	}
+
+	static bool &IsParallelCompile()
+	{
+		static bool enabled = false;
+		return enabled;
+	}
+
+	// with parallel compilation, notes the programs the driver finished since the last call, so their
+	// compile times end there and not when they are first used; called while the loader waits
+	static void PollPending()
+	{
+		for (PendingLink *pending : PendingLink::All())
+		{
+			pending->Poll();
+		}
+	}
+
+	static void DispatchCompute(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z)
+	{
+		glDispatchCompute(num_groups_x, num_groups_y, num_groups_z);
+	}
+
+	void Release() override
+	{
+		mPending = nullptr;
+		StateCache::Instance().ForgetProgram(mProgram);
+		glDeleteProgram(mProgram);
 		mProgram = 0;
 	}
 
@@ -308,6 +748,11 @@ public:
 		glProgramUniform1f(mProgram, location, v0);
 	}
 
+	void SetInt(GLint location, GLint v0)
+	{
+		glProgramUniform1i(mProgram, location, v0);
+	}
+
 	void SetVector(GLint location, glm::vec2 v0)
 	{
 		glProgramUniform2f(mProgram, location, v0.x, v0.y);
@@ -323,8 +768,89 @@ public:
 		glProgramUniform4f(mProgram, location, v0.x, v0.y, v0.z, v0.w);
 	}
 
+	void SetVector(GLint location, glm::ivec2 v0)
+	{
+		glProgramUniform2i(mProgram, location, v0.x, v0.y);
+	}
+
 protected:
+	// GL_COMPLETION_STATUS_KHR, same value for the ARB extension
+	static constexpr GLenum CompletionStatus = 0x91B1;
+
+	// shaders and cache key of a link that has not been checked yet, compileMs is negative until the
+	// completion status or the link status reported the link as done
+	struct PendingLink
+	{
+		PendingLink(GLuint Program, uint64_t Key)
+			: program(Program), key(Key), start(std::chrono::steady_clock::now())
+		{
+			All().push_back(this);
+		}
+
+		~PendingLink()
+		{
+			std::vector<PendingLink *> &all = All();
+			all.erase(std::remove(all.begin(), all.end(), this), all.end());
+		}
+
+		PendingLink(const PendingLink &) = delete;
+		PendingLink &operator = (const PendingLink &) = delete;
+
+		// true once the link is done, never waits
+		bool Poll()
+		{
+			if (compileMs < 0.0)
+			{
+				GLint done = GL_FALSE;
+				glGetProgramiv(program, CompletionStatus, &done);
+				if (GL_FALSE != done)
+				{
+					Complete();
+				}
+			}
+			return compileMs >= 0.0;
+		}
+
+		void Complete()
+		{
+			if (compileMs < 0.0)
+			{
+				compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+		}
+
+		// links of all programs in flight, only touched on the GL thread; never destroyed, static programs
+		// may still hold a pending link when the statics are torn down
+		static std::vector<PendingLink *> &All()
+		{
+			static std::vector<PendingLink *> *all = new std::vector<PendingLink *>;
+			return *all;
+		}
+
+		GLuint program;
+		uint64_t key;
+		std::chrono::steady_clock::time_point start;
+		double compileMs = -1.0;
+		std::vector<Shader> shaders;
+	};
+
+	static bool HasExtension(const char *Name)
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++)
+		{
+			const GLubyte *extension = glGetStringi(GL_EXTENSIONS, GLuint(i));
+			if (nullptr != extension && 0 == std::strcmp(reinterpret_cast<const char *>(extension), Name))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
 	GLuint mProgram;
+	mutable std::unique_ptr<PendingLink> mPending;
 };
 
 class RenderTarget : public NonCopyable
@@ -453,9 +979,21 @@ public:
 		}
 	}
 
+	// GL_TEXTURE_2D_MULTISAMPLE target, samples are read with texelFetch
+	void StorageMultisample(GLenum InternalFormat, GLint Width, GLint Height, GLint Samples)
+	{
+		if (0 == mWidth && 0 == mHeight)
+		{
+			glTextureStorage2DMultisample(mId, Samples, InternalFormat, Width, Height, GL_TRUE);
+			mWidth = Width;
+			mHeight = Height;
+			mLevels = 1;
+		}
+	}
+
 	void BindTextureUnit(GLuint unit) const
 	{
-		glBindTextureUnit(unit, mId);
+		StateCache::Instance().BindTextureUnit(unit, mId);
 	}
 
 	void BindImageTexture(GLuint Unit, GLint Level, GLboolean Layered, GLint Layer, GLenum Access, GLenum Format) const
@@ -468,6 +1006,30 @@ public:
 		glGenerateTextureMipmap(mId);
 	}
 
+	// rows of a 2D texture; DataPtr is an offset when a pixel unpack buffer is bound
+	void SubImage2D(GLint Level, GLint X, GLint Y, GLsizei Width, GLsizei Height, GLenum Format, GLenum Type, const void *DataPtr) const
+	{
+		glTextureSubImage2D(mId, Level, X, Y, Width, Height, Format, Type, DataPtr);
+	}
+
+	// Layer is the face of a cube map or the layer of an array texture
+	void SubImage(GLint Level, GLint Layer, GLsizei Width, GLsizei Height, GLenum Format, GLenum Type, const void *DataPtr) const
+	{
+		glTextureSubImage3D(mId, Level, 0, 0, Layer, Width, Height, 1, Format, Type, DataPtr);
+	}
+
+	// Layers consecutive faces or layers starting at Layer
+	void SubImage(GLint Level, GLint Layer, GLsizei Width, GLsizei Height, GLsizei Layers, GLenum Format, GLenum Type, const void *DataPtr) const
+	{
+		glTextureSubImage3D(mId, Level, 0, 0, Layer, Width, Height, Layers, Format, Type, DataPtr);
+	}
+
+	// all faces or layers of a level, waits for the GPU
+	void GetImage(GLint Level, GLenum Format, GLenum Type, GLsizei BufSize, void *DataPtr) const
+	{
+		glGetTextureImage(mId, Level, Format, Type, BufSize, DataPtr);
+	}
+
 	void CopyImageSubData(GLenum SrcTarget, GLint SrcLevel, GLint SrcX, GLint SrcY, GLint SrcZ,
 		const Texture &DstTex, GLenum DstTarget, GLint DstLevel, GLint DstX, GLint DstY, GLint DstZ,
 		GLsizei SrcDepth) const
@@ -481,10 +1043,17 @@ public:
 		glTextureParameteri(mId, GL_TEXTURE_WRAP_T, WrapT);
 	}
 
+	void SetFilter(GLint MinFilter, GLint MagFilter) const
+	{
+		glTextureParameteri(mId, GL_TEXTURE_MIN_FILTER, MinFilter);
+		glTextureParameteri(mId, GL_TEXTURE_MAG_FILTER, MagFilter);
+	}
+
 	void Release() override
 	{
 		if (0 != mId)
 		{
+			StateCache::Instance().ForgetTexture(mId);
 			glDeleteTextures(1, &mId);
 			mId = 0;
 			RenderTarget::Release();
@@ -514,414 +1083,876 @@ protected:
 	GLint mLevels;
 };
 
-class Environment : public Texture
+class Renderbuffer : public RenderTarget
 {
+public:
+	Renderbuffer()
+		: RenderTarget()
+	{
+		glCreateRenderbuffers(1, &mId);
+	}
+
+	~Renderbuffer() override { Release(); }
+
+	Renderbuffer(Renderbuffer &&Other)
+		: RenderTarget(std::move(Other))
+	{
+	}
+
+	Renderbuffer &operator = (Renderbuffer &&Other)
+	{
+		if (&Other != this)
+		{
+			Release();
+
+			RenderTarget::operator = (std::move(Other));
+		}
+
+		return *this;
+	}
+
+	void AttachTo(GLuint Fb, GLenum Attachment) const override
+	{
+		glNamedFramebufferRenderbuffer(Fb, Attachment, GL_RENDERBUFFER, mId);
+	}
+
+	void Storage(GLenum Format, GLint Width, GLint Height, GLint Samples = 0)
+	{
+		if (Samples > 0)
+		{
+			glNamedRenderbufferStorageMultisample(mId, Samples, Format, Width, Height);
+		}
+		else
+		{
+			glNamedRenderbufferStorage(mId, Format, Width, Height);
+		}
+		mWidth = Width;
+		mHeight = Height;
+	}
+
+	void Release() override
+	{
+		if (0 != mId)
+		{
+			glDeleteRenderbuffers(1, &mId);
+			mId = 0;
+			RenderTarget::Release();
+		}
+	}
+
 protected:
-	static constexpr int kEnvMapSize = 1024;
-	static constexpr int kIrradianceMapSize = 32;
-	static constexpr int kBRDF_LUT_Size = 256;
+};
 
+class Framebuffer : public NonCopyable
+{
+protected:
+	enum RenderTargetType { TypeRenderBuffer = 0, TypeTexture, TypeTextureMultisample };
 public:
-	Environment()
-		: Texture() {}
+	Framebuffer()
+	{
+		glCreateFramebuffers(1, &mId);
+	}
 
-	~Environment() override { Release(); }
+	~Framebuffer() override { Release(); }
 
-	Environment(Environment &&Other)
-		: Texture(std::move(Other))
-			, mIrmap(std::move(Other.mIrmap))
-			, mSpBrdfLut(std::move(Other.mSpBrdfLut))
+	Framebuffer(Framebuffer &&Other)
+		: mId(Other.mId)
 	{
+		Other.mId = 0;
 	}
 
-	Environment &operator = (Environment &&Other)
+	Framebuffer & operator = (Framebuffer && Other)
 	{
 		if (&Other != this)
 		{
 			Release();
 
-			Texture::operator = (std::move(Other));
-			mIrmap = std::move(Other.mIrmap);
-			mSpBrdfLut = std::move(Other.mSpBrdfLut);
+			std::swap(mId, Other.mId);
 		}
 		return *this;
 	}
 
-	Environment(const std::shared_ptr<class Image>& Img)
-		: Texture(GL_TEXTURE_CUBE_MAP, kEnvMapSize, kEnvMapSize, GL_RGBA16F)
-	{	//------------------------------------------------------------------------------------------------------------------
-		Texture envTextureEquirect{ Img, GL_RGB, GL_RGB16F, 1 };
-		Texture envTextureUnfiltered{ GL_TEXTURE_CUBE_MAP, kEnvMapSize, kEnvMapSize, GL_RGBA16F };
-		ShaderProgram equirectToCubeProgram =
-			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/equirect2cube_cs.glsl")) }};
+	GLuint GetId() { return mId; }
 
-		equirectToCubeProgram.Use();
-		envTextureEquirect.BindTextureUnit(0);
-		envTextureUnfiltered.BindImageTexture(0, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	void Bind()
+	{
+		StateCache::Instance().BindFramebuffer(mId);
+	}
 
-		ShaderProgram::DispatchCompute(envTextureUnfiltered.GetWidth() / 32, envTextureUnfiltered.GetHeight() / 32, 6);
+	void Unbind()
+	{
+		StateCache::Instance().BindFramebuffer(0);
+	}
 
-		envTextureEquirect.Release();
-		equirectToCubeProgram.Release();
-		envTextureUnfiltered.GenerateMipmap();
-		//-------------------------------------------------------------------------------------------------------------------
-		ShaderProgram spmapProgram =
-			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/spmap_cs.glsl")) }};
+	void AttachRenderbuffer(GLenum Attachment, GLenum Format, GLint Width, GLint Height, GLint Samples = 0)
+	{
+		mRbParams[Attachment] = std::make_tuple(RenderTargetType::TypeRenderBuffer, Format, Samples);
+		recreateIfNeeded(Attachment, Width, Height);
+		updateDrawBuffers();
+	}
 
-		// Copy 0th mipmap level into destination environment map
-		envTextureUnfiltered.CopyImageSubData(GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0, /*m_envTexture*/
-											  *this, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0, 6);
+	void AttachTexture(GLenum Attachment, GLenum Format, GLint Width, GLint Height)
+	{
+		mRbParams[Attachment] = std::make_tuple(RenderTargetType::TypeTexture, Format, 0);
+		recreateIfNeeded(Attachment, Width, Height);
+		updateDrawBuffers();
+	}
 
-		spmapProgram.Use();
-		envTextureUnfiltered.BindTextureUnit(0);
+	// multisampled attachment that shaders can read, unlike a renderbuffer
+	void AttachMultisampleTexture(GLenum Attachment, GLenum Format, GLint Width, GLint Height, GLint Samples)
+	{
+		mRbParams[Attachment] = std::make_tuple(RenderTargetType::TypeTextureMultisample, Format, Samples);
+		recreateIfNeeded(Attachment, Width, Height);
+		updateDrawBuffers();
+	}
 
-		// Pre-filter rest of the mip chain.
-		const float deltaRoughness = 1.0f / glm::max(float(/*m_envTexture.*/this->GetLevels() - 1), 1.0f);
-		for (int level = 1, size = kEnvMapSize / 2; level <= /*m_envTexture.*/this->GetLevels(); ++level, size /= 2)
+	void ResizeAll(GLint Width, GLint Height)
+	{
+		for (const auto &rb : mRenderbuffers)
 		{
-			const GLuint numGroups = glm::max(1, size / 32);
-			/*m_envTexture.*/this->BindImageTexture(0, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
-			spmapProgram.SetFloat(0, level * deltaRoughness);
-			ShaderProgram::DispatchCompute(numGroups, numGroups, 6);
+			recreateIfNeeded(rb.first, Width, Height);
 		}
-		spmapProgram.Release();
-		envTextureUnfiltered.Release();
-		//-------------------------------------------------------------------------------------------------------------------
-		mIrmap = Texture{ GL_TEXTURE_CUBE_MAP, kIrradianceMapSize, kIrradianceMapSize, GL_RGBA16F, 1 };
+	}
 
-		ShaderProgram irmapProgram =
-			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/irmap_cs.glsl")) }};
+	const std::shared_ptr<const RenderTarget> GetRenderTarget(GLenum Attachment) const
+	{
+		return mRenderbuffers.at(Attachment);
+	}
 
-		irmapProgram.Use();
-		/*m_envTexture.*/BindTextureUnit(0);
-		mIrmap.BindImageTexture(0, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
-		ShaderProgram::DispatchCompute(mIrmap.GetWidth() / 32, mIrmap.GetHeight() / 32, 6);
-		irmapProgram.Release();
-		//-------------------------------------------------------------------------------------------------------------------
-		mSpBrdfLut = Texture{ GL_TEXTURE_2D, kBRDF_LUT_Size, kBRDF_LUT_Size, GL_RG16F, 1 };
-		mSpBrdfLut.SetWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+	GLenum CheckStatus() const
+	{
+		return glCheckNamedFramebufferStatus(mId, GL_DRAW_FRAMEBUFFER);
+	}
 
-		ShaderProgram spBRDFProgram =
-			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/spbrdf_cs.glsl")) }};
+	void Blit(glm::ivec2 SrcP0, glm::ivec2 SrcP1, const Framebuffer& Dst, glm::ivec2 DstP0, glm::ivec2 DstP1, GLbitfield Mask, GLenum Filter) const
+	{
+		Blit(SrcP0, SrcP1, Dst.mId, DstP0, DstP1, Mask, Filter);
+	}
 
-		spBRDFProgram.Use();
-		mSpBrdfLut.BindImageTexture(0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
-		ShaderProgram::DispatchCompute(mSpBrdfLut.GetWidth() / 32, mSpBrdfLut.GetHeight() / 32, 1);
-		spBRDFProgram.Release();
-		//-------------------------------------------------------------------------------------------------------------------
-		glFinish();
+	// DstId 0 is the default framebuffer of the window
+	void Blit(glm::ivec2 SrcP0, glm::ivec2 SrcP1, GLuint DstId, glm::ivec2 DstP0, glm::ivec2 DstP1, GLbitfield Mask, GLenum Filter) const
+	{
+		glBlitNamedFramebuffer(mId, DstId, SrcP0.x, SrcP0.y, SrcP1.x, SrcP1.y, DstP0.x, DstP0.y, DstP1.x, DstP1.y, Mask, Filter);
 	}
 
-	void Release() override
+	void InvalidateAttachments(std::vector<GLenum> Attachments) const
 	{
-		Texture::Release();
-		mIrmap.Release();
-		mSpBrdfLut.Release();
+		glInvalidateNamedFramebufferData(mId, GLsizei(Attachments.size()), (Attachments.size() > 0) ? &Attachments[0] : nullptr);
 	}
 
-	const Texture &GetIrmapTexture() const { return mIrmap; }
-	const Texture &GetSpBrdfLutTexture() const { return mSpBrdfLut; }
+	void SetReadBuffer(GLenum Attachment) const
+	{
+		glNamedFramebufferReadBuffer(mId, Attachment);
+	}
+
+	void SetDrawBuffer(GLenum Attachment) const
+	{
+		glNamedFramebufferDrawBuffer(mId, Attachment);
+	}
+
+	void SetDrawBuffers(std::vector<GLenum> Buffers) const
+	{
+		glNamedFramebufferDrawBuffers(mId, Buffers.size(), Buffers.size() ? &Buffers[0] : nullptr);
+	}
+
+	void Resolve(const Framebuffer& Dst, std::vector<std::tuple<GLenum, GLenum, GLbitfield, GLenum>> List) const
+	{
+		const auto &rt = GetRenderTarget(std::get<0>(List.at(0)));
+		Resolve(Dst, glm::ivec2{ rt->GetWidth(), rt->GetHeight() }, List);
+	}
+
+	// resolves only the lower left Size pixels, the rendered part of targets larger than the viewport
+	void Resolve(const Framebuffer& Dst, glm::ivec2 Size, std::vector<std::tuple<GLenum, GLenum, GLbitfield, GLenum>> List) const
+	{
+		for (const auto & copyParams: List)
+		{
+			auto attach1 = std::get<0>(copyParams);
+			auto attach2 = std::get<1>(copyParams);
+			auto bitfieldMask = std::get<2>(copyParams);
+			auto filter = std::get<3>(copyParams);
+			SetReadBuffer(attach1);
+			Dst.SetDrawBuffer(attach2);
+			Blit(glm::ivec2{0, 0}, Size, Dst, glm::ivec2{0, 0}, Size, bitfieldMask, filter);
+		}
+	}
+
+	void Release() override
+	{
+		if (0 != mId)
+		{
+			mRenderbuffers.clear();
+			StateCache::Instance().ForgetFramebuffer(mId);
+			glDeleteFramebuffers(1, &mId);
+			mId = 0;
+		}
+	}
 
 protected:
-	Texture mIrmap, mSpBrdfLut;
+	void updateDrawBuffers()
+	{
+		std::vector<GLenum> buffers;
+		for (const auto &buffer : mRenderbuffers)
+		{
+			if (GL_DEPTH_ATTACHMENT != buffer.first)
+			{
+				buffers.emplace_back(buffer.first);
+			}
+		}
+		glNamedFramebufferDrawBuffers(mId, buffers.size(), buffers.size() ? &buffers[0] : nullptr);
+	}
+
+	void recreateIfNeeded(GLenum Attachment, GLint Width, GLint Height)
+	{
+		if (0 == mRenderbuffers.count(Attachment)
+			|| mRenderbuffers[Attachment]->GetWidth() != Width
+			|| mRenderbuffers[Attachment]->GetHeight() != Height)
+		{
+			const auto &params = mRbParams[Attachment];
+			const auto type = std::get<0>(params);
+			const auto format = std::get<1>(params);
+			const auto samples = std::get<2>(params);
+			switch (type)
+			{
+				case RenderTargetType::TypeRenderBuffer:
+					{
+						auto renderbufferPtr = std::make_shared<Renderbuffer>();
+						mRenderbuffers[Attachment] = std::static_pointer_cast<RenderTarget>(renderbufferPtr);
+						renderbufferPtr->Storage(format, Width, Height, samples);
+					}
+					break;
+				case RenderTargetType::TypeTexture:
+					{
+						auto texturePtr = std::make_shared<Texture>(GL_TEXTURE_2D);
+						mRenderbuffers[Attachment] = std::static_pointer_cast<RenderTarget>(texturePtr);
+						texturePtr->Storage(format, Width, Height, 1);
+					}
+					break;
+				case RenderTargetType::TypeTextureMultisample:
+					{
+						auto texturePtr = std::make_shared<Texture>(GL_TEXTURE_2D_MULTISAMPLE);
+						mRenderbuffers[Attachment] = std::static_pointer_cast<RenderTarget>(texturePtr);
+						texturePtr->StorageMultisample(format, Width, Height, samples);
+					}
+					break;
+			}
+			mRenderbuffers[Attachment]->AttachTo(mId, Attachment);
+		}
+	}
+
+	GLuint mId;
+	std::unordered_map<GLenum, std::shared_ptr<RenderTarget>> mRenderbuffers;
+	std::unordered_map<GLenum, std::tuple<RenderTargetType, GLenum, GLint>> mRbParams;
 };
 
-class Renderbuffer : public RenderTarget
+// Per frame uniform data: one persistently mapped buffer split into FramesInFlight segments. Binding
+// copies into the segment of the current frame and binds that range; a segment is written again
+// only after the fence of the frame that last used it has signalled.
+class UniformRing : public NonCopyable
 {
 public:
-	Renderbuffer()
-		: RenderTarget()
+	static constexpr int FramesInFlight = 3;
+	static constexpr GLsizeiptr SegmentSize = 64 * 1024;
+
+	// ring of the GL context, used by UniformBuffer::Bind once created
+	static UniformRing &Instance()
 	{
-		glCreateRenderbuffers(1, &mId);
+		static UniformRing ring;
+		return ring;
 	}
 
-	~Renderbuffer() override { Release(); }
+	~UniformRing() override { Release(); }
 
-	Renderbuffer(Renderbuffer &&Other)
-		: RenderTarget(std::move(Other))
+	void Create()
 	{
+		Release();
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		mAlignment = alignment;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, &mId);
+		glNamedBufferStorage(mId, FramesInFlight * SegmentSize, nullptr, flags);
+		mMapped = static_cast<GLubyte*>(glMapNamedBufferRange(mId, 0, FramesInFlight * SegmentSize, flags));
 	}
 
-	Renderbuffer &operator = (Renderbuffer &&Other)
+	bool IsCreated() const { return nullptr != mMapped; }
+
+	void BeginFrame()
+	{
+		if (!IsCreated())
+		{
+			return;
+		}
+		mSegment = (mSegment + 1) % FramesInFlight;
+		GLsync &fence = mFences[mSegment];
+		if (nullptr != fence)
+		{
+			while (GL_TIMEOUT_EXPIRED == glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000))
+			{
+			}
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+		mOffset = 0;
+		mInFrame = true;
+	}
+
+	void EndFrame()
+	{
+		if (mInFrame)
+		{
+			mFences[mSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			mInFrame = false;
+		}
+	}
+
+	// false outside of a frame or when the segment is full, the caller then uploads on its own
+	bool Bind(GLuint Slot, const void *Data, GLsizeiptr Size)
+	{
+		const GLsizeiptr offset = (mOffset + mAlignment - 1) / mAlignment * mAlignment;
+		if (!mInFrame || offset + Size > SegmentSize)
+		{
+			return false;
+		}
+		const GLintptr start = mSegment * SegmentSize + offset;
+		std::memcpy(mMapped + start, Data, Size);
+		StateCache::Instance().BindUniformBuffer(Slot, mId, start, Size);
+		mOffset = offset + Size;
+		return true;
+	}
+
+	void Release() override
+	{
+		for (GLsync &fence : mFences)
+		{
+			if (nullptr != fence)
+			{
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+		if (0 != mId)
+		{
+			StateCache::Instance().ForgetBuffer(mId);
+			glUnmapNamedBuffer(mId);
+			glDeleteBuffers(1, &mId);
+		}
+		mId = 0;
+		mMapped = nullptr;
+		mInFrame = false;
+	}
+
+protected:
+	UniformRing() = default;
+
+	GLuint mId = 0;
+	GLubyte *mMapped = nullptr;
+	GLsizeiptr mAlignment = 256;
+	GLsizeiptr mOffset = 0;
+	int mSegment = 0;
+	bool mInFrame = false;
+	std::array<GLsync, FramesInFlight> mFences {};
+};
+
+template <class T>
+class UniformBuffer : public NonCopyable
+{
+public:
+	UniformBuffer()
+		: mId(0)
+	{}
+
+	UniformBuffer(UniformBuffer &&Other)
+		: mId(Other.mId)
+	{
+		Other.mId = 0;
+	}
+
+	UniformBuffer &operator = (UniformBuffer &&Other)
 	{
 		if (&Other != this)
 		{
 			Release();
 
-			RenderTarget::operator = (std::move(Other));
+			std::swap(mId, Other.mId);
 		}
-
 		return *this;
 	}
 
-	void AttachTo(GLuint Fb, GLenum Attachment) const override
+	void Create()
 	{
-		glNamedFramebufferRenderbuffer(Fb, Attachment, GL_RENDERBUFFER, mId);
+		mId = -1;
+		glCreateBuffers(1, &mId);
+		glNamedBufferStorage(mId, sizeof(T), nullptr, GL_DYNAMIC_STORAGE_BIT);
 	}
 
-	void Storage(GLenum Format, GLint Width, GLint Height, GLint Samples = 0)
+	void Update()
 	{
-		if (Samples > 0)
+		glNamedBufferSubData(mId, 0, sizeof(T), &mData);
+	}
+
+	// through the uniform ring during a frame, own storage otherwise
+	void Bind(GLuint Slot)
+	{
+		if (UniformRing::Instance().Bind(Slot, &mData, sizeof(T)))
 		{
-			glNamedRenderbufferStorageMultisample(mId, Samples, Format, Width, Height);
+			return;
 		}
-		else
+		if (0 == mId)
 		{
-			glNamedRenderbufferStorage(mId, Format, Width, Height);
+			Create();
 		}
-		mWidth = Width;
-		mHeight = Height;
+		Update();
+		StateCache::Instance().BindUniformBuffer(Slot, mId);
 	}
 
+	T &GetReference() { return mData; }
+
 	void Release() override
 	{
-		if (0 != mId)
+		if (-1 != mId)
 		{
-			glDeleteRenderbuffers(1, &mId);
-			mId = 0;
-			RenderTarget::Release();
+			StateCache::Instance().ForgetBuffer(mId);
+			glDeleteBuffers(1, &mId);
 		}
+		mId = 0;
 	}
 
 protected:
+	GLuint mId;
+	T mData;
 };
 
-class Framebuffer : public NonCopyable
+// GL_TIMESTAMP queries around the stages of a frame. Queries of the last FramesInFlight frames are kept
+// in a ring and read only once available, so timing never waits for the GPU.
+class GpuTimerRing : public NonCopyable
 {
+public:
+	static constexpr int FramesInFlight = 4;
+
+	GpuTimerRing()
+		: mNumStages(0), mCurrent(0)
+	{}
+
+	~GpuTimerRing() override { Release(); }
+
+	void Create(int NumStages)
+	{
+		Release();
+		mNumStages = NumStages;
+		for (Slot &slot : mSlots)
+		{
+			slot.Queries.resize(2 * NumStages);
+			glCreateQueries(GL_TIMESTAMP, GLsizei(slot.Queries.size()), slot.Queries.data());
+			slot.Used.assign(NumStages, false);
+			slot.Pending = false;
+		}
+	}
+
+	bool IsCreated() const { return mNumStages > 0; }
+
+	// reuses the oldest slot, its results are delivered first (Dropped when the GPU is that far behind)
+	template <typename ReadyFunc, typename DroppedFunc>
+	void BeginFrame(uint64_t Frame, ReadyFunc Ready, DroppedFunc Dropped)
+	{
+		mCurrent = (mCurrent + 1) % FramesInFlight;
+		Collect(Ready);
+		Slot &slot = mSlots[mCurrent];
+		if (slot.Pending)
+		{
+			Dropped(slot.Frame);
+		}
+		slot.Frame = Frame;
+		slot.Pending = true;
+		std::fill(slot.Used.begin(), slot.Used.end(), false);
+	}
+
+	void BeginStage(int Stage)
+	{
+		Slot &slot = mSlots[mCurrent];
+		slot.Used[Stage] = true;
+		glQueryCounter(slot.Queries[2 * Stage], GL_TIMESTAMP);
+	}
+
+	void EndStage(int Stage)
+	{
+		glQueryCounter(mSlots[mCurrent].Queries[2 * Stage + 1], GL_TIMESTAMP);
+	}
+
+	// delivers milliseconds per stage (NaN for stages not issued) of every finished frame, oldest first
+	template <typename ReadyFunc>
+	void Collect(ReadyFunc Ready)
+	{
+		for (int i = 1; i <= FramesInFlight; i++)
+		{
+			Slot &slot = mSlots[(mCurrent + i) % FramesInFlight];
+			if (!slot.Pending)
+			{
+				continue;
+			}
+			const int lastIssued = LastIssued(slot);
+			GLint available = GL_TRUE;
+			if (lastIssued >= 0)
+			{
+				glGetQueryObjectiv(slot.Queries[lastIssued], GL_QUERY_RESULT_AVAILABLE, &available);
+			}
+			if (GL_FALSE == available)
+			{
+				break;			// later frames can not be done either
+			}
+			std::vector<double> times(mNumStages, std::numeric_limits<double>::quiet_NaN());
+			for (int stage = 0; stage < mNumStages; stage++)
+			{
+				if (slot.Used[stage])
+				{
+					GLuint64 begin = 0, end = 0;
+					glGetQueryObjectui64v(slot.Queries[2 * stage], GL_QUERY_RESULT, &begin);
+					glGetQueryObjectui64v(slot.Queries[2 * stage + 1], GL_QUERY_RESULT, &end);
+					times[stage] = double(end - begin) * 1e-6;
+				}
+			}
+			slot.Pending = false;
+			Ready(slot.Frame, times);
+		}
+	}
+
+	void Release() override
+	{
+		for (Slot &slot : mSlots)
+		{
+			if (!slot.Queries.empty())
+			{
+				glDeleteQueries(GLsizei(slot.Queries.size()), slot.Queries.data());
+			}
+			slot.Queries.clear();
+			slot.Pending = false;
+		}
+		mNumStages = 0;
+	}
+
 protected:
-	enum RenderTargetType { TypeRenderBuffer = 0, TypeTexture };
+	struct Slot
+	{
+		std::vector<GLuint> Queries;	// begin and end timestamp of each stage
+		std::vector<bool> Used;
+		uint64_t Frame = 0;
+		bool Pending = false;
+	};
+
+	int LastIssued(const Slot &Frame) const
+	{
+		// results become available in submission order, so the last issued query tells about the whole frame
+		for (int stage = mNumStages - 1; stage >= 0; stage--)
+		{
+			if (Frame.Used[stage])
+			{
+				return 2 * stage + 1;
+			}
+		}
+		return -1;
+	}
+
+	std::array<Slot, FramesInFlight> mSlots;
+	int mNumStages;
+	int mCurrent;
+};
+
+// shader storage buffer with data known at creation time, immutable unless created with GL_DYNAMIC_STORAGE_BIT
+class StorageBuffer : public NonCopyable
+{
 public:
-	Framebuffer()
+	StorageBuffer()
+		: mId(0), mSize(0)
+	{}
+
+	// Flags of glNamedBufferStorage, GL_DYNAMIC_STORAGE_BIT allows Update
+	StorageBuffer(const void *Data, GLsizeiptr Size, GLbitfield Flags = 0)
+		: mId(0), mSize(Size)
 	{
-		glCreateFramebuffers(1, &mId);
+		glCreateBuffers(1, &mId);
+		glNamedBufferStorage(mId, Size, Data, Flags);
 	}
 
-	~Framebuffer() override { Release(); }
-
-	Framebuffer(Framebuffer &&Other)
-		: mId(Other.mId)
+	StorageBuffer(StorageBuffer &&Other)
+		: mId(Other.mId), mSize(Other.mSize)
 	{
 		Other.mId = 0;
+		Other.mSize = 0;
 	}
 
-	Framebuffer & operator = (Framebuffer && Other)
+	StorageBuffer &operator = (StorageBuffer &&Other)
 	{
 		if (&Other != this)
 		{
 			Release();
 
 			std::swap(mId, Other.mId);
+			std::swap(mSize, Other.mSize);
 		}
 		return *this;
 	}
 
-	GLuint GetId() { return mId; }
+	~StorageBuffer() { Release(); }
 
-	void Bind()
+	void Bind(GLuint Slot) const
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, mId);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, Slot, mId);
 	}
 
-	void Unbind()
+	// whole buffer as a uniform block, e.g. results of a compute pass read by shading
+	void BindUniform(GLuint Slot) const
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		StateCache::Instance().BindUniformBuffer(Slot, mId);
 	}
 
-	void AttachRenderbuffer(GLenum Attachment, GLenum Format, GLint Width, GLint Height, GLint Samples = 0)
+	// non indexed targets, e.g. GL_DRAW_INDIRECT_BUFFER
+	void BindTarget(GLenum Target) const
 	{
-		mRbParams[Attachment] = std::make_tuple(RenderTargetType::TypeRenderBuffer, Format, Samples);
-		recreateIfNeeded(Attachment, Width, Height);
-		updateDrawBuffers();
+		glBindBuffer(Target, mId);
 	}
 
-	void AttachTexture(GLenum Attachment, GLenum Format, GLint Width, GLint Height)
+	void Update(GLintptr Offset, GLsizeiptr Size, const void *Data)
 	{
-		mRbParams[Attachment] = std::make_tuple(RenderTargetType::TypeTexture, Format, 0);
-		recreateIfNeeded(Attachment, Width, Height);
-		updateDrawBuffers();
+		glNamedBufferSubData(mId, Offset, Size, Data);
 	}
 
-	void ResizeAll(GLint Width, GLint Height)
+	// waits for the GPU
+	void GetData(GLintptr Offset, GLsizeiptr Size, void *Data) const
 	{
-		for (const auto &rb : mRenderbuffers)
-		{
-			recreateIfNeeded(rb.first, Width, Height);
-		}
+		glGetNamedBufferSubData(mId, Offset, Size, Data);
 	}
 
-	const std::shared_ptr<const RenderTarget> GetRenderTarget(GLenum Attachment) const
+	// Access of glMapNamedBufferRange within the flags the buffer was created with; waits for the GPU
+	// when the range is still in use unless GL_MAP_UNSYNCHRONIZED_BIT is given
+	void *Map(GLintptr Offset, GLsizeiptr Size, GLbitfield Access) const
 	{
-		return mRenderbuffers.at(Attachment);
+		return glMapNamedBufferRange(mId, Offset, Size, Access);
 	}
 
-	GLenum CheckStatus() const
+	void Unmap() const
 	{
-		return glCheckNamedFramebufferStatus(mId, GL_DRAW_FRAMEBUFFER);
+		glUnmapNamedBuffer(mId);
 	}
 
-	void Blit(glm::ivec2 SrcP0, glm::ivec2 SrcP1, const Framebuffer& Dst, glm::ivec2 DstP0, glm::ivec2 DstP1, GLbitfield Mask, GLenum Filter) const
-	{
-		glBlitNamedFramebuffer(mId, Dst.mId, SrcP0.x, SrcP0.y, SrcP1.x, SrcP1.y, DstP0.x, DstP0.y, DstP1.x, DstP1.y, Mask, Filter);
-	}
+	GLsizeiptr GetSize() const { return mSize; }
 
-	void InvalidateAttachments(std::vector<GLenum> Attachments) const
+	void Release() override
 	{
-		glInvalidateNamedFramebufferData(mId, GLsizei(Attachments.size()), (Attachments.size() > 0) ? &Attachments[0] : nullptr);
+		if (0 != mId)
+		{
+			glDeleteBuffers(1, &mId);
+		}
+		mId = 0;
+		mSize = 0;
 	}
 
-	void SetReadBuffer(GLenum Attachment) const
-	{
-		glNamedFramebufferReadBuffer(mId, Attachment);
-	}
+protected:
+	GLuint mId;
+	GLsizeiptr mSize;
+};
 
-	void SetDrawBuffer(GLenum Attachment) const
-	{
-		glNamedFramebufferDrawBuffer(mId, Attachment);
-	}
+class Environment : public Texture
+{
+protected:
+	// rows of a Radiance image decoded per upload, two bands are in the pixel unpack buffer
+	static constexpr std::size_t kHdrBandBytes = 4 * 1024 * 1024;
 
-	void SetDrawBuffers(std::vector<GLenum> Buffers) const
+public:
+	Environment()
+		: Texture() {}
+
+	~Environment() override { Release(); }
+
+	Environment(Environment &&Other)
+		: Texture(std::move(Other))
+			, mIrradianceSH(std::move(Other.mIrradianceSH))
+			, mSpBrdfLut(std::move(Other.mSpBrdfLut))
 	{
-		glNamedFramebufferDrawBuffers(mId, Buffers.size(), Buffers.size() ? &Buffers[0] : nullptr);
 	}
 
-	void Resolve(const Framebuffer& Dst, std::vector<std::tuple<GLenum, GLenum, GLbitfield, GLenum>> List) const
+	Environment &operator = (Environment &&Other)
 	{
-		for (const auto & copyParams: List)
+		if (&Other != this)
 		{
-			auto attach1 = std::get<0>(copyParams);
-			auto attach2 = std::get<1>(copyParams);
-			auto bitfieldMask = std::get<2>(copyParams);
-			auto filter = std::get<3>(copyParams);
-			const auto &rt1 = GetRenderTarget(attach1);
-			const auto &rt2 = Dst.GetRenderTarget(attach2);
-			SetReadBuffer(attach1);
-			Dst.SetDrawBuffer(attach2);
-			Blit(glm::ivec2{0, 0}, glm::ivec2{rt1->GetWidth(), rt1->GetHeight()},
-				 Dst, glm::ivec2{0, 0}, glm::ivec2{rt2->GetWidth(), rt2->GetHeight()}, bitfieldMask, filter);
+			Release();
+
+			Texture::operator = (std::move(Other));
+			mIrradianceSH = std::move(Other.mIrradianceSH);
+			mSpBrdfLut = std::move(Other.mSpBrdfLut);
 		}
+		return *this;
 	}
 
-	void Release() override
+	// Image decoded by stb_image, for the files HdrImage leaves to it
+	Environment(const std::shared_ptr<class Image>& Img, const EnvironmentMaps::Parameters& Params)
+		: Texture(GL_TEXTURE_CUBE_MAP, Params.specularSize, Params.specularSize, GL_RGBA16F, Params.specularLevels)
 	{
-		if (0 != mId)
-		{
-			mRenderbuffers.clear();
-			glDeleteFramebuffers(1, &mId);
-			mId = 0;
-		}
+		Texture envTextureEquirect{ Img, GL_RGB, GL_RGB16F, 1 };
+		Precompute(envTextureEquirect, Params);
 	}
 
-protected:
-	void updateDrawBuffers()
+	// Radiance image decoded on the thread pool in bands of rows straight into a mapped pixel unpack buffer,
+	// a band is uploaded while the next one decodes; no float or full size copy of the image is made
+	Environment(const HdrImage& Img, const EnvironmentMaps::Parameters& Params)
+		: Texture(GL_TEXTURE_CUBE_MAP, Params.specularSize, Params.specularSize, GL_RGBA16F, Params.specularLevels)
 	{
-		std::vector<GLenum> buffers;
-		for (const auto &buffer : mRenderbuffers)
+		Texture envTextureEquirect{ GL_TEXTURE_2D, Img.width(), Img.height(), GL_RGBA16F, 1 };
+		const int bandRows = std::clamp(int(kHdrBandBytes / Img.rowBytes()), 1, Img.height());
+		const GLsizeiptr bandBytes = GLsizeiptr(bandRows * Img.rowBytes());
+		StorageBuffer unpackBuffer{ nullptr, 2 * bandBytes, GL_MAP_WRITE_BIT };
+
+		unpackBuffer.BindTarget(GL_PIXEL_UNPACK_BUFFER);
+		for (int row = 0, band = 0; row < Img.height(); row += bandRows, band ^= 1)
 		{
-			if (GL_DEPTH_ATTACHMENT != buffer.first)
+			const int rows = std::min(bandRows, Img.height() - row);
+			// mapping waits for the upload of the band that used this half before
+			void *mapped = unpackBuffer.Map(band * bandBytes, GLsizeiptr(rows * Img.rowBytes()), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+			if (nullptr == mapped)
 			{
-				buffers.emplace_back(buffer.first);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				throw std::runtime_error("Failed to map the pixel unpack buffer of the environment");
 			}
+			Img.decode(ThreadPool::instance(), row, row + rows, static_cast<uint16_t*>(mapped));
+			unpackBuffer.Unmap();
+			envTextureEquirect.SubImage2D(0, 0, row, Img.width(), rows, GL_RGBA, GL_HALF_FLOAT, reinterpret_cast<const void*>(band * bandBytes));
 		}
-		glNamedFramebufferDrawBuffers(mId, buffers.size(), buffers.size() ? &buffers[0] : nullptr);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		unpackBuffer.Release();
+
+		Precompute(envTextureEquirect, Params);
 	}
 
-	void recreateIfNeeded(GLenum Attachment, GLint Width, GLint Height)
+	// Maps loaded from the cache, uploaded as they are without running any of the precompute programs
+	Environment(const EnvironmentMaps &Maps)
+		: Texture(GL_TEXTURE_CUBE_MAP, Maps.levelSize(EnvironmentMaps::Specular, 0), Maps.levelSize(EnvironmentMaps::Specular, 0),
+				  GL_RGBA16F, Maps.levels(EnvironmentMaps::Specular))
 	{
-		if (0 == mRenderbuffers.count(Attachment)
-			|| mRenderbuffers[Attachment]->GetWidth() != Width
-			|| mRenderbuffers[Attachment]->GetHeight() != Height)
+		// rows of half float RGBA and RG texels are multiples of 4 bytes, the default alignment holds
+		for (int level = 0; level < GetLevels(); level++)
 		{
-			const auto &params = mRbParams[Attachment];
-			const auto type = std::get<0>(params);
-			const auto format = std::get<1>(params);
-			const auto samples = std::get<2>(params);
-			switch (type)
-			{
-				case RenderTargetType::TypeRenderBuffer:
-					{
-						auto renderbufferPtr = std::make_shared<Renderbuffer>();
-						mRenderbuffers[Attachment] = std::static_pointer_cast<RenderTarget>(renderbufferPtr);
-						renderbufferPtr->Storage(format, Width, Height, samples);
-					}
-					break;
-				case RenderTargetType::TypeTexture:
-					{
-						auto texturePtr = std::make_shared<Texture>(GL_TEXTURE_2D);
-						mRenderbuffers[Attachment] = std::static_pointer_cast<RenderTarget>(texturePtr);
-						texturePtr->Storage(format, Width, Height, 1);
-					}
-					break;
-			}
-			mRenderbuffers[Attachment]->AttachTo(mId, Attachment);
+			const int size = Maps.levelSize(EnvironmentMaps::Specular, level);
+			SubImage(level, 0, size, size, 6, GL_RGBA, GL_HALF_FLOAT, Maps.data(EnvironmentMaps::Specular, level));
 		}
-	}
-
-	GLuint mId;
-	std::unordered_map<GLenum, std::shared_ptr<RenderTarget>> mRenderbuffers;
-	std::unordered_map<GLenum, std::tuple<RenderTargetType, GLenum, GLint>> mRbParams;
-};
 
-template <class T>
-class UniformBuffer : public NonCopyable
-{
-public:
-	UniformBuffer()
-		: mId(0)
-	{}
+		mIrradianceSH = StorageBuffer{ Maps.irradianceSH(), EnvironmentMaps::SHFloats * sizeof(float) };
 
-	UniformBuffer(UniformBuffer &&Other)
-		: mId(Other.mId)
-	{
-		Other.mId = 0;
+		const int lutSize = Maps.levelSize(EnvironmentMaps::BrdfLut, 0);
+		mSpBrdfLut = Texture{ GL_TEXTURE_2D, lutSize, lutSize, GL_RG, GL_RG16F, 1, GL_HALF_FLOAT, Maps.data(EnvironmentMaps::BrdfLut, 0) };
+		mSpBrdfLut.SetWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
 	}
 
-	UniformBuffer &operator = (UniformBuffer &&Other)
+	// Reads the precomputed maps back for the cache, waits for the GPU
+	std::shared_ptr<EnvironmentMaps> Download(uint64_t Key, const EnvironmentMaps::Parameters& Params) const
 	{
-		if (&Other != this)
+		std::shared_ptr<EnvironmentMaps> maps = std::make_shared<EnvironmentMaps>(Key, Params);
+		for (int level = 0; level < GetLevels() && level < maps->levels(EnvironmentMaps::Specular); level++)
 		{
-			Release();
-
-			std::swap(mId, Other.mId);
+			GetImage(level, GL_RGBA, GL_HALF_FLOAT, GLsizei(maps->levelBytes(EnvironmentMaps::Specular, level)),
+					 maps->data(EnvironmentMaps::Specular, level));
 		}
-		return *this;
+		mIrradianceSH.GetData(0, EnvironmentMaps::SHFloats * sizeof(float), maps->irradianceSH());
+		mSpBrdfLut.GetImage(0, GL_RG, GL_HALF_FLOAT, GLsizei(maps->levelBytes(EnvironmentMaps::BrdfLut, 0)),
+							maps->data(EnvironmentMaps::BrdfLut, 0));
+		return maps;
 	}
 
-	void Create()
+	void Release() override
 	{
-		mId = -1;
-		glCreateBuffers(1, &mId);
-		glNamedBufferStorage(mId, sizeof(*this), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		Texture::Release();
+		mIrradianceSH.Release();
+		mSpBrdfLut.Release();
 	}
 
-	void Update()
-	{
-		glNamedBufferSubData(mId, 0, sizeof(T), &mData);
-	}
+	// coefficients of irradiance_sh.glsl, bound as a uniform buffer for shading
+	const StorageBuffer &GetIrradianceSH() const { return mIrradianceSH; }
+	const Texture &GetSpBrdfLutTexture() const { return mSpBrdfLut; }
 
-	void Bind(GLuint Slot)
-	{
-		if (0 == mId)
-		{
-			Create();
-		}
-		Update();
-		glBindBufferBase(GL_UNIFORM_BUFFER, Slot, mId);
-	}
+protected:
+	// Maps of the quality tier, Equirect is released once it is converted; the unfiltered cube map keeps
+	// its full mip chain for the filtered importance sampling, the specular map only has the levels of the tier
+	void Precompute(Texture &Equirect, const EnvironmentMaps::Parameters& Params)
+	{	//------------------------------------------------------------------------------------------------------------------
+		Texture envTextureUnfiltered{ GL_TEXTURE_CUBE_MAP, Params.specularSize, Params.specularSize, GL_RGBA16F };
+		ShaderProgram equirectToCubeProgram =
+			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/equirect2cube_cs.glsl")) }};
 
-	T &GetReference() { return mData; }
+		equirectToCubeProgram.Use();
+		Equirect.BindTextureUnit(0);
+		envTextureUnfiltered.BindImageTexture(0, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
 
-	void Release() override
-	{
-		if (-1 != mId)
+		ShaderProgram::DispatchCompute(envTextureUnfiltered.GetWidth() / 32, envTextureUnfiltered.GetHeight() / 32, 6);
+		// image stores are visible to the mipmap generation, the copy below and texture fetches only after a barrier
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+		Equirect.Release();
+		equirectToCubeProgram.Release();
+		envTextureUnfiltered.GenerateMipmap();
+		//-------------------------------------------------------------------------------------------------------------------
+		ShaderProgram spmapProgram =
+			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/spmap_cs.glsl")) }};
+
+		// Copy 0th mipmap level into destination environment map
+		envTextureUnfiltered.CopyImageSubData(GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0, /*m_envTexture*/
+											  *this, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0, 6);
+
+		spmapProgram.Use();
+		envTextureUnfiltered.BindTextureUnit(0);
+
+		// Pre-filter rest of the mip chain.
+		const float deltaRoughness = 1.0f / glm::max(float(/*m_envTexture.*/this->GetLevels() - 1), 1.0f);
+		spmapProgram.SetInt(1, Params.specularSamples);
+		for (int level = 1, size = Params.specularSize / 2; level < /*m_envTexture.*/this->GetLevels(); ++level, size /= 2)
 		{
-			glDeleteBuffers(1, &mId);
+			const GLuint numGroups = glm::max(1, (size + 31) / 32);
+			/*m_envTexture.*/this->BindImageTexture(0, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+			spmapProgram.SetFloat(0, level * deltaRoughness);
+			ShaderProgram::DispatchCompute(numGroups, numGroups, 6);
 		}
-		mId = 0;
+		// before shading samples the levels and Download reads them back for the cache
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+		spmapProgram.Release();
+		//-------------------------------------------------------------------------------------------------------------------
+		// L2 spherical harmonics of a small box filtered level, one workgroup
+		mIrradianceSH = StorageBuffer{ nullptr, EnvironmentMaps::SHFloats * sizeof(float) };
+
+		ShaderProgram irradianceSHProgram =
+			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/irradiance_sh_cs.glsl")) }};
+
+		irradianceSHProgram.Use();
+		envTextureUnfiltered.BindTextureUnit(0);
+		mIrradianceSH.Bind(0);
+		irradianceSHProgram.SetInt(0, Utility::numMipmapLevels(Params.specularSize / Params.irradianceSourceSize, 1) - 1);
+		ShaderProgram::DispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_UNIFORM_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+		irradianceSHProgram.Release();
+		envTextureUnfiltered.Release();
+		//-------------------------------------------------------------------------------------------------------------------
+		mSpBrdfLut = Texture{ GL_TEXTURE_2D, Params.brdfLutSize, Params.brdfLutSize, GL_RG16F, 1 };
+		mSpBrdfLut.SetWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+		ShaderProgram spBRDFProgram =
+			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/spbrdf_cs.glsl")) }};
+
+		spBRDFProgram.Use();
+		mSpBrdfLut.BindImageTexture(0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+		ShaderProgram::DispatchCompute(mSpBrdfLut.GetWidth() / 32, mSpBrdfLut.GetHeight() / 32, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+		spBRDFProgram.Release();
+		//-------------------------------------------------------------------------------------------------------------------
+		glFinish();
 	}
 
-protected:
-	GLuint mId;
-	T mData;
+	StorageBuffer mIrradianceSH;
+	Texture mSpBrdfLut;
+};
+
+// layout of the commands read by glMultiDrawArraysIndirect
+struct DrawArraysIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint first;
+	GLuint baseInstance;
 };
 
 struct MeshBuffer
@@ -1017,6 +2048,7 @@ public:
 	{
 		if (0 != mVao)
 		{
+			StateCache::Instance().ForgetVertexArray(mVao);
 			glDeleteVertexArrays(1, &mVao);
 			mVao = 0;
 		}
@@ -1037,7 +2069,7 @@ public:
 
 	void Render()
 	{
-		glBindVertexArray(mVao);
+		StateCache::Instance().BindVertexArray(mVao);
 		if (false != mEmpty)
 		{
 			glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -1052,6 +2084,21 @@ public:
 		}
 	}
 
+	// DrawCount non indexed commands from the bound GL_DRAW_INDIRECT_BUFFER, meant for the empty
+	// geometry with vertices pulled from storage buffers
+	void RenderArraysIndirect(GLsizei DrawCount)
+	{
+		StateCache::Instance().BindVertexArray(mVao);
+		glMultiDrawArraysIndirect(mDrawPatches ? GL_PATCHES : GL_TRIANGLES, nullptr, DrawCount, 0);
+	}
+
+	// vertex (Mesh::Vertex) and index (Mesh::Face) data as shader storage buffers
+	void BindStorage(GLuint VertexSlot, GLuint IndexSlot) const
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VertexSlot, mVbo);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IndexSlot, mIbo);
+	}
+
 protected:
 	GLboolean mEmpty, mDrawPatches;
 	GLuint mVbo, mIbo, mVao;
@@ -1070,7 +2117,8 @@ public:
             mNormals(std::move(Other.mNormals)),
             mMetalness(std::move(Other.mMetalness)),
             mRoughness(std::move(Other.mRoughness)),
-            mEnvironmentPtr(std::move(Other.mEnvironmentPtr)) {}
+            mEnvironmentPtr(std::move(Other.mEnvironmentPtr)),
+            mNoIrradianceSH(std::move(Other.mNoIrradianceSH)) {}
 	
 	PbrMeshBase &operator = (PbrMeshBase &&Other)
 	{
@@ -1083,57 +2131,87 @@ public:
 			mMetalness = std::move(Other.mMetalness);
 			mRoughness = std::move(Other.mRoughness);
 			mEnvironmentPtr = std::move(Other.mEnvironmentPtr);
+			mNoIrradianceSH = std::move(Other.mNoIrradianceSH);
 		}
 
 		return *this;
 	}
 
+	// decoded texture files named by a mesh, null when the mesh has none; no GL calls so that
+	// it can be loaded on a worker thread
+	struct MaterialImages
+	{
+		std::shared_ptr<Image> albedo;
+		std::shared_ptr<Image> normals;
+		std::shared_ptr<Image> metalness;
+		std::shared_ptr<Image> roughness;
+
+		static MaterialImages Load(const std::shared_ptr<Mesh> &MeshPtr)
+		{
+			const std::string texturesPathStr = "data/textures/";
+			auto load = [&](Mesh::TextureType TexType, int Channels) -> std::shared_ptr<Image>
+			{
+				const std::string fileName = MeshPtr->textureName(TexType);
+				return fileName.empty() ? nullptr : Image::fromFile(texturesPathStr + fileName, Channels);
+			};
+			return MaterialImages{ load(Mesh::TextureType::Albedo, 4), load(Mesh::TextureType::Normals, 3),
+								   load(Mesh::TextureType::Metalness, 1), load(Mesh::TextureType::Roughness, 1) };
+		}
+	};
+
 	PbrMeshBase(const std::shared_ptr<Mesh> &MeshPtr, const std::shared_ptr<const Environment> &EnvironmentPtr = nullptr, bool DrawPatches = false)
+		: PbrMeshBase(MeshPtr, MaterialImages::Load(MeshPtr), EnvironmentPtr, DrawPatches)
+	{
+	}
+
+	PbrMeshBase(const std::shared_ptr<Mesh> &MeshPtr, const MaterialImages &Images, const std::shared_ptr<const Environment> &EnvironmentPtr = nullptr, bool DrawPatches = false)
 		: MeshGeometry(MeshPtr, false, DrawPatches)
 	{
-		const std::string texturesPathStr = "data/textures/";
-		auto albedoFileName = MeshPtr->textureName(Mesh::TextureType::Albedo);
-		if (albedoFileName.empty())
+		mEnvironmentPtr = EnvironmentPtr;
+		if (nullptr == mEnvironmentPtr)
+		{
+			// the shading programs always read the irradiance block, without an environment it is black
+			const float zero[EnvironmentMaps::SHFloats] = {};
+			mNoIrradianceSH = StorageBuffer{ zero, sizeof(zero) };
+		}
+		if (nullptr == Images.albedo)
 		{
 			const GLubyte pix[] = { 128, 128, 128, 255 };
 			mAlbedo = Texture{ GL_TEXTURE_2D, 1, 1, GL_RGBA, GL_RGBA8, 0, GL_UNSIGNED_BYTE, &pix };
 		}
 		else
 		{
-			mAlbedo = Texture{ Image::fromFile(texturesPathStr + albedoFileName, 4), GL_RGBA, GL_SRGB8_ALPHA8 };
+			mAlbedo = Texture{ Images.albedo, GL_RGBA, GL_SRGB8_ALPHA8 };
 		}
 
-		auto normalsFileName = MeshPtr->textureName(Mesh::TextureType::Normals);
-		if (normalsFileName.empty())
+		if (nullptr == Images.normals)
 		{
 			const GLubyte pix[] = { 0, 0, 255 };
 			mNormals = Texture{ GL_TEXTURE_2D, 1, 1, GL_RGB, GL_RGB8, 0, GL_UNSIGNED_BYTE, &pix };
 		}
 		else
 		{
-			mNormals = Texture{ Image::fromFile(texturesPathStr + normalsFileName, 3), GL_RGB, GL_RGB8 };
+			mNormals = Texture{ Images.normals, GL_RGB, GL_RGB8 };
 		}
 
-		auto metalnessFileName = MeshPtr->textureName(Mesh::TextureType::Metalness);
-		if (metalnessFileName.empty())
+		if (nullptr == Images.metalness)
 		{
 			const GLubyte pix[] = { 128 };
 			mMetalness = Texture{ GL_TEXTURE_2D, 1, 1, GL_RED, GL_R8, 0, GL_UNSIGNED_BYTE, &pix };
 		}
 		else
 		{
-			mMetalness = Texture{ Image::fromFile(texturesPathStr + metalnessFileName, 1), GL_RED, GL_R8 };
+			mMetalness = Texture{ Images.metalness, GL_RED, GL_R8 };
 		}
 
-		auto roughnessFileName = MeshPtr->textureName(Mesh::TextureType::Roughness);
-		if (roughnessFileName.empty())
+		if (nullptr == Images.roughness)
 		{
 			const GLubyte pix[] = { 128 };
 			mRoughness = Texture{ GL_TEXTURE_2D, 1, 1, GL_RED, GL_R8, 0, GL_UNSIGNED_BYTE, &pix };
 		}
 		else
 		{
-			mRoughness = Texture{ Image::fromFile(texturesPathStr + roughnessFileName, 1), GL_RED, GL_R8 };
+			mRoughness = Texture{ Images.roughness, GL_RED, GL_R8 };
 		}
 	}
 
@@ -1144,6 +2222,7 @@ public:
 		mMetalness.Release();
 		mRoughness.Release();
 		mEnvironmentPtr = nullptr;
+		mNoIrradianceSH.Release();
 
 		MeshGeometry::Release();
 	}
@@ -1159,9 +2238,34 @@ public:
 
 	virtual void Render(bool OpaquePass) {}
 
-protected:
+	// passes a drawable is submitted to, Mixed items are drawn in both and keep their part in the fragment shader
+	enum class BlendClass
+	{
+		Opaque,
+		Transparent,
+		Mixed,
+	};
+	virtual BlendClass GetBlendClass() const { return BlendClass::Mixed; }
+
+protected:
+	// specular map, irradiance coefficients and BRDF LUT at the slots of pbr_fs.glsl and pbr_asteroid_fs.glsl
+	void BindEnvironment() const
+	{
+		if (nullptr != mEnvironmentPtr)
+		{
+			mEnvironmentPtr->BindTextureUnit(4);
+			mEnvironmentPtr->GetIrradianceSH().BindUniform(3);
+			mEnvironmentPtr->GetSpBrdfLutTexture().BindTextureUnit(6);
+		}
+		else
+		{
+			mNoIrradianceSH.BindUniform(3);
+		}
+	}
+
 	Texture mAlbedo, mNormals, mMetalness, mRoughness;
 	std::shared_ptr<const Environment> mEnvironmentPtr;
+	StorageBuffer mNoIrradianceSH;
 };
 
 class PbrMesh : public PbrMeshBase
@@ -1230,12 +2334,7 @@ public:
 		mNormals.BindTextureUnit(1);
 		mMetalness.BindTextureUnit(2);
 		mRoughness.BindTextureUnit(3);
-		if (nullptr != mEnvironmentPtr)
-		{
-			mEnvironmentPtr->BindTextureUnit(4);
-			mEnvironmentPtr->GetIrmapTexture().BindTextureUnit(5);
-			mEnvironmentPtr->GetSpBrdfLutTexture().BindTextureUnit(6);
-		}
+		BindEnvironment();
 		MeshGeometry::Render();
 	}
 
@@ -1275,9 +2374,60 @@ protected:
 	UniformBuffer<BaseInfoUB> mBaseInfoUB;
 };
 
+// per instance data of the asteroid program, std430 layout of AsteroidInstance in asteroid_instance.glsl
+struct AsteroidInstanceData
+{
+	glm::mat4 modelMat;
+	glm::vec4 albedoRoughness;
+	GLfloat metalness;
+	GLuint noiseVariant;
+	GLfloat boundingRadius;
+	GLfloat reserved;
+	glm::mat4 prevModelMat;		// model matrix of the previous frame, for motion vectors
+};
+
 class PbrAsteroid : public PbrMeshBase
 {
 public:
+	// Compile time specialization of the shading program, every combination is a separate program
+	// so that the compiler unrolls the light loop and strips the disabled work.
+	struct Variant
+	{
+		int activeLights = SceneSettings::NumLights;	// enabled lights, packed to the front of the light array
+		int noiseLevels = AsteroidNoise::MaxLevel;		// highest noise level evaluated per fragment
+		bool craters = true;							// craters of the levels evaluated per fragment
+		bool transparency = false;						// opaque/transparent pass split in the shader
+		bool earlyFragmentTests = false;				// set for the shading pass after the depth pre-pass
+		bool temporalAA = false;						// motion vectors, normal antialiasing spread over frames
+
+		uint32_t GetKey() const
+		{
+			return uint32_t(activeLights) | uint32_t(noiseLevels) << 4 | uint32_t(craters) << 10
+				 | uint32_t(transparency) << 11 | uint32_t(earlyFragmentTests) << 12 | uint32_t(temporalAA) << 13;
+		}
+
+		// defines of pbr_asteroid_fs.glsl and asteroid_base.glsl
+		std::vector<std::string> GetDefines() const
+		{
+			std::vector<std::string> defines{ "ACTIVE_LIGHTS " + std::to_string(activeLights),
+											  "NOISE_LEVELS " + std::to_string(noiseLevels),
+											  std::string("CRATERS ") + (craters ? "1" : "0") };
+			if (!transparency)
+			{
+				defines.push_back("OPAQUE_ONLY");
+			}
+			if (earlyFragmentTests)
+			{
+				defines.push_back("EARLY_FRAGMENT_TESTS");
+			}
+			if (temporalAA)
+			{
+				defines.push_back("TEMPORAL_AA");
+			}
+			return defines;
+		}
+	};
+
 	PbrAsteroid()
 		: PbrMeshBase()
 	{
@@ -1285,28 +2435,138 @@ public:
 
 	PbrAsteroid(PbrAsteroid &&Other)
 		: PbrMeshBase(std::move(Other))
+		, mVertexHeights(std::move(Other.mVertexHeights))
+		, mPatchBounds(std::move(Other.mPatchBounds))
+		, mNoiseVariants(std::move(Other.mNoiseVariants))
+		, mSurfaceNormalHeight(std::move(Other.mSurfaceNormalHeight))
+		, mSurfaceCraterNormal(std::move(Other.mSurfaceCraterNormal))
+		, mBakedLevels(Other.mBakedLevels)
+		, mVertexCount(Other.mVertexCount)
+		, mPatchCount(Other.mPatchCount)
+		, mBoundingRadius(Other.mBoundingRadius)
+		, mInstances(std::move(Other.mInstances))
+		, mInstanceBuffer(std::move(Other.mInstanceBuffer))
+		, mVisiblePatches(std::move(Other.mVisiblePatches))
+		, mDrawCommands(std::move(Other.mDrawCommands))
+		, mPatchSource(std::move(Other.mPatchSource))
+		, mDepthPrePass(Other.mDepthPrePass)
+		, mVariant(Other.mVariant)
 	{
 	}
 
 	PbrAsteroid &operator = (PbrAsteroid &&Other)
 	{
 		PbrMeshBase::operator = (std::move(Other));
+		mVertexHeights = std::move(Other.mVertexHeights);
+		mPatchBounds = std::move(Other.mPatchBounds);
+		mNoiseVariants = std::move(Other.mNoiseVariants);
+		mSurfaceNormalHeight = std::move(Other.mSurfaceNormalHeight);
+		mSurfaceCraterNormal = std::move(Other.mSurfaceCraterNormal);
+		mBakedLevels = Other.mBakedLevels;
+		mVertexCount = Other.mVertexCount;
+		mPatchCount = Other.mPatchCount;
+		mBoundingRadius = Other.mBoundingRadius;
+		mInstances = std::move(Other.mInstances);
+		mInstanceBuffer = std::move(Other.mInstanceBuffer);
+		mVisiblePatches = std::move(Other.mVisiblePatches);
+		mDrawCommands = std::move(Other.mDrawCommands);
+		mPatchSource = std::move(Other.mPatchSource);
+		mDepthPrePass = Other.mDepthPrePass;
+		mVariant = Other.mVariant;
 
 		return *this;
 	}
 
 	PbrAsteroid(const std::shared_ptr<Mesh> &MeshPtr, const std::shared_ptr<const Environment> &EnvironmentPtr = nullptr)
-		: PbrMeshBase(MeshPtr, EnvironmentPtr, true)
+		: PbrAsteroid(MeshPtr, MaterialImages::Load(MeshPtr), EnvironmentPtr)
+	{
+	}
+
+	PbrAsteroid(const std::shared_ptr<Mesh> &MeshPtr, const MaterialImages &Images, const std::shared_ptr<const Environment> &EnvironmentPtr = nullptr)
+		: PbrMeshBase(MeshPtr, Images, EnvironmentPtr, true)
+		, mPatchSource(nullptr, true, true)
+	{
+		CreateBaseDisplacement(*MeshPtr);
+
+		const DrawArraysIndirectCommand command{ 0, 1, 0, 0 };
+		mDrawCommands = StorageBuffer{ &command, sizeof(command), GL_DYNAMIC_STORAGE_BIT };
+
+		// a single instance placed by SetShadingUniforms until SetInstances is called
+		AsteroidInstanceData instance{};
+		instance.albedoRoughness = glm::vec4{ 1.0f, 1.0f, 1.0f, 0.9f };
+		instance.metalness = 0.05f;
+		instance.modelMat = glm::mat4{ 1.0f };
+		instance.prevModelMat = instance.modelMat;
+		instance.boundingRadius = BoundingSphere::maxColumnLength(instance.modelMat) * mBoundingRadius;
+		SetInstances({ instance });
+	}
+
+	// first noise levels are taken from the map instead of being evaluated per fragment
+	void SetSurfaceMap(const AsteroidSurfaceMap &SurfaceMap)
+	{
+		auto createCubeMap = [&SurfaceMap](const uint16_t *(AsteroidSurfaceMap::*Texels)(int, int) const)
+		{
+			Texture cubeMap{ GL_TEXTURE_CUBE_MAP, SurfaceMap.resolution(), SurfaceMap.resolution(), GL_RGBA16F, SurfaceMap.mipLevels() };
+			for (int level = 0; level < SurfaceMap.mipLevels(); level++)
+			{
+				for (int face = 0; face < AsteroidSurfaceMap::NumFaces; face++)
+				{
+					cubeMap.SubImage(level, face, SurfaceMap.levelSize(level), SurfaceMap.levelSize(level),
+									 GL_RGBA, GL_HALF_FLOAT, (SurfaceMap.*Texels)(level, face));
+				}
+			}
+			return cubeMap;
+		};
+		mSurfaceNormalHeight = createCubeMap(&AsteroidSurfaceMap::normalHeight);
+		mSurfaceCraterNormal = createCubeMap(&AsteroidSurfaceMap::craterNormal);
+		mBakedLevels = SurfaceMap.levels();
+	}
+
+	// visible patches of all instances are drawn by one indirect command, instance 0 follows
+	// the model matrix passed to SetShadingUniforms
+	void SetInstances(const std::vector<AsteroidInstanceData> &Instances)
+	{
+		mInstances = Instances;
+		if (mInstances.size() > MaxInstances)
+		{
+			std::cout << "WARNING: asteroid instances limited to " << MaxInstances << std::endl;
+			mInstances.resize(MaxInstances);
+		}
+		mInstanceBuffer = StorageBuffer{ mInstances.data(), static_cast<GLsizeiptr>(mInstances.size() * sizeof(AsteroidInstanceData)),
+										 GL_DYNAMIC_STORAGE_BIT };
+		// room for every patch of every instance
+		mVisiblePatches = StorageBuffer{ nullptr, static_cast<GLsizeiptr>(mInstances.size() * mPatchCount * sizeof(VisiblePatch)) };
+	}
+
+	void UpdateInstance(size_t Index, const AsteroidInstanceData &Instance)
 	{
+		mInstances[Index] = Instance;
+		mInstanceBuffer.Update(static_cast<GLintptr>(Index * sizeof(AsteroidInstanceData)), sizeof(AsteroidInstanceData), &Instance);
 	}
 
+	size_t GetInstanceCount() const { return mInstances.size(); }
+	const AsteroidInstanceData &GetInstance(size_t Index) const { return mInstances[Index]; }
+
+	// object space radius of the mesh with the highest base displacement
+	float GetBoundingRadius() const { return mBoundingRadius; }
+
 	void Release() override
 	{
-		mTessControlUB.Release();
-		mTransformsUB.Release();
-		mViewProjectionUB.Release();
-		mShadingUB.Release();
-		mBaseInfoUB.Release();
+		mVertexHeights.Release();
+		mPatchBounds.Release();
+		mNoiseVariants.Release();
+		mSurfaceNormalHeight.Release();
+		mSurfaceCraterNormal.Release();
+		mBakedLevels = 0;
+		mVertexCount = 0;
+		mPatchCount = 0;
+		mBoundingRadius = 0.0f;
+		mInstances.clear();
+		mInstanceBuffer.Release();
+		mVisiblePatches.Release();
+		mDrawCommands.Release();
+		mPatchSource.Release();
+		mFrameUB.Release();
 
 		PbrMeshBase::Release();
 	}
@@ -1318,117 +2578,586 @@ public:
 		const glm::mat4 &ViewMat,
 		const glm::mat4 &ModelMat) override
 	{
-		auto &transformUniforms = mTransformsUB.GetReference();
-		transformUniforms.modelViewProjectionMatrix = ProjectionMat * ViewMat * ModelMat;
-
-		auto &mvpUB = mViewProjectionUB.GetReference();
-		mvpUB.viewport = Viewport;
-		mvpUB.modelMat = ModelMat;
-		mvpUB.viewMat = ViewMat;
-		mvpUB.modelViewProjectionMat = transformUniforms.modelViewProjectionMatrix;
+		auto &frameUniforms = mFrameUB.GetReference();
+		frameUniforms.viewMat = ViewMat;
+		frameUniforms.projectionMat = ProjectionMat;
+		frameUniforms.viewProjectionMat = ProjectionMat * ViewMat;
+		frameUniforms.viewport = Viewport;
+		// enabled lights first, the shading program variant loops over them only
+		int activeLights = 0;
+		for (const SceneSettings::Light &light : Lights)
+		{
+			if (light.enabled)
+			{
+				frameUniforms.lights[activeLights].direction = glm::vec4{ light.direction, 0.0f };
+				frameUniforms.lights[activeLights].radiance = glm::vec4{ light.radiance, 0.0f };
+				activeLights++;
+			}
+		}
+		for (int i = activeLights; i < SceneSettings::NumLights; i++)
+		{
+			frameUniforms.lights[i].direction = glm::vec4{};
+			frameUniforms.lights[i].radiance = glm::vec4{};
+		}
+		mVariant.activeLights = activeLights;
+		frameUniforms.eyePosition = glm::vec3{ glm::inverse(ViewMat) * glm::vec4{ 0, 0, 0, 1.f } };
+		glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &frameUniforms.maxTessLevel);
+		frameUniforms.bakedLevels = mBakedLevels;
+		frameUniforms.vertexCount = mVertexCount;
+		frameUniforms.patchCount = mPatchCount;
+
+		// the previous matrix follows one frame late, so one more update after the model stops
+		if (!mInstances.empty() && (mInstances[0].modelMat != ModelMat || mInstances[0].prevModelMat != ModelMat))
+		{
+			AsteroidInstanceData instance = mInstances[0];
+			instance.prevModelMat = instance.modelMat;
+			instance.modelMat = ModelMat;
+			// the cull pass tests the world space sphere, the radius follows the scale of the matrix
+			instance.boundingRadius = BoundingSphere::maxColumnLength(ModelMat) * mBoundingRadius;
+			UpdateInstance(0, instance);
+		}
+	}
 
-		auto &baseInfoUB = mBaseInfoUB.GetReference();
-		baseInfoUB.modelMat = ModelMat;
-		baseInfoUB.modelViewMat = ViewMat * ModelMat;
+	// Reprojection data of temporal anti-aliasing, set every frame after SetShadingUniforms: view projection
+	// of the previous frame, projection jitter in NDC of this (xy) and the previous frame (zw) and the
+	// rotation of the extra normal sample of grazing fragments, which alternates between frames
+	void SetTemporal(const glm::mat4 &PrevViewProjectionMat, const glm::vec4 &Jitter, float NormalSampleOffset)
+	{
+		auto &frameUniforms = mFrameUB.GetReference();
+		frameUniforms.prevViewProjectionMat = PrevViewProjectionMat;
+		frameUniforms.jitter = Jitter;
+		frameUniforms.normalSampleOffset = NormalSampleOffset;
+	}
 
-		auto &shadingUniforms = mShadingUB.GetReference();
-		for (int i = 0; i < Lights.size(); i++)
+	// Frustum and back face culling of patches of all instances, visible patches with their
+	// tessellation levels are appended to the list drawn by Render. Call once per frame after
+	// SetShadingUniforms.
+	void CullPatches()
+	{
+		const ShaderProgram &cullProgram = GetCullProgram();
+		const GLuint zero = 0;
+		mDrawCommands.Update(0, sizeof(zero), &zero);
+		if (mInstances.empty())
 		{
-			const SceneSettings::Light& light = Lights[i];
-			shadingUniforms.lights[i].direction = glm::vec4{ light.direction, 0.0f };
-			shadingUniforms.lights[i].radiance = light.enabled ? glm::vec4{ light.radiance, 0.0f } : glm::vec4{};
+			return;
 		}
+		cullProgram.Use();
 
-		const glm::vec3 eyePosition = glm::vec3{ glm::inverse(ViewMat) * glm::vec4{ 0, 0, 0, 1.f } };
-		shadingUniforms.eyePosition = glm::vec4{ eyePosition, 0.0f };
+		mFrameUB.Bind(0);
+		mVertexHeights.Bind(0);
+		mPatchBounds.Bind(1);
+		mInstanceBuffer.Bind(2);
+		MeshGeometry::BindStorage(4, 5);
+		mVisiblePatches.Bind(6);
+		mDrawCommands.Bind(7);
+
+		ShaderProgram::DispatchCompute((mPatchCount + 63) / 64, static_cast<GLuint>(mInstances.size()), 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	}
+
+	// with the pre-pass the shading pass runs after RenderDepth with GL_EQUAL depth test,
+	// and its fragment shader uses early fragment tests
+	void SetDepthPrePass(bool Enabled) { mDepthPrePass = Enabled; }
+
+	// quality settings of the shading program variant, levels as in SceneSettings::noiseLevels
+	void SetNoiseLevels(int Levels) { mVariant.noiseLevels = VariantNoiseLevels(Levels); }
+	void SetCraters(bool Enabled) { mVariant.craters = Enabled; }
+	// the shading pass writes motion vectors to GL_COLOR_ATTACHMENT3
+	void SetTemporalAA(bool Enabled) { mVariant.temporalAA = Enabled; }
+
+	// tessellation density and noise detail, set every frame before CullPatches
+	void SetLod(const LodGovernor::Settings &Lod)
+	{
+		auto &frameUniforms = mFrameUB.GetReference();
+		frameUniforms.maxEdgeLength = Lod.maxEdgeLength;
+		frameUniforms.tessLevelCap = Lod.maxTessLevel;
+		frameUniforms.noiseLevelBias = Lod.noiseLevelBias;
+	}
+
+	// the fragment shader writes no transparency
+	BlendClass GetBlendClass() const override { return BlendClass::Opaque; }
+
+	// depth only: positions of the shading pass, no fragment shader
+	void RenderDepth()
+	{
+		const ShaderProgram &depthProgram = GetDepthProgram();
+		if (mInstances.empty())
+		{
+			return;
+		}
+		depthProgram.Use();
 
-		auto &tessUniforms = mTessControlUB.GetReference();
-		tessUniforms.modelViewMat = ViewMat * ModelMat;
-		tessUniforms.projectionMat = ProjectionMat;
-		tessUniforms.viewport = Viewport;
-		glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &tessUniforms.maxTessLevel);
+		mFrameUB.Bind(0);
+		RenderVisiblePatches();
 	}
 
 	void Render(bool OpaquePass) override
 	{
-		static ShaderProgram pbrProgram;
-		if (!pbrProgram.IsUsable())
+		Variant variant = mVariant;
+		variant.transparency = BlendClass::Opaque != GetBlendClass();
+		variant.earlyFragmentTests = mDepthPrePass;
+		const ShaderProgram &program = GetShadingProgram(variant);
+		if (mInstances.empty())
 		{
-			pbrProgram =
+			return;
+		}
+		program.Use();
+
+		mFrameUB.GetReference().opaquePass = OpaquePass ? 1 : 0;	// don't draw transparent geometry
+		mFrameUB.Bind(0);											// update and bind uniform buffer
+
+		mAlbedo.BindTextureUnit(0);
+		mNormals.BindTextureUnit(1);
+		if (mBakedLevels > 0)
+		{
+			mSurfaceNormalHeight.BindTextureUnit(2);
+			mSurfaceCraterNormal.BindTextureUnit(3);
+		}
+
+		BindEnvironment();
+
+		RenderVisiblePatches();
+	}
+
+	// starts compiling the asteroid programs and the shading variants Scene can select at runtime: its noise
+	// levels and craters for every light count (F1-F3), with and without the depth pre-pass (F4) and TAA (F5);
+	// with parallel shader compilation the driver works on them while the caller continues
+	static void CreatePrograms(const SceneSettings &Scene)
+	{
+		GetCullProgram();
+		GetDepthProgram();
+		for (int lights = 0; lights <= SceneSettings::NumLights; lights++)
+		{
+			for (int switches = 0; switches < 4; switches++)
+			{
+				Variant variant;
+				variant.activeLights = lights;
+				variant.noiseLevels = VariantNoiseLevels(Scene.noiseLevels);
+				variant.craters = Scene.craters;
+				variant.earlyFragmentTests = (switches & 1) != 0;
+				variant.temporalAA = (switches & 2) != 0;
+				GetShadingProgram(variant);
+			}
+		}
+	}
+
+	// waits for the programs started by CreatePrograms
+	static void FinishPrograms()
+	{
+		GetCullProgram().Finish();
+		GetDepthProgram().Finish();
+		for (const auto &program : GetShadingPrograms())
+		{
+			program.second.Finish();
+		}
+	}
+
+protected:
+	// 0 selects all noise levels, others are clamped to the levels evaluated per fragment
+	static int VariantNoiseLevels(int Levels)
+	{
+		return glm::clamp(Levels > 0 ? Levels : AsteroidNoise::MaxLevel, AsteroidNoise::StartLevel + 1, AsteroidNoise::MaxLevel);
+	}
+
+	static const ShaderProgram &GetCullProgram()
+	{
+		static ShaderProgram cullProgram;
+		if (!cullProgram.IsUsable())
+		{
+			cullProgram = ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/asteroid_cull_cs.glsl")) }};
+		}
+		return cullProgram;
+	}
+
+	static const ShaderProgram &GetDepthProgram()
+	{
+		static ShaderProgram depthProgram;
+		if (!depthProgram.IsUsable())
+		{
+			depthProgram =
+				ShaderProgram{{ std::make_tuple(GL_VERTEX_SHADER, 			Shader::GetFileContents("data/shaders/pbr_asteroid_vs.glsl")),
+								std::make_tuple(GL_TESS_CONTROL_SHADER, 	Shader::GetFileContents("data/shaders/pbr_asteroid_cs.glsl")),
+								std::make_tuple(GL_TESS_EVALUATION_SHADER, 	Shader::GetFileContents("data/shaders/pbr_asteroid_depth_es.glsl")) }};
+		}
+		return depthProgram;
+	}
+
+	// shading programs by Variant::GetKey
+	static std::unordered_map<uint32_t, ShaderProgram> &GetShadingPrograms()
+	{
+		static std::unordered_map<uint32_t, ShaderProgram> programs;
+		return programs;
+	}
+
+	static const ShaderProgram &GetShadingProgram(const Variant &ProgramVariant)
+	{
+		ShaderProgram &program = GetShadingPrograms()[ProgramVariant.GetKey()];
+		if (!program.IsUsable())
+		{
+			program =
 				ShaderProgram{{ std::make_tuple(GL_VERTEX_SHADER, 			Shader::GetFileContents("data/shaders/pbr_asteroid_vs.glsl")),
 								std::make_tuple(GL_TESS_CONTROL_SHADER, 	Shader::GetFileContents("data/shaders/pbr_asteroid_cs.glsl")),
 								std::make_tuple(GL_TESS_EVALUATION_SHADER, 	Shader::GetFileContents("data/shaders/pbr_asteroid_es.glsl")),
-								std::make_tuple(GL_FRAGMENT_SHADER, 		Shader::GetFileContents("data/shaders/pbr_asteroid_fs.glsl")) }};
+								std::make_tuple(GL_FRAGMENT_SHADER, 		Shader::AddDefines(Shader::GetFileContents("data/shaders/pbr_asteroid_fs.glsl"), ProgramVariant.GetDefines())) }};
 		}
-		pbrProgram.Use();
+		return program;
+	}
 
+	// patches written by CullPatches, three vertices pulled per visible patch
+	void RenderVisiblePatches()
+	{
 		glPatchParameteri(GL_PATCH_VERTICES, 3);
 
-		mTransformsUB.Bind(0);
-		mShadingUB.Bind(1);											// update and bind uniform buffers
-		mBaseInfoUB.GetReference().opaquePass = OpaquePass ? 1 : 0;	// don't draw transparent geometry
-		mBaseInfoUB.Bind(2);
-		mViewProjectionUB.Bind(3);
-		mTessControlUB.Bind(4);
+		mInstanceBuffer.Bind(2);
+		mNoiseVariants.Bind(3);
+		MeshGeometry::BindStorage(4, 5);
+		mVisiblePatches.Bind(6);
 
-		mAlbedo.BindTextureUnit(0);
-		mNormals.BindTextureUnit(1);
+		mDrawCommands.BindTarget(GL_DRAW_INDIRECT_BUFFER);
+		mPatchSource.RenderArraysIndirect(1);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
 
-		if (nullptr != mEnvironmentPtr)
+	// Heights of the base surface depend only on static mesh positions, so they are evaluated
+	// once on CPU instead of per frame: one value per vertex for the tessellation levels of the
+	// culling pass and bounds of every patch from its vertices, edge midpoints and centroid,
+	// repeated for every noise variant with the direction rotated into the variant's noise domain.
+	void CreateBaseDisplacement(const Mesh &AsteroidMesh)
+	{
+		const auto startTime = std::chrono::steady_clock::now();
+
+		const auto &vertices = AsteroidMesh.vertices();
+		const auto &faces = AsteroidMesh.faces();
+		// points of the tessellated surface before displacement, as interpolated by the evaluation shader
+		auto interpolate = [](const glm::vec3 &A, const glm::vec3 &B)
 		{
-			mEnvironmentPtr->BindTextureUnit(4);
-			mEnvironmentPtr->GetIrmapTexture().BindTextureUnit(5);
-			mEnvironmentPtr->GetSpBrdfLutTexture().BindTextureUnit(6);
+			return 0.5f * (glm::length(A) + glm::length(B)) * glm::normalize(A + B);
+		};
+		std::vector<glm::vec3> vertexPoints, patchPoints;
+		vertexPoints.reserve(vertices.size());
+		patchPoints.reserve(PatchSamples * faces.size());
+		for (const Mesh::Vertex &vertex : vertices)
+		{
+			vertexPoints.push_back(vertex.position);
+		}
+		for (const Mesh::Face &face : faces)
+		{
+			const glm::vec3 &p1 = vertices[face.v1].position, &p2 = vertices[face.v2].position, &p3 = vertices[face.v3].position;
+			patchPoints.push_back((glm::length(p1) + glm::length(p2) + glm::length(p3)) / 3.0f * glm::normalize(p1 + p2 + p3));
+			patchPoints.push_back(interpolate(p1, p2));
+			patchPoints.push_back(interpolate(p2, p3));
+			patchPoints.push_back(interpolate(p3, p1));
 		}
 
-		MeshGeometry::Render();
-	}
+		// variant major: [vertices of variant 0][vertices of variant 1]...[patch samples of variant 0]...
+		std::vector<glm::vec3> directions;
+		std::vector<glm::mat4> noiseRotations;
+		directions.reserve(AsteroidField::NoiseVariants * (vertexPoints.size() + patchPoints.size()));
+		for (const std::vector<glm::vec3> *points : { &vertexPoints, &patchPoints })
+		{
+			for (int variant = 0; variant < AsteroidField::NoiseVariants; variant++)
+			{
+				const glm::mat3 rotation = AsteroidField::noiseRotation(variant);
+				for (const glm::vec3 &point : *points)
+				{
+					directions.push_back(rotation * glm::normalize(point));
+				}
+			}
+		}
+		for (int variant = 0; variant < AsteroidField::NoiseVariants; variant++)
+		{
+			noiseRotations.push_back(glm::mat4{ AsteroidField::noiseRotation(variant) });
+		}
+		const size_t vertexSamples = AsteroidField::NoiseVariants * vertexPoints.size();
 
+		std::vector<glm::vec4> noise(directions.size());
+		ThreadPool::instance().parallelFor(0, directions.size(), 1024, [&](size_t Begin, size_t End)
+		{
+			AsteroidNoise::heightMap(&directions[Begin], End - Begin, &noise[Begin],
+									 AsteroidNoise::StartLevel, AsteroidNoise::BaseLevelCount, 1.0f);
+		});
 
-protected:
-	struct ModelMatrixUB
-	{
-		glm::mat4 modelViewProjectionMatrix;
+		std::vector<GLfloat> heights(noise.size());
+		std::transform(noise.begin(), noise.end(), heights.begin(), [](const glm::vec4 &Noise) { return Noise.w; });
+
+		// bounding sphere and normal cone of the displaced samples of each patch
+		std::vector<glm::vec4> bounds(2 * AsteroidField::NoiseVariants * faces.size());
+		ThreadPool::instance().parallelFor(0, AsteroidField::NoiseVariants * faces.size(), 1024, [&](size_t Begin, size_t End)
+		{
+			for (size_t i = Begin; i < End; i++)
+			{
+				const size_t variant = i / faces.size(), faceIndex = i % faces.size();
+				const Mesh::Face &face = faces[faceIndex];
+				auto displaced = [&](uint32_t Vertex)
+				{
+					return vertices[Vertex].position * AsteroidNoise::heightMapping(heights[variant * vertices.size() + Vertex]);
+				};
+				const size_t patchSample = vertexSamples + PatchSamples * i;
+				auto displacedSample = [&](int Sample)
+				{
+					return patchPoints[PatchSamples * faceIndex + Sample] * AsteroidNoise::heightMapping(heights[patchSample + Sample]);
+				};
+				// ring around the centroid in the winding order of the face
+				const glm::vec3 center = displacedSample(0);
+				const glm::vec3 ring[6] = { displaced(face.v1), displacedSample(1), displaced(face.v2), displacedSample(2), displaced(face.v3), displacedSample(3) };
+
+				glm::vec3 sphereCenter = center;
+				for (const glm::vec3 &point : ring)
+				{
+					sphereCenter += point;
+				}
+				sphereCenter /= 7.0f;
+				float radius = glm::length(center - sphereCenter);
+				float minHeight = heights[patchSample], maxHeight = heights[patchSample];
+				for (int sample = 1; sample < PatchSamples; sample++)
+				{
+					minHeight = std::min(minHeight, heights[patchSample + sample]);
+					maxHeight = std::max(maxHeight, heights[patchSample + sample]);
+				}
+				for (const glm::vec3 &point : ring)
+				{
+					radius = std::max(radius, glm::length(point - sphereCenter));
+				}
+				// the surface between the samples is not bounded by them, widen by the height spread plus a margin
+				radius += 0.125f * (maxHeight - minHeight + BoundsHeightMargin) * glm::length(center);
+
+				glm::vec3 normals[6], axis{ 0.0f };
+				for (int n = 0; n < 6; n++)
+				{
+					normals[n] = glm::cross(ring[n] - center, ring[(n + 1) % 6] - center);
+					axis += normals[n];
+				}
+				float cutoff = 2.0f;		// never culled
+				if (glm::length(axis) > 0.0f)
+				{
+					axis = glm::normalize(axis);
+					float minDot = 1.0f;
+					for (const glm::vec3 &normal : normals)
+					{
+						minDot = (glm::length(normal) > 0.0f) ? std::min(minDot, glm::dot(axis, glm::normalize(normal))) : minDot;
+					}
+					if (minDot > 0.0f)
+					{
+						cutoff = std::sqrt(1.0f - minDot * minDot) + BackfaceMargin;
+					}
+				}
+				bounds[2 * i] = glm::vec4{ sphereCenter, radius };
+				bounds[2 * i + 1] = glm::vec4{ axis, cutoff };
+			}
+		});
+
+		mVertexHeights = StorageBuffer{ heights.data(), static_cast<GLsizeiptr>(vertexSamples * sizeof(GLfloat)) };
+		mPatchBounds = StorageBuffer{ bounds.data(), static_cast<GLsizeiptr>(bounds.size() * sizeof(glm::vec4)) };
+		mNoiseVariants = StorageBuffer{ noiseRotations.data(), static_cast<GLsizeiptr>(noiseRotations.size() * sizeof(glm::mat4)) };
+		mVertexCount = static_cast<GLint>(vertices.size());
+		mPatchCount = static_cast<GLint>(faces.size());
+
+		mBoundingRadius = 0.0f;
+		for (size_t i = 0; i < bounds.size(); i += 2)
+		{
+			mBoundingRadius = std::max(mBoundingRadius, glm::length(glm::vec3{ bounds[i] }) + bounds[i].w);
+		}
+
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+		std::cout << "Asteroid base displacement: " << directions.size() << " samples (" << AsteroidField::NoiseVariants
+				  << " noise variants) in " << elapsed.count() << " ms (" << AsteroidNoise::kernelName(AsteroidNoise::kernel()) << ")" << std::endl;
+	}
+
+	// one work group row of the culling dispatch per instance, the visible list has room for all patches
+	static constexpr size_t MaxInstances = 4096;
+	// centroid and three edge midpoints
+	static constexpr int PatchSamples = 4;
+	// heights between the samples of a patch may leave their range by about this much
+	static constexpr float BoundsHeightMargin = 0.1f;
+	// back faces are kept up to this much past the silhouette, like the former per patch test
+	static constexpr float BackfaceMargin = 0.2f;
+
+	StorageBuffer mVertexHeights, mPatchBounds, mNoiseVariants;
+	Texture mSurfaceNormalHeight, mSurfaceCraterNormal;
+	int mBakedLevels = 0;
+	GLint mVertexCount = 0, mPatchCount = 0;
+	float mBoundingRadius = 0.0f;
+
+	std::vector<AsteroidInstanceData> mInstances;
+	StorageBuffer mInstanceBuffer;
+	// written by CullPatches: VisiblePatch list and the DrawArraysIndirectCommand drawing it
+	StorageBuffer mVisiblePatches, mDrawCommands;
+	MeshGeometry mPatchSource;		// empty, vertices are pulled from the storage buffers
+	bool mDepthPrePass = false;
+	Variant mVariant;				// activeLights follows the lights passed to SetShadingUniforms
+
+	// std430 layout of VisiblePatch in asteroid_instance.glsl
+	struct VisiblePatch
+	{
+		GLuint patchIndex;
+		GLuint instanceIndex;
+		GLuint tessLevels;
 	};
-	UniformBuffer<ModelMatrixUB> mTransformsUB;
 
-	struct ShadingUB
+	// std140 layout of FrameUniforms in asteroid_instance.glsl
+	struct FrameUB
 	{
+		glm::mat4 viewMat;
+		glm::mat4 projectionMat;
+		glm::mat4 viewProjectionMat;
+		glm::vec4 viewport;
 		struct
 		{
 			glm::vec4 direction;
 			glm::vec4 radiance;
 		}
 		lights[SceneSettings::NumLights];
-		glm::vec4 eyePosition;
+		glm::vec3 eyePosition;
+		GLint maxTessLevel;
+		GLint opaquePass;
+		GLint bakedLevels;
+		GLint vertexCount;
+		GLint patchCount;
+		GLfloat maxEdgeLength;
+		GLint tessLevelCap;
+		GLfloat noiseLevelBias;
+		GLfloat normalSampleOffset;
+		glm::mat4 prevViewProjectionMat;
+		glm::vec4 jitter;
 	};
-	UniformBuffer<ShadingUB> mShadingUB;
+	UniformBuffer<FrameUB> mFrameUB;
+};
 
-	struct BaseInfoUB
+// Drawables of a frame sorted into the opaque and the transparency (OIT) pass by their blend class
+class RenderQueue
+{
+public:
+	void Clear()
 	{
-		glm::mat4 modelMat;
-		glm::mat4 modelViewMat;
-		int opaquePass;
-	};
-	UniformBuffer<BaseInfoUB> mBaseInfoUB;
+		mOpaque.clear();
+		mTransparent.clear();
+	}
 
-	struct ViewProjectionMatrixUB
+	void Submit(PbrMeshBase &Item)
 	{
-		glm::mat4 modelMat;
-		glm::mat4 viewMat;
-		glm::mat4 modelViewProjectionMat;
-		glm::vec4 viewport;
-	};
-	UniformBuffer<ViewProjectionMatrixUB> mViewProjectionUB;
+		const PbrMeshBase::BlendClass blendClass = Item.GetBlendClass();
+		if (PbrMeshBase::BlendClass::Transparent != blendClass)
+		{
+			mOpaque.push_back(&Item);
+		}
+		if (PbrMeshBase::BlendClass::Opaque != blendClass)
+		{
+			mTransparent.push_back(&Item);
+		}
+	}
 
-	struct TessControlMatrixUniform
+	bool HasTransparent() const { return !mTransparent.empty(); }
+
+	void Render(bool OpaquePass) const
 	{
-		glm::mat4 modelViewMat;
-		glm::mat4 projectionMat;
-		glm::vec4 viewport;
-		GLint maxTessLevel;
+		for (PbrMeshBase *item : OpaquePass ? mOpaque : mTransparent)
+		{
+			item->Render(OpaquePass);
+		}
+	}
+
+protected:
+	std::vector<PbrMeshBase*> mOpaque, mTransparent;
+};
+
+// Exposure of the tone mapping without CPU readback: a luminance histogram of the HDR scene built with
+// shared memory atomics is reduced by a single workgroup to an exposure that adapts over time. The
+// tone mapping shaders read it from the buffer bound by Bind (exposure.glsl).
+class AutoExposure : public NonCopyable
+{
+public:
+	static constexpr int HistogramBins = 256;
+	// exposure while adaptation is off
+	static constexpr float FixedExposure = 0.3f;
+	// mid grey the average scene luminance is mapped to and the rate of adaptation per second
+	static constexpr float KeyValue = 0.18f;
+	static constexpr float AdaptationSpeed = 1.5f;
+
+	~AutoExposure() override { Release(); }
+
+	// starts compiling the programs, they are waited for on first use or by Finish
+	void Create()
+	{
+		mHistogramProgram =
+			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/luminance_histogram_cs.glsl")) }};
+		mHistogramMsProgram =
+			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::AddDefines(Shader::GetFileContents("data/shaders/luminance_histogram_cs.glsl"), { "MULTISAMPLE" })) }};
+		mReduceProgram =
+			ShaderProgram{{ std::make_tuple(GL_COMPUTE_SHADER, Shader::GetFileContents("data/shaders/exposure_cs.glsl")) }};
+
+		const Data data{};
+		mBuffer = StorageBuffer{ &data, sizeof(data), GL_DYNAMIC_STORAGE_BIT };
+		SetFixed();
+	}
+
+	void Finish() const
+	{
+		mHistogramProgram.Finish();
+		mHistogramMsProgram.Finish();
+		mReduceProgram.Finish();
+	}
+
+	// histogram of the rendered Size part of Scene and adaptation of the exposure over DeltaSeconds,
+	// the first measurement after SetFixed takes the measured exposure at once
+	void Measure(const Texture &Scene, bool Multisample, glm::ivec2 Size, float DeltaSeconds)
+	{
+		Bind(ExposureSlot);
+		Scene.BindTextureUnit(0);
+		ShaderProgram &histogramProgram = Multisample ? mHistogramMsProgram : mHistogramProgram;
+		histogramProgram.Use();
+		histogramProgram.SetVector(0, Size);
+		// one invocation per 2x2 block, 16x16 invocations per workgroup
+		ShaderProgram::DispatchCompute((Size.x + 31) / 32, (Size.y + 31) / 32, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		mReduceProgram.Use();
+		mReduceProgram.SetFloat(0, mAdapting ? 1.0f - std::exp(-DeltaSeconds * AdaptationSpeed) : 1.0f);
+		mReduceProgram.SetFloat(1, KeyValue);
+		ShaderProgram::DispatchCompute(1, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		mAdapting = true;
+	}
+
+	// FixedExposure until the next Measure
+	void SetFixed()
+	{
+		const GLfloat exposure = FixedExposure;
+		mBuffer.Update(offsetof(Data, exposure), sizeof(exposure), &exposure);
+		mAdapting = false;
+	}
+
+	bool IsAdapting() const { return mAdapting; }
+
+	void Bind(GLuint Slot = ExposureSlot) const
+	{
+		mBuffer.Bind(Slot);
+	}
+
+	void Release() override
+	{
+		mBuffer.Release();
+		mHistogramProgram.Release();
+		mHistogramMsProgram.Release();
+		mReduceProgram.Release();
+		mAdapting = false;
+	}
+
+protected:
+	// binding of ExposureBuffer in exposure.glsl
+	static constexpr GLuint ExposureSlot = 8;
+
+	// ExposureBuffer of exposure.glsl
+	struct Data
+	{
+		GLuint bins[HistogramBins];
+		GLfloat exposure;
 	};
-	UniformBuffer<TessControlMatrixUniform> mTessControlUB;
+
+	StorageBuffer mBuffer;
+	ShaderProgram mHistogramProgram;
+	ShaderProgram mHistogramMsProgram;
+	ShaderProgram mReduceProgram;
+	bool mAdapting = false;
 };
 
 //==========================================================================================================================
@@ -1438,35 +3167,124 @@ class Renderer final : public RendererInterface
 {
 public:
 	GLFWwindow* initialize(int width, int height, int maxSamples) override;
+	bool initializeHeadless(int width, int height, int maxSamples) override;
 	void shutdown() override;
-	std::function<void (int w, int h)> setup() override;
+	std::function<void (int w, int h)> setup(const SceneSettings& scene) override;
 	void render(GLFWwindow* window, const ViewSettings& view, const SceneSettings& scene) override;
+	void finish() override;
+	void readFrame(std::vector<unsigned char>& pixels, int& width, int& height) override;
+	bool openFrameReport(const std::string& filename) override;
 
 protected:
+	enum Stage
+	{
+		StageSkybox,
+		StageCull,
+		StageDepth,
+		StageOpaque,
+		StageTransparency,
+		StageExposure,
+		StageResolve,
+		StageTonemap,
+		NumStages
+	};
+
+	// CPU scope and GPU timestamps around a stage of render()
+	class StageTimer
+	{
+	public:
+		StageTimer(Renderer& renderer, Stage stage);
+		~StageTimer();
+
+	private:
+		FrameProfiler::CpuScope m_cpuScope;
+		GpuTimerRing& m_gpuTimers;
+		Stage m_stage;
+	};
+
+	void createRenderTargets(int width, int height, int maxSamples);
+	// scene framebuffers, the OIT accumulation and counter attachments only with transparency;
+	// with temporalAA single sampled with motion vectors and the TAA history instead of the resolve targets
+	void createSceneTargets(int width, int height, bool transparency, bool temporalAA);
 	void renderScene(bool OpaquePass);
+	// stage times of a frame finished on the GPU, for the report, the LOD governor and the render scale;
+	// the governor lowers detail before the render scale drops and raises it only at full scale
+	void onGpuTimes(uint64_t frame, const std::vector<double>& times);
+	// scene asteroid plus count - 1 field instances around it
+	void updateAsteroidField(int count);
+	// environment maps of another quality tier from the cache or precomputed, in place for the meshes sharing it;
+	// called before a frame starts, leaves the GL bindings changed
+	void updateEnvironment(EnvironmentMaps::Quality quality);
+	// reads the precomputed maps back, they are written to the cache on a worker
+	void saveEnvironment(uint64_t key, const EnvironmentMaps::Parameters& parameters);
 
 #ifdef _DEBUG
 	static void logMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
 #endif
 
 	std::shared_ptr<Framebuffer> mFramebuffer, mResolveFramebuffer;
+	int mSamples = 0;
+	bool mTransparencyTargets = false;
+	bool mTemporalAATargets = false;
+	// temporal anti-aliasing: the resolve reads one history target and writes the other, which is
+	// tonemapped; matrices and jitter of the previous frame give the motion vectors
+	std::array<std::shared_ptr<Framebuffer>, 2> mHistoryFramebuffers;
+	int mHistoryIndex = 0;
+	bool mHistoryValid = false;
+	glm::ivec2 mHistorySize { 0, 0 };
+	int mJitterIndex = 0;
+	glm::mat4 mPrevViewProjection { 1.0f };
+	glm::mat4 mPrevSkyViewProjection { 1.0f };
+	glm::vec2 mPrevJitter { 0.0f, 0.0f };
+	RenderQueue mRenderQueue;
+	// tonemapped frame of the headless mode, there is no default framebuffer
+	std::shared_ptr<Framebuffer> mOutputFramebuffer;
+	void* mEglDisplay = nullptr;
+	void* mEglContext = nullptr;
+
+	// GL calls issued and dropped as redundant by the state cache, level of the LOD governor, render scale
+	enum Counter
+	{
+		CounterGlCalls,
+		CounterGlCallsElided,
+		CounterLodLevel,
+		CounterRenderScale,
+	};
+
+	FrameProfiler mProfiler { { "skybox", "cull", "depth", "opaque", "transparency", "exposure", "resolve", "tonemap" }, { "gl_calls", "gl_calls_elided", "lod_level", "render_scale" } };
+	GpuTimerRing mGpuTimers;
+	LodGovernor mLodGovernor;
+	// scene targets are allocated at mTargetSize, frames are rendered into the lower left
+	// mDynamicResolution.renderSize part and scaled to the output after the resolve
+	DynamicResolution mDynamicResolution;
+	glm::ivec2 mTargetSize { 0, 0 };
 
 	std::shared_ptr<Camera> mCameraPtr;
 
 	MeshGeometry mFullScreenQuad;
 	MeshGeometry mSkybox;
 	PbrAsteroid mPbrAsteroid;
+	int mAsteroidCount = 1;
 
 	MeshGeometry mEmptyVao;
 
 	ShaderProgram mSkyboxProgram;
-	ShaderProgram mTonemapProgram;
+	ShaderProgram mResolveProgram;			// MSAA resolve, OIT composition and tone mapping
+	ShaderProgram mResolveOpaqueProgram;	// without OIT composition
+	ShaderProgram mTonemapProgram;			// of the TAA history
+	ShaderProgram mTaaProgram;
+	ShaderProgram mTaaOpaqueProgram;
+	AutoExposure mAutoExposure;
+	std::chrono::steady_clock::time_point mLastFrameTime;
 
 	std::shared_ptr<Environment> mEnvPtr;
+	EnvironmentMaps::Quality mEnvQuality = EnvironmentMaps::Quality::High;
 
 	struct SkyboxUB
 	{
 		glm::mat4 skyViewProjectionMatrix;
+		glm::mat4 prevSkyViewProjectionMatrix;
+		glm::vec4 jitter;
 	};
 	UniformBuffer<SkyboxUB> mSkyboxUB;
 };
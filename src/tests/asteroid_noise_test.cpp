@@ -0,0 +1,194 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * asteroid-noise-test: AsteroidNoise against reference values of height_map() in asteroid_base.glsl and
+ * every kernel the CPU supports against the scalar one. No GL device is needed.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../common/asteroid_noise.hpp"
+
+namespace {
+	int failures = 0;
+
+	void check(bool condition, const std::string& what)
+	{
+		if (!condition)
+		{
+			std::cout << "FAILED: " << what << std::endl;
+			failures++;
+		}
+	}
+
+	struct Reference
+	{
+		glm::vec3 position;
+		glm::vec4 expected;			// vec4(normal, height) of height_map(position, START_LEVEL, levelCount, 1.0)
+	};
+
+	// Taken from the shader: asteroid_base.glsl compiled as C++ with GLSL vector types and single precision
+	// sin/cos/atan/log/exp, on 32 directions of a Fibonacci sphere. The hashes of random3D() amplify the last
+	// bit of sin(), so no implementation matches another exactly; the tolerances below bound the agreement.
+
+	// levelCount 5, six detail levels
+	const Reference SixLevels[] = {
+		{ { 0.248039186f, 0.96875f, 0.0f }, { 0.039695397f, 0.999211848f, -2.24673897e-07f, 0.776509702f } },
+		{ { -0.311716914f, 0.90625f, 0.285558224f }, { -0.174111813f, 0.962361038f, 0.208677217f, 0.69239825f } },
+		{ { 0.046924565f, 0.84375f, -0.534681261f }, { 0.513814569f, 0.590548098f, -0.622292101f, 0.653679371f } },
+		{ { 0.379798651f, 0.78125f, 0.495380074f }, { 0.245904401f, 0.896019876f, 0.369701713f, 0.658100367f } },
+		{ { -0.684640348f, 0.71875f, -0.121103242f }, { -0.53831327f, 0.754001439f, -0.376431376f, 0.663538039f } },
+		{ { 0.636650085f, 0.65625f, -0.404984683f }, { 0.761723638f, 0.414790004f, -0.497721136f, 0.672792494f } },
+		{ { -0.208890498f, 0.59375f, 0.777062237f }, { -0.338632494f, 0.818829298f, 0.46351549f, 0.725865662f } },
+		{ { -0.390487403f, 0.53125f, -0.751859725f }, { -0.6620875f, 0.581125855f, -0.473215461f, 0.726850331f } },
+		{ { 0.829731524f, 0.46875f, 0.303016603f }, { 0.661443353f, 0.695918739f, 0.279624343f, 0.615935445f } },
+		{ { -0.844631791f, 0.40625f, 0.348651737f }, { -0.989472449f, 0.0245148577f, -0.142629936f, 0.763960302f } },
+		{ { 0.398017317f, 0.34375f, -0.850539923f }, { 0.0499420576f, 0.703654349f, -0.708785117f, 0.703556478f } },
+		{ { 0.287203133f, 0.28125f, 0.915648818f }, { 0.514305413f, 0.218005866f, 0.829435527f, 0.722275019f } },
+		{ { -0.84425658f, 0.21875f, -0.489263952f }, { -0.483689547f, 0.803884685f, -0.346141607f, 0.682844043f } },
+		{ { 0.964679778f, 0.15625f, -0.212082148f }, { 0.769764423f, 0.521027684f, 0.368772089f, 0.741562426f } },
+		{ { -0.572596431f, 0.09375f, 0.814459503f }, { -0.75946188f, -0.233550057f, 0.607183695f, 0.764974356f } },
+		{ { -0.12844792f, 0.03125f, -0.991223752f }, { 0.102008209f, 0.24623926f, -0.963826001f, 0.714580655f } },
+		{ { 0.764275551f, -0.03125f, 0.644132257f }, { 0.801083446f, 0.116305165f, 0.587144375f, 0.778214991f } },
+		{ { -0.994745612f, -0.09375f, 0.0411358513f }, { -0.930500329f, 0.0567453764f, 0.361868888f, 0.828036427f } },
+		{ { 0.70012325f, -0.15625f, -0.69671613f }, { 0.678325295f, 0.399211735f, -0.616850734f, 0.765079916f } },
+		{ { -0.0450727306f, -0.21875f, 0.974739373f }, { 0.0683031157f, -0.46787402f, 0.881151855f, 0.748022079f } },
+		{ { -0.614846647f, -0.28125f, -0.73679173f }, { -0.783306301f, -0.451487899f, -0.4273054f, 0.81225425f } },
+		{ { 0.930674851f, -0.34375f, 0.125220984f }, { 0.602168381f, -0.679305851f, 0.419448376f, 0.868089736f } },
+		{ { -0.750069141f, -0.40625f, 0.521878541f }, { -0.941722333f, 0.00463259779f, 0.336359292f, 0.656529784f } },
+		{ { 0.193874672f, -0.46875f, -0.861792326f }, { -0.465028673f, 0.0648136884f, -0.882919908f, 0.728070676f } },
+		{ { 0.42121914f, -0.53125f, 0.73508358f }, { 0.819141805f, -0.525451005f, 0.23001729f, 0.708091676f } },
+		{ { -0.76658386f, -0.59375f, -0.244561151f }, { -0.84228462f, -0.304492027f, -0.444793314f, 0.764221191f } },
+		{ { 0.684967935f, -0.65625f, -0.31647256f }, { 0.376779824f, -0.800058186f, -0.466844559f, 0.825076222f } },
+		{ { -0.268416137f, -0.71875f, 0.641366661f }, { -0.637318492f, -0.642258823f, 0.425827146f, 0.767917991f } },
+		{ { -0.211268097f, -0.78125f, -0.587379098f }, { 0.356908143f, -0.891960263f, -0.277531087f, 0.694773614f } },
+		{ { 0.475113362f, -0.84375f, 0.249706268f }, { 0.211177915f, -0.477644444f, 0.852795243f, 0.828462541f } },
+		{ { -0.408778995f, -0.90625f, 0.10775283f }, { 0.0566404983f, -0.993593454f, 0.0977956131f, 0.717321575f } },
+		{ { 0.134148955f, -0.96875f, -0.208632439f }, { -0.07083188f, -0.950028121f, 0.304022133f, 0.756444275f } },
+	};
+
+	// levelCount AsteroidNoise::BaseLevelCount, the base displacement of mesh vertices
+	const Reference BaseLevels[] = {
+		{ { 0.248039186f, 0.96875f, 0.0f }, { 0.329599917f, 0.944120228f, 0.000955413445f, 0.77921176f } },
+		{ { -0.311716914f, 0.90625f, 0.285558224f }, { -0.271007717f, 0.929436684f, 0.250404179f, 0.695076525f } },
+		{ { 0.046924565f, 0.84375f, -0.534681261f }, { 0.288182884f, 0.718531609f, -0.632979453f, 0.657158256f } },
+		{ { 0.379798651f, 0.78125f, 0.495380074f }, { 0.234613076f, 0.855347276f, 0.461884946f, 0.661481619f } },
+		{ { -0.684640348f, 0.71875f, -0.121103242f }, { -0.534812927f, 0.776425004f, -0.333375543f, 0.667775154f } },
+		{ { 0.636650085f, 0.65625f, -0.404984683f }, { 0.753469527f, 0.498839229f, -0.428302616f, 0.675391674f } },
+		{ { -0.208890498f, 0.59375f, 0.777062237f }, { -0.233298093f, 0.808434904f, 0.540374875f, 0.728665411f } },
+		{ { -0.390487403f, 0.53125f, -0.751859725f }, { -0.399021536f, 0.501319468f, -0.767763376f, 0.72786051f } },
+		{ { 0.829731524f, 0.46875f, 0.303016603f }, { 0.760405123f, 0.493054956f, 0.422706574f, 0.61918354f } },
+		{ { -0.844631791f, 0.40625f, 0.348651737f }, { -0.960062742f, 0.145753294f, 0.238821f, 0.767613113f } },
+		{ { 0.398017317f, 0.34375f, -0.850539923f }, { 0.386061072f, 0.4562805f, -0.801726222f, 0.710085213f } },
+		{ { 0.287203133f, 0.28125f, 0.915648818f }, { 0.434490144f, 0.483022809f, 0.760202169f, 0.724955142f } },
+		{ { -0.84425658f, 0.21875f, -0.489263952f }, { -0.684598565f, 0.647335649f, -0.33508411f, 0.686042845f } },
+		{ { 0.964679778f, 0.15625f, -0.212082148f }, { 0.965821922f, 0.244546473f, 0.0859367028f, 0.745361149f } },
+		{ { -0.572596431f, 0.09375f, 0.814459503f }, { -0.632307053f, -0.23377791f, 0.73860389f, 0.769499004f } },
+		{ { -0.12844792f, 0.03125f, -0.991223752f }, { 0.159995452f, 0.0283274483f, -0.986711204f, 0.719409168f } },
+		{ { 0.764275551f, -0.03125f, 0.644132257f }, { 0.843638122f, 0.162107185f, 0.511855483f, 0.782993436f } },
+		{ { -0.994745612f, -0.09375f, 0.0411358513f }, { -0.980435491f, -0.135740325f, 0.14255105f, 0.830330014f } },
+		{ { 0.70012325f, -0.15625f, -0.69671613f }, { 0.548822999f, 0.0184010118f, -0.835736036f, 0.77071172f } },
+		{ { -0.0450727306f, -0.21875f, 0.974739373f }, { 0.122927673f, -0.386726499f, 0.913964689f, 0.750495851f } },
+		{ { -0.614846647f, -0.28125f, -0.73679173f }, { -0.400339991f, -0.562318802f, -0.723550558f, 0.815003455f } },
+		{ { 0.930674851f, -0.34375f, 0.125220984f }, { 0.759126782f, -0.435324728f, 0.483961731f, 0.870792389f } },
+		{ { -0.750069141f, -0.40625f, 0.521878541f }, { -0.838812053f, -0.234861314f, 0.49115628f, 0.660963595f } },
+		{ { 0.193874672f, -0.46875f, -0.861792326f }, { -0.0956290737f, -0.189340293f, -0.977243781f, 0.741096318f } },
+		{ { 0.42121914f, -0.53125f, 0.73508358f }, { 0.699880481f, -0.566389441f, 0.435166925f, 0.713186383f } },
+		{ { -0.76658386f, -0.59375f, -0.244561151f }, { -0.754445493f, -0.541534662f, -0.370880395f, 0.768514752f } },
+		{ { 0.684967935f, -0.65625f, -0.31647256f }, { 0.438646168f, -0.804473937f, -0.400513679f, 0.831983805f } },
+		{ { -0.268416137f, -0.71875f, 0.641366661f }, { -0.146450654f, -0.752817333f, 0.641730666f, 0.771614015f } },
+		{ { -0.211268097f, -0.78125f, -0.587379098f }, { 0.0217264649f, -0.924944043f, -0.379481971f, 0.700360835f } },
+		{ { 0.475113362f, -0.84375f, 0.249706268f }, { 0.43184346f, -0.533974528f, 0.726899207f, 0.831986606f } },
+		{ { -0.408778995f, -0.90625f, 0.10775283f }, { -0.235564604f, -0.966384232f, 0.103009179f, 0.721010745f } },
+		{ { 0.134148955f, -0.96875f, -0.208632439f }, { -0.0518593565f, -0.99304539f, 0.105695285f, 0.758754015f } },
+	};
+
+	const float HeightTolerance = 1e-3f;
+	const float NormalTolerance = 1e-2f;
+
+	template<std::size_t N>
+	void testReference(const Reference (&references)[N], float levelCount, bool checkNormals, const std::string& name)
+	{
+		std::vector<glm::vec3> positions;
+		for (const Reference& reference : references)
+		{
+			positions.push_back(reference.position);
+		}
+		std::vector<glm::vec4> results(N);
+		AsteroidNoise::heightMap(positions.data(), N, results.data(), AsteroidNoise::StartLevel, levelCount, 1.0f);
+
+		for (std::size_t i = 0; i < N; i++)
+		{
+			const glm::vec4& expected = references[i].expected;
+			const glm::vec4& result = results[i];
+			const std::string what = name + " direction " + std::to_string(i);
+			check(std::abs(result.w - expected.w) <= HeightTolerance, what + ": height " + std::to_string(result.w) +
+				  ", shader " + std::to_string(expected.w));
+			if (checkNormals)
+			{
+				const float normalError = std::max({ std::abs(result.x - expected.x), std::abs(result.y - expected.y),
+													 std::abs(result.z - expected.z) });
+				check(normalError <= NormalTolerance, what + ": normal off by " + std::to_string(normalError));
+			}
+			check(AsteroidNoise::heightMap(references[i].position, AsteroidNoise::StartLevel, levelCount, 1.0f) == result,
+				  what + ": single position matches the batch");
+		}
+	}
+
+	// SIMD kernels have to reproduce the scalar one bit for bit, including positions that share a pack
+	void testKernels()
+	{
+		std::vector<glm::vec3> positions;
+		for (int i = 0; i < 1000; i++)
+		{
+			const float z = 1.0f - (2.0f * i + 1.0f) / 1000.0f;
+			const float angle = 2.39996323f * i;
+			positions.push_back(glm::vec3{ std::sqrt(1.0f - z * z) * std::cos(angle), z, std::sqrt(1.0f - z * z) * std::sin(angle) });
+		}
+
+		const AsteroidNoise::Kernel initial = AsteroidNoise::kernel();
+		check(AsteroidNoise::setKernel(AsteroidNoise::Kernel::Scalar), "scalar kernel is always supported");
+		std::vector<glm::vec4> scalar(positions.size());
+		AsteroidNoise::heightMap(positions.data(), positions.size(), scalar.data(), AsteroidNoise::StartLevel,
+								 float(AsteroidNoise::BaseLevelCount), 1.0f);
+
+		for (const AsteroidNoise::Kernel kernel : { AsteroidNoise::Kernel::Sse41, AsteroidNoise::Kernel::Avx2, AsteroidNoise::Kernel::Avx2x2 })
+		{
+			if (!AsteroidNoise::setKernel(kernel))
+			{
+				std::cout << AsteroidNoise::kernelName(kernel) << " not supported, skipped" << std::endl;
+				continue;
+			}
+			std::vector<glm::vec4> results(positions.size());
+			AsteroidNoise::heightMap(positions.data(), positions.size(), results.data(), AsteroidNoise::StartLevel,
+									 float(AsteroidNoise::BaseLevelCount), 1.0f);
+			check(0 == std::memcmp(results.data(), scalar.data(), results.size() * sizeof(glm::vec4)),
+				  std::string(AsteroidNoise::kernelName(kernel)) + " kernel matches the scalar one");
+		}
+		AsteroidNoise::setKernel(initial);
+	}
+}
+
+int main()
+{
+	// the detected kernel against the shader, then the other supported kernels against the scalar one
+	testReference(SixLevels, 5.0f, true, "six levels");
+	testReference(BaseLevels, float(AsteroidNoise::BaseLevelCount), false, "base levels");
+	testKernels();
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "all checks passed" << std::endl;
+	return 0;
+}
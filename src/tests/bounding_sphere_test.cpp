@@ -0,0 +1,83 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * bounding-sphere-test: scale of model matrices and the frustum test of BoundingSphere, which mirrors
+ * the instance test of asteroid_cull_cs.glsl, for spheres on either side of a frustum plane.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../common/bounding_sphere.hpp"
+
+namespace {
+	int failures = 0;
+
+	void check(bool condition, const std::string& what)
+	{
+		if (!condition)
+		{
+			std::cout << "FAILED: " << what << std::endl;
+			failures++;
+		}
+	}
+
+	void testMaxColumnLength()
+	{
+		check(std::abs(BoundingSphere::maxColumnLength(glm::mat4{ 1.0f }) - 1.0f) < 1e-6f, "identity has scale 1");
+
+		const glm::mat4 uniform = glm::translate(glm::mat4{ 1.0f }, glm::vec3{ 5.0f, -3.0f, 2.0f }) *
+								  glm::rotate(glm::mat4{ 1.0f }, 0.7f, glm::normalize(glm::vec3{ 1.0f, 2.0f, 3.0f })) *
+								  glm::scale(glm::mat4{ 1.0f }, glm::vec3{ 2.5f });
+		check(std::abs(BoundingSphere::maxColumnLength(uniform) - 2.5f) < 1e-5f, "translation and rotation keep the scale");
+
+		const glm::mat4 stretched = glm::rotate(glm::mat4{ 1.0f }, 1.1f, glm::vec3{ 0.0f, 1.0f, 0.0f }) *
+									glm::scale(glm::mat4{ 1.0f }, glm::vec3{ 1.0f, 4.0f, 2.0f });
+		check(std::abs(BoundingSphere::maxColumnLength(stretched) - 4.0f) < 1e-5f, "non uniform scale takes the largest axis");
+	}
+
+	// 90 degree frustum looking down -z: at z = -10 the right plane passes through x = 10 with its
+	// normal at 45 degrees, an x offset of sqrt(2) * d puts a center d outside of it
+	void testFrustumEdge()
+	{
+		const glm::mat4 viewProjectionMat = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f) *
+											glm::lookAt(glm::vec3{ 0.0f }, glm::vec3{ 0.0f, 0.0f, -1.0f }, glm::vec3{ 0.0f, 1.0f, 0.0f });
+		const float objectRadius = 1.0f;
+		const float modelScale = 2.5f;
+		auto outside = [](float distance) { return glm::vec3{ 10.0f + std::sqrt(2.0f) * distance, 0.0f, -10.0f }; };
+
+		check(!BoundingSphere::isOutsideFrustum(viewProjectionMat, glm::vec3{ 0.0f, 0.0f, -10.0f }, objectRadius), "centered sphere is kept");
+		check(!BoundingSphere::isOutsideFrustum(viewProjectionMat, outside(-0.5f), objectRadius), "sphere inside the plane is kept");
+
+		// scaled asteroid with its center 1.5 outside the right plane still reaches 1 unit into the frustum
+		const glm::vec3 center = outside(1.5f);
+		const glm::mat4 modelMat = glm::translate(glm::mat4{ 1.0f }, center) * glm::scale(glm::mat4{ 1.0f }, glm::vec3{ modelScale });
+		const float worldRadius = BoundingSphere::maxColumnLength(modelMat) * objectRadius;
+		check(!BoundingSphere::isOutsideFrustum(viewProjectionMat, center, worldRadius), "scaled radius keeps an asteroid overlapping the plane");
+		check(BoundingSphere::isOutsideFrustum(viewProjectionMat, center, objectRadius), "object space radius culls the same asteroid");
+
+		check(!BoundingSphere::isOutsideFrustum(viewProjectionMat, outside(2.49f), worldRadius), "asteroid just touching the plane is kept");
+		check(BoundingSphere::isOutsideFrustum(viewProjectionMat, outside(2.51f), worldRadius), "asteroid just past the plane is culled");
+
+		check(BoundingSphere::isOutsideFrustum(viewProjectionMat, glm::vec3{ 0.0f, 0.0f, 10.0f }, objectRadius), "sphere behind the eye is culled");
+	}
+}
+
+int main()
+{
+	testMaxColumnLength();
+	testFrustumEdge();
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "all checks passed" << std::endl;
+	return 0;
+}
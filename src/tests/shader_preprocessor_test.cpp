@@ -0,0 +1,193 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * shader-preprocessor-test: include expansion, #line mapping, defines, the file cache and the source
+ * hash of ShaderPreprocessor on files written to a temporary directory. No GL device is needed.
+ */
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../common/shader_preprocessor.hpp"
+
+namespace {
+	int failures = 0;
+
+	void check(bool condition, const std::string& what)
+	{
+		if (!condition)
+		{
+			std::cout << "FAILED: " << what << std::endl;
+			failures++;
+		}
+	}
+
+	void checkEqual(const std::string& actual, const std::string& expected, const std::string& what)
+	{
+		check(actual == expected, what);
+		if (actual != expected)
+		{
+			std::cout << "expected:" << std::endl << expected << "actual:" << std::endl << actual << std::endl;
+		}
+	}
+
+	void write(const std::filesystem::path& path, const std::string& contents)
+	{
+		std::ofstream stream{ path, std::ios::binary | std::ios::trunc };
+		stream << contents;
+	}
+
+	// std::cout of the calls in between, where the preprocessor reports errors
+	class CaptureOutput
+	{
+	public:
+		CaptureOutput() : m_previous(std::cout.rdbuf(m_stream.rdbuf())) {}
+		~CaptureOutput() { std::cout.rdbuf(m_previous); }
+		std::string text() const { return m_stream.str(); }
+
+	private:
+		std::ostringstream m_stream;
+		std::streambuf* m_previous;
+	};
+
+	void testIncludes(const std::string& dir)
+	{
+		write(dir + "/common.glsl", "#pragma once\nconst float PI = 3.14159;\n");
+		write(dir + "/lib/light.glsl", "#include \"../common.glsl\"\nfloat light() { return PI; }\n");
+		write(dir + "/main.glsl", "#version 450 core\n#include \"common.glsl\"\n#include \"lib/light.glsl\"\nvoid main() {}\n");
+
+		ShaderPreprocessor preprocessor;
+		const std::string output = preprocessor.process(dir + "/main.glsl");
+		// main.glsl is string 0, common.glsl 1, lib/light.glsl 2; the second include of common.glsl is dropped,
+		// every part after an include restarts at its own line and string number
+		checkEqual(output,
+				   "#version 450 core\n"
+				   "#line 2 1\nconst float PI = 3.14159;\n"
+				   "#line 2 2\nfloat light() { return PI; }\n"
+				   "#line 4 0\nvoid main() {}\n",
+				   "nested includes with #pragma once");
+		checkEqual(preprocessor.fileName(0), dir + "/main.glsl", "string 0 is the processed file");
+		checkEqual(preprocessor.fileName(1), dir + "/common.glsl", "string 1 is the first include");
+		checkEqual(preprocessor.fileName(2), dir + "/lib/light.glsl", "include path is normalized relative to the includer");
+		check(preprocessor.fileName(3).empty(), "unknown string number has no file");
+		checkEqual(preprocessor.sourceNumbers(), "0: " + dir + "/main.glsl\n1: " + dir + "/common.glsl\n2: " + dir + "/lib/light.glsl\n",
+				   "source numbers list");
+	}
+
+	void testIncludeWithoutOnce(const std::string& dir)
+	{
+		write(dir + "/twice.glsl", "float twice;\n");
+		write(dir + "/twice_main.glsl", "#include \"twice.glsl\"\n#include \"twice.glsl\"\n");
+
+		ShaderPreprocessor preprocessor;
+		checkEqual(preprocessor.process(dir + "/twice_main.glsl"), "#line 1 1\nfloat twice;\n#line 1 1\nfloat twice;\n",
+				   "file without #pragma once is expanded every time");
+	}
+
+	void testCycle(const std::string& dir)
+	{
+		write(dir + "/cycle_a.glsl", "#include \"cycle_b.glsl\"\nfloat a;\n");
+		write(dir + "/cycle_b.glsl", "#include \"cycle_a.glsl\"\nfloat b;\n");
+
+		ShaderPreprocessor preprocessor;
+		std::string output, errors;
+		{
+			CaptureOutput capture;
+			output = preprocessor.process(dir + "/cycle_a.glsl");
+			errors = capture.text();
+		}
+		check(errors.find("ERROR: ShaderPreprocessor: includes nested too deep") != std::string::npos, "cycle reports the depth limit");
+		check(errors.find("missing #pragma once?") != std::string::npos, "depth limit error hints at #pragma once");
+		check(!output.empty() && output.size() < 4096, "cycle stops at the depth limit");
+	}
+
+	void testDefines(const std::string& dir)
+	{
+		write(dir + "/defines.glsl", "// header\n#version 450\nfloat x = VALUE;\n");
+
+		ShaderPreprocessor preprocessor;
+		// #line only after #version, the comment above it is kept
+		checkEqual(preprocessor.process(dir + "/defines.glsl", { "VALUE 2.0", "FLAG" }),
+				   "// header\n#version 450\n#define VALUE 2.0\n#define FLAG\n#line 3 0\nfloat x = VALUE;\n",
+				   "defines follow #version");
+
+		write(dir + "/no_version.glsl", "float y;\n");
+		checkEqual(preprocessor.process(dir + "/no_version.glsl", { "FLAG" }), "#define FLAG\n#line 1 1\nfloat y;\n",
+				   "defines lead a source without #version");
+
+		checkEqual(ShaderPreprocessor::addDefines("#version 450\nvoid main() {}\n", { "A 1" }), "#version 450\n#define A 1\nvoid main() {}\n",
+				   "addDefines after #version");
+		checkEqual(ShaderPreprocessor::addDefines("void main() {}\n", { "A 1" }), "#define A 1\nvoid main() {}\n",
+				   "addDefines without #version");
+	}
+
+	void testCache(const std::string& dir)
+	{
+		const std::string filename = dir + "/cached.glsl";
+		write(filename, "float first;\n");
+		const std::filesystem::file_time_type time = std::filesystem::last_write_time(filename);
+
+		ShaderPreprocessor preprocessor;
+		const std::string first = preprocessor.process(filename);
+
+		// same modification time: the cached contents are reused
+		write(filename, "float second;\n");
+		std::filesystem::last_write_time(filename, time);
+		checkEqual(preprocessor.process(filename), first, "unchanged modification time reuses the cache");
+
+		// newer modification time: read again under the same string number
+		std::filesystem::last_write_time(filename, time + std::chrono::seconds(2));
+		checkEqual(preprocessor.process(filename), "#line 1 0\nfloat second;\n", "changed modification time reloads the file");
+		checkEqual(preprocessor.sourceNumbers(), "0: " + filename + "\n", "reload keeps the string number");
+
+		preprocessor.clear();
+		check(preprocessor.fileName(0).empty(), "clear drops the source numbers");
+	}
+
+	void testHash()
+	{
+		// FNV-1a 64 reference values
+		check(ShaderPreprocessor::hash(std::string()) == 14695981039346656037ull, "hash of nothing is the seed");
+		check(ShaderPreprocessor::hash(std::string("a")) == 0xaf63dc4c8601ec8cull, "hash of \"a\"");
+		check(ShaderPreprocessor::hash(std::string("foobar")) == 0x85944171f73967e8ull, "hash of \"foobar\"");
+		check(ShaderPreprocessor::hash(std::string("bar"), ShaderPreprocessor::hash(std::string("foo"))) == ShaderPreprocessor::hash(std::string("foobar")),
+			  "seed chains sources");
+
+		const std::string source = "#version 450\nvoid main() {}\n";
+		check(ShaderPreprocessor::hash(ShaderPreprocessor::addDefines(source, { "LIGHTS 1" })) == ShaderPreprocessor::hash(ShaderPreprocessor::addDefines(source, { "LIGHTS 1" })),
+			  "hash is stable");
+		check(ShaderPreprocessor::hash(ShaderPreprocessor::addDefines(source, { "LIGHTS 1" })) != ShaderPreprocessor::hash(ShaderPreprocessor::addDefines(source, { "LIGHTS 2" })),
+			  "hash changes with a define");
+	}
+}
+
+int main()
+{
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() /
+		("shader-preprocessor-test-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+	std::filesystem::create_directories(dir / "lib");
+	const std::string dirName = dir.lexically_normal().generic_string();
+
+	testIncludes(dirName);
+	testIncludeWithoutOnce(dirName);
+	testCycle(dirName);
+	testDefines(dirName);
+	testCache(dirName);
+	testHash();
+
+	std::error_code error;
+	std::filesystem::remove_all(dir, error);
+
+	if (failures > 0)
+	{
+		std::cout << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "all checks passed" << std::endl;
+	return 0;
+}
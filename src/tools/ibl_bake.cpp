@@ -0,0 +1,180 @@
+/*
+ * Physically Based Rendering
+ * Forked from Michał Siejak PBR project
+ *
+ * ibl-bake: precomputes the environment maps on CPU, without a GL device. The output is the cache file
+ * the renderer loads on startup (data/cache/environment_<key>.bin), --compare checks it against maps
+ * the GPU precompute wrote there.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "../common/environment_maps.hpp"
+#include "../common/ibl_precompute.hpp"
+#include "../common/image.hpp"
+#include "../common/thread_pool.hpp"
+#include "../common/utils.hpp"
+
+namespace {
+	void printUsage(const char* program)
+	{
+		std::cerr << "Usage: " << program << " [--input file.hdr] [--cache dir/] [--out file] [--compare file] [--quality tier]" << std::endl
+				  << "  run from the directory with data/, the shaders are part of the cache key" << std::endl
+				  << "  --input is the equirectangular environment, data/textures/skybox.hdr by default" << std::endl
+				  << "  --cache is the directory the renderer reads, data/cache/ by default; --out overrides the file name" << std::endl
+				  << "  --compare prints the difference to maps of the same key, e.g. those written by the GPU precompute" << std::endl
+				  << "  --quality is the environment tier of the renderer: low, medium, high (default) or reference" << std::endl;
+	}
+
+	bool parseArguments(int argc, char* argv[], std::string& input, std::string& cache, std::string& output, std::string& compare,
+						 EnvironmentMaps::Quality& quality)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--input" && hasValue)
+			{
+				input = argv[++i];
+			}
+			else if (arg == "--cache" && hasValue)
+			{
+				cache = argv[++i];
+			}
+			else if (arg == "--out" && hasValue)
+			{
+				output = argv[++i];
+			}
+			else if (arg == "--compare" && hasValue)
+			{
+				compare = argv[++i];
+			}
+			else if (arg == "--quality" && hasValue)
+			{
+				if (!EnvironmentMaps::parseQuality(argv[++i], quality))
+				{
+					return false;
+				}
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// largest absolute and root mean square relative difference of every map level
+	void printDifference(const EnvironmentMaps& baked, const EnvironmentMaps& reference)
+	{
+		const char* names[EnvironmentMaps::NumMaps] = { "specular", "brdf lut" };
+		for (int map = 0; map < EnvironmentMaps::NumMaps; map++)
+		{
+			const EnvironmentMaps::Map m = EnvironmentMaps::Map(map);
+			for (int level = 0; level < baked.levels(m); level++)
+			{
+				const std::size_t count = baked.levelBytes(m, level) / sizeof(uint16_t);
+				const uint16_t* a = baked.data(m, level);
+				const uint16_t* b = reference.data(m, level);
+				double maxDifference = 0.0, sumSquares = 0.0;
+				for (std::size_t i = 0; i < count; i++)
+				{
+					const double x = Utility::halfToFloat(a[i]), y = Utility::halfToFloat(b[i]);
+					const double difference = std::abs(x - y);
+					maxDifference = std::max(maxDifference, difference);
+					const double relative = difference / std::max(std::abs(y), 1e-3);
+					sumSquares += relative * relative;
+				}
+				std::cout << "  " << std::setw(13) << names[map] << " level " << std::setw(2) << level
+						  << ": max " << std::setw(10) << maxDifference << ", relative rms " << std::sqrt(sumSquares / double(count)) << std::endl;
+			}
+		}
+		double maxDifference = 0.0;
+		for (int i = 0; i < EnvironmentMaps::SHFloats; i++)
+		{
+			maxDifference = std::max(maxDifference, double(std::abs(baked.irradianceSH()[i] - reference.irradianceSH()[i])));
+		}
+		std::cout << "  irradiance sh: max " << maxDifference << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::string input = "data/textures/skybox.hdr";
+	std::string cache = "data/cache/";
+	std::string output, compare;
+	EnvironmentMaps::Quality quality = EnvironmentMaps::Quality::High;
+	if (!parseArguments(argc, argv, input, cache, output, compare, quality))
+	{
+		printUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const EnvironmentMaps::Parameters parameters = EnvironmentMaps::parameters(quality);
+	const uint64_t key = EnvironmentMaps::key(input, parameters);
+	if (0 == key)
+	{
+		std::cerr << "ERROR: could not read " << input << " or the precompute programs" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (output.empty())
+	{
+		output = EnvironmentMaps::fileName(cache, key);
+	}
+
+	try
+	{
+		std::shared_ptr<Image> equirect = Image::fromFile(input, 3);
+		EnvironmentMaps maps{ key, parameters };
+		ThreadPool& pool = ThreadPool::instance();
+		IblPrecompute precompute{ pool };
+		precompute.run(*equirect, parameters, maps);
+
+		std::cout << "Baked " << input << " at " << EnvironmentMaps::qualityName(quality) << " quality (" << parameters.specularSize << "^2, "
+				  << parameters.specularLevels << " levels, " << parameters.specularSamples << " samples per texel) on " << pool.size() + 1 << " threads:" << std::endl;
+		for (const IblPrecompute::StageStats& stage : precompute.stats())
+		{
+			const double seconds = stage.ms / 1000.0;
+			std::cout << "  " << std::setw(13) << stage.name << ": " << std::setw(9) << stage.texels << " texels in "
+					  << std::setw(9) << stage.ms << " ms, " << double(stage.texels) / seconds / 1e6 << " Mtexels/s, "
+					  << double(stage.samples) / seconds / 1e6 << " Msamples/s" << std::endl;
+		}
+
+		if (!compare.empty())
+		{
+			std::shared_ptr<EnvironmentMaps> reference = EnvironmentMaps::load(compare, key, parameters);
+			if (nullptr == reference)
+			{
+				std::cerr << "ERROR: " << compare << " is not a cache file of " << input << " with the current programs" << std::endl;
+				return EXIT_FAILURE;
+			}
+			std::cout << "Difference to " << compare << ":" << std::endl;
+			printDifference(maps, *reference);
+			return EXIT_SUCCESS;
+		}
+
+		std::error_code error;
+		std::filesystem::create_directories(std::filesystem::path(output).parent_path(), error);
+		if (!maps.save(output))
+		{
+			std::cerr << "ERROR: could not write " << output << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cout << "Wrote " << output << std::endl;
+	}
+	catch (const std::runtime_error& error)
+	{
+		std::cerr << "ERROR: " << error.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}